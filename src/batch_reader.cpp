@@ -0,0 +1,444 @@
+#include "batch_reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <initializer_list>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace slclangd {
+namespace {
+
+enum Op : std::uint64_t { kOpOpen = 1, kOpRead = 2, kOpClose = 3 };
+
+static std::uint64_t userData(std::size_t slot, Op op) { return (static_cast<std::uint64_t>(slot) << 2) | op; }
+
+static int sysSetup(unsigned entries, io_uring_params* p) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int sysEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int sysRegister(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+// Whether the kernel implements every opcode in `ops`. The ring itself dates from 5.1, but
+// OPENAT/READ/CLOSE only from 5.6, as does the probe: where it fails, they're missing too.
+static bool supportsOps(int fd, std::initializer_list<unsigned> ops) {
+  constexpr unsigned kProbeOps = 256;
+  // io_uring_probe and its ops[], zeroed and suitably aligned.
+  std::vector<std::uint64_t> buf((sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op)) / sizeof(std::uint64_t));
+  auto* probe = reinterpret_cast<io_uring_probe*>(buf.data());
+  if (sysRegister(fd, IORING_REGISTER_PROBE, probe, kProbeOps) != 0) return false;
+  for (unsigned op : ops) {
+    if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+  }
+  return true;
+}
+
+static void* mapRing(int fd, std::size_t bytes, off_t offset) {
+  void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+  return p == MAP_FAILED ? nullptr : p;
+}
+
+// Reads the part of a file beyond what the first read returned.
+static bool readRest(int fd, std::string& out) {
+  while (true) {
+    std::size_t got = out.size();
+    out.resize(got + BatchFileReader::kBufferBytes);
+    ssize_t r = pread(fd, out.data() + got, BatchFileReader::kBufferBytes, static_cast<off_t>(got));
+    if (r < 0 && errno == EINTR) {
+      out.resize(got);
+      continue;
+    }
+    if (r <= 0) {
+      out.resize(got);
+      return r == 0;
+    }
+    out.resize(got + static_cast<std::size_t>(r));
+  }
+}
+
+// The mapping the current thread is scanning, if any (see onSigbus()).
+struct MappedRange {
+  char* begin = nullptr;
+  char* end = nullptr;
+};
+thread_local MappedRange t_mapped;
+struct sigaction g_prev_sigbus {};
+std::uintptr_t g_page_size = 0;  // sysconf() isn't async-signal-safe
+
+// Hands a SIGBUS that isn't ours to whatever handled SIGBUS before installSigbusHandler(); ours
+// stays installed for the next one.
+static void chainSigbus(int sig, siginfo_t* info, void* context) {
+  if (g_prev_sigbus.sa_flags & SA_SIGINFO) {
+    g_prev_sigbus.sa_sigaction(sig, info, context);
+    return;
+  }
+  // An ignored SIGBUS from a fault still kills the process, as it would without us.
+  if (g_prev_sigbus.sa_handler == SIG_IGN && info->si_code <= 0) return;
+  if (g_prev_sigbus.sa_handler != SIG_DFL && g_prev_sigbus.sa_handler != SIG_IGN) {
+    g_prev_sigbus.sa_handler(sig);
+    return;
+  }
+  // The default action: terminate with a core dump. SIGBUS stays blocked until the handler
+  // returns, so it is delivered (or the fault repeats) only under the default disposition.
+  struct sigaction dfl {};
+  dfl.sa_handler = SIG_DFL;
+  sigemptyset(&dfl.sa_mask);
+  sigaction(SIGBUS, &dfl, nullptr);
+  raise(SIGBUS);
+}
+
+// A file truncated while mapped faults with SIGBUS when the scan reaches its old end. If the
+// address is in this thread's mapping, the rest of the mapping is replaced with zero pages and the
+// read is retried: the scan goes on and sees NULs, so the file reads as binary (and a watcher will
+// report the change anyway). Any other SIGBUS is passed on to the previous handler.
+static void onSigbus(int sig, siginfo_t* info, void* context) {
+  char* addr = static_cast<char*>(info->si_addr);
+  const MappedRange m = t_mapped;
+  if (info->si_code > 0 && addr >= m.begin && addr < m.end) {
+    char* from = reinterpret_cast<char*>(reinterpret_cast<std::uintptr_t>(addr) & ~(g_page_size - 1));
+    if (mmap(from, static_cast<std::size_t>(m.end - from), PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) !=
+        MAP_FAILED) {
+      return;
+    }
+  }
+  chainSigbus(sig, info, context);
+}
+
+static void installSigbusHandler() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    g_page_size = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    struct sigaction sa {};
+    sa.sa_sigaction = onSigbus;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGBUS, &sa, &g_prev_sigbus);
+  });
+}
+
+// Read-only mapping of a whole file, hinted for one sequential pass. The page cache is scanned in
+// place instead of being copied out. While it's alive, a truncation of the file is survived (see
+// onSigbus()); one mapping per thread at a time.
+class MappedFile {
+ public:
+  explicit MappedFile(int fd) {
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return;
+    len_ = static_cast<std::size_t>(st.st_size);
+    installSigbusHandler();
+    void* p = mmap(nullptr, len_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) return;
+    addr_ = p;
+    t_mapped = {static_cast<char*>(addr_), static_cast<char*>(addr_) + len_};
+    (void)madvise(addr_, len_, MADV_SEQUENTIAL);
+    (void)madvise(addr_, len_, MADV_WILLNEED);
+  }
+  ~MappedFile() {
+    if (!addr_) return;
+    t_mapped = {};
+    munmap(addr_, len_);
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  explicit operator bool() const { return addr_ != nullptr; }
+  std::string_view view() const { return {static_cast<const char*>(addr_), len_}; }
+
+ private:
+  void* addr_ = nullptr;
+  std::size_t len_ = 0;
+};
+
+}  // namespace
+
+BatchFileReader::BatchFileReader(std::size_t depth) {
+  depth = std::max<std::size_t>(depth, 1);
+  if (!setupRing(depth)) teardownRing();
+}
+
+BatchFileReader::~BatchFileReader() { teardownRing(); }
+
+bool BatchFileReader::setupRing(std::size_t depth) {
+  // Each slot has at most one open/read outstanding, plus closes that haven't been reaped yet.
+  io_uring_params p{};
+  int fd = sysSetup(static_cast<unsigned>(depth * 2), &p);
+  if (fd < 0) return false;
+  ring_fd_ = fd;
+  if (!supportsOps(fd, {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE})) return false;
+
+  sq_map_bytes_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cq_map_bytes_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) sq_map_bytes_ = cq_map_bytes_ = std::max(sq_map_bytes_, cq_map_bytes_);
+  sq_map_ = mapRing(fd, sq_map_bytes_, IORING_OFF_SQ_RING);
+  if (!sq_map_) return false;
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_map_ = sq_map_;
+  } else {
+    cq_map_ = mapRing(fd, cq_map_bytes_, IORING_OFF_CQ_RING);
+    if (!cq_map_) return false;
+  }
+  sqes_bytes_ = p.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = mapRing(fd, sqes_bytes_, IORING_OFF_SQES);
+  if (!sqes_) return false;
+
+  auto* sq = static_cast<char*>(sq_map_);
+  auto* cq = static_cast<char*>(cq_map_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+  sq_entries_ = p.sq_entries;
+  cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+  cqes_ = cq + p.cq_off.cqes;
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+
+  slots_.resize(depth);
+  void* mem = mmap(nullptr, depth * kBufferBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) return false;
+  buffers_ = static_cast<char*>(mem);
+  // Registered buffers skip the per-read page pinning; not fatal if RLIMIT_MEMLOCK says no.
+  std::vector<iovec> iov(depth);
+  for (std::size_t i = 0; i < depth; ++i) iov[i] = {buffers_ + i * kBufferBytes, kBufferBytes};
+  buffers_registered_ = sysRegister(fd, IORING_REGISTER_BUFFERS, iov.data(), static_cast<unsigned>(depth)) == 0;
+  return true;
+}
+
+void BatchFileReader::teardownRing() {
+  if (buffers_) munmap(buffers_, slots_.size() * kBufferBytes);
+  if (sqes_) munmap(sqes_, sqes_bytes_);
+  if (cq_map_ && cq_map_ != sq_map_) munmap(cq_map_, cq_map_bytes_);
+  if (sq_map_) munmap(sq_map_, sq_map_bytes_);
+  if (ring_fd_ >= 0) close(ring_fd_);
+  buffers_ = nullptr;
+  sqes_ = sq_map_ = cq_map_ = nullptr;
+  ring_fd_ = -1;
+}
+
+void BatchFileReader::readAll(const std::vector<std::string>& paths, const FileFn& on_file, std::atomic_bool* cancelled) {
+  if (usesIoUring()) {
+    readAllUring(paths, on_file, cancelled);
+  } else {
+    readAllPread(paths, on_file, cancelled);
+  }
+}
+
+void BatchFileReader::readAllPread(const std::vector<std::string>& paths,
+                                   const FileFn& on_file,
+                                   std::atomic_bool* cancelled) {
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    if (cancelled && cancelled->load(std::memory_order_acquire)) return;
+    int fd = open(paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) continue;
+    struct stat st {};
+    bool more = true;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+      MappedFile mapped(static_cast<std::size_t>(st.st_size) > kMmapThreshold ? fd : -1);
+      big_.clear();
+      if (mapped) {
+        more = on_file(i, mapped.view());
+      } else if (readRest(fd, big_)) {
+        more = on_file(i, big_);
+      }
+    }
+    close(fd);
+    if (!more) return;
+  }
+}
+
+void BatchFileReader::push(const io_uring_sqe& sqe) {
+  const unsigned tail = *sq_tail_;
+  const unsigned idx = tail & sq_mask_;
+  static_cast<io_uring_sqe*>(sqes_)[idx] = sqe;
+  sq_array_[idx] = idx;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  ++to_submit_;
+  ++inflight_;
+}
+
+void BatchFileReader::queueOpen(std::size_t slot, const std::string& path) {
+  io_uring_sqe sqe{};
+  sqe.opcode = IORING_OP_OPENAT;
+  sqe.fd = AT_FDCWD;
+  sqe.addr = reinterpret_cast<std::uint64_t>(path.c_str());
+  sqe.open_flags = O_RDONLY | O_CLOEXEC;
+  sqe.user_data = userData(slot, kOpOpen);
+  push(sqe);
+}
+
+void BatchFileReader::queueRead(std::size_t slot) {
+  io_uring_sqe sqe{};
+  sqe.opcode = buffers_registered_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe.fd = slots_[slot].fd;
+  sqe.addr = reinterpret_cast<std::uint64_t>(buffers_ + slot * kBufferBytes);
+  sqe.len = kBufferBytes;
+  sqe.off = 0;
+  if (buffers_registered_) sqe.buf_index = static_cast<std::uint16_t>(slot);
+  sqe.user_data = userData(slot, kOpRead);
+  push(sqe);
+}
+
+void BatchFileReader::queueClose(int fd) {
+  io_uring_sqe sqe{};
+  sqe.opcode = IORING_OP_CLOSE;
+  sqe.fd = fd;
+  sqe.user_data = userData(0, kOpClose);
+  push(sqe);
+}
+
+bool BatchFileReader::enter(unsigned wait_for) {
+  while (true) {
+    int r = sysEnter(ring_fd_, to_submit_, wait_for, IORING_ENTER_GETEVENTS);
+    if (r >= 0) {
+      to_submit_ -= std::min<unsigned>(static_cast<unsigned>(r), to_submit_);
+      return true;
+    }
+    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+    return false;
+  }
+}
+
+void BatchFileReader::readAllUring(const std::vector<std::string>& paths,
+                                   const FileFn& on_file,
+                                   std::atomic_bool* cancelled) {
+  std::size_t next = 0;
+  bool stop = false;
+  std::vector<std::size_t> free_slots;
+  for (std::size_t s = slots_.size(); s-- > 0;) free_slots.push_back(s);
+  std::vector<bool> busy(slots_.size(), false);  // opening or reading a file not delivered yet
+  auto release = [&](std::size_t s) {
+    busy[s] = false;
+    free_slots.push_back(s);
+  };
+
+  auto startMore = [&]() {
+    // Each queued open may later need a close: keep room in the SQ for both.
+    while (!stop && next < paths.size() && !free_slots.empty() && inflight_ + 2 <= sq_entries_) {
+      std::size_t s = free_slots.back();
+      free_slots.pop_back();
+      busy[s] = true;
+      slots_[s] = Slot{next, -1};
+      queueOpen(s, paths[next++]);
+    }
+  };
+
+  // The ring is unusable: close what we opened, drop it (later calls use pread) and read the
+  // files in flight and those not started synchronously.
+  auto fallBack = [&]() {
+    // Opens that already completed tell us their fds.
+    for (unsigned head = *cq_head_; head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE); ++head) {
+      const auto* cqe = static_cast<const io_uring_cqe*>(cqes_) + (head & cq_mask_);
+      const auto s = static_cast<std::size_t>(cqe->user_data >> 2);
+      if ((cqe->user_data & 3) == kOpOpen && cqe->res >= 0) {
+        if (busy[s] && !stop) {
+          slots_[s].fd = cqe->res;
+        } else {
+          close(cqe->res);
+        }
+      }
+    }
+    // Closes the kernel never consumed are ours to do. (Those it did consume, like opens still
+    // running in its workers, finish or get cancelled with the ring.)
+    for (unsigned i = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE); i != *sq_tail_; ++i) {
+      const auto& sqe = static_cast<const io_uring_sqe*>(sqes_)[sq_array_[i & sq_mask_]];
+      if (sqe.opcode == IORING_OP_CLOSE) close(sqe.fd);
+    }
+    std::vector<std::size_t> unread;
+    for (std::size_t s = 0; s < slots_.size(); ++s) {
+      if (!busy[s]) continue;
+      if (slots_[s].fd >= 0) close(slots_[s].fd);
+      unread.push_back(slots_[s].path_index);
+    }
+    teardownRing();
+    if (stop) return;
+    std::sort(unread.begin(), unread.end());
+    for (std::size_t i = next; i < paths.size(); ++i) unread.push_back(i);
+    std::vector<std::string> rest;
+    rest.reserve(unread.size());
+    for (std::size_t i : unread) rest.push_back(paths[i]);
+    readAllPread(rest, [&](std::size_t i, std::string_view contents) { return on_file(unread[i], contents); },
+                 cancelled);
+  };
+
+  // Scans the whole file open in slot `s` from a mapping (or, failing that, read into big_).
+  // Returns false if on_file() says to stop.
+  auto deliverWhole = [&](std::size_t s) {
+    MappedFile mapped(slots_[s].fd);
+    if (mapped) return on_file(slots_[s].path_index, mapped.view());
+    big_.clear();
+    return !readRest(slots_[s].fd, big_) || on_file(slots_[s].path_index, big_);
+  };
+
+  startMore();
+  while (inflight_ > 0) {
+    if (!enter(1)) {
+      fallBack();
+      return;
+    }
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const auto* cqe = static_cast<const io_uring_cqe*>(cqes_) + (head & cq_mask_);
+      const auto op = static_cast<Op>(cqe->user_data & 3);
+      const auto s = static_cast<std::size_t>(cqe->user_data >> 2);
+      const int res = cqe->res;
+      --inflight_;
+      if (cancelled && cancelled->load(std::memory_order_acquire)) stop = true;
+
+      if (op == kOpClose) continue;
+      if (op == kOpOpen) {
+        if (res < 0) {
+          release(s);
+        } else if (stop) {
+          queueClose(res);
+          release(s);
+        } else {
+          slots_[s].fd = res;
+          // A file that won't fit in the buffer is scanned from a mapping right away rather than
+          // read once into the buffer first.
+          struct stat st {};
+          if (fstat(res, &st) == 0 && S_ISREG(st.st_mode) && static_cast<std::size_t>(st.st_size) > kMmapThreshold) {
+            if (!deliverWhole(s)) stop = true;
+            queueClose(res);
+            release(s);
+          } else {
+            queueRead(s);
+          }
+        }
+        continue;
+      }
+
+      // kOpRead
+      const int fd = slots_[s].fd;
+      if (res >= 0 && !stop) {
+        std::string_view contents(buffers_ + s * kBufferBytes, static_cast<std::size_t>(res));
+        if (static_cast<std::size_t>(res) == kBufferBytes) {
+          // Grew past the buffer since it was opened.
+          if (!deliverWhole(s)) stop = true;
+        } else if (!on_file(slots_[s].path_index, contents)) {
+          stop = true;
+        }
+      }
+      queueClose(fd);
+      release(s);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    startMore();
+  }
+}
+
+}  // namespace slclangd
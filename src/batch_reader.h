@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct io_uring_sqe;
+
+namespace slclangd {
+
+// Reads many whole files without waiting on each one in turn. With io_uring, up to `depth` files
+// are in flight at once: open, read into a buffer from a pool registered with the kernel, then
+// close, all submitted and reaped in batches. If io_uring is unavailable (old kernel, seccomp,
+// kernel.io_uring_disabled) it falls back to open + pread, one file at a time. Files larger than
+// kMmapThreshold are mmapped (with MADV_SEQUENTIAL/MADV_WILLNEED) rather than copied. The first
+// mapping installs a process-wide SIGBUS handler (once, for the life of the process), so a file
+// truncated while it's scanned reads as NULs past its new end instead of killing the process. It
+// only handles faults in the mappings being scanned, and passes any other SIGBUS on to the handler
+// that was installed before it.
+//
+// A reader is single-threaded; keep one per thread and reuse it, since setting up the ring and
+// registering its buffers is the expensive part.
+class BatchFileReader final {
+ public:
+  // 1 MiB of buffers per reader; most headers and sources fit in one buffer.
+  static constexpr std::size_t kDefaultDepth = 16;
+  static constexpr std::size_t kBufferBytes = 64 * 1024;
+  static constexpr std::size_t kMmapThreshold = kBufferBytes;  // smaller files are just read()
+
+  explicit BatchFileReader(std::size_t depth = kDefaultDepth);
+  ~BatchFileReader();
+
+  BatchFileReader(const BatchFileReader&) = delete;
+  BatchFileReader& operator=(const BatchFileReader&) = delete;
+
+  // Called with the index into `paths` and the file's contents (only valid during the call), in
+  // completion order. Files that can't be opened or read are skipped. Return false to stop.
+  using FileFn = std::function<bool(std::size_t index, std::string_view contents)>;
+
+  void readAll(const std::vector<std::string>& paths, const FileFn& on_file, std::atomic_bool* cancelled = nullptr);
+
+  bool usesIoUring() const { return ring_fd_ >= 0; }
+
+ private:
+  struct Slot {
+    std::size_t path_index = 0;
+    int fd = -1;
+  };
+
+  bool setupRing(std::size_t depth);
+  void teardownRing();
+  void readAllUring(const std::vector<std::string>& paths, const FileFn& on_file, std::atomic_bool* cancelled);
+  void readAllPread(const std::vector<std::string>& paths, const FileFn& on_file, std::atomic_bool* cancelled);
+
+  // Queue one SQE each; `user_data` encodes (slot, op).
+  void push(const struct io_uring_sqe& sqe);
+  void queueOpen(std::size_t slot, const std::string& path);
+  void queueRead(std::size_t slot);
+  void queueClose(int fd);
+  // Submits queued SQEs and waits for at least `wait_for` completions.
+  bool enter(unsigned wait_for);
+
+  int ring_fd_ = -1;
+  // Mapped SQ/CQ rings and SQE array (see io_uring_setup(2)).
+  void* sq_map_ = nullptr;
+  std::size_t sq_map_bytes_ = 0;
+  void* cq_map_ = nullptr;
+  std::size_t cq_map_bytes_ = 0;
+  void* sqes_ = nullptr;
+  std::size_t sqes_bytes_ = 0;
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  void* cqes_ = nullptr;
+  unsigned cq_mask_ = 0;
+  unsigned to_submit_ = 0;
+  unsigned inflight_ = 0;  // submitted or queued operations not reaped yet
+
+  bool buffers_registered_ = false;
+  char* buffers_ = nullptr;  // depth * kBufferBytes, one buffer per slot
+  std::vector<Slot> slots_;
+  std::string big_;  // contents of a file larger than kBufferBytes
+};
+
+}  // namespace slclangd
@@ -0,0 +1,859 @@
+#include "decl_scanner.h"
+
+#include <cctype>
+#include <cstring>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+namespace slclangd {
+namespace {
+
+static bool isIdentStart(unsigned char c) { return std::isalpha(c) || c == '_' || c == '$' || c >= 0x80; }
+static bool isIdentChar(unsigned char c) { return std::isalnum(c) || c == '_' || c == '$' || c >= 0x80; }
+
+// UTF-16 code units of UTF-8 text: one per character, two for those outside the BMP.
+static int utf16Length(std::string_view s) {
+  int n = 0;
+  for (unsigned char b : s) {
+    if ((b & 0xC0) != 0x80) ++n;
+    if (b >= 0xF0) ++n;
+  }
+  return n;
+}
+
+// "B" of "a::B".
+static std::string_view lastComponent(std::string_view scope) {
+  const std::size_t colons = scope.rfind("::");
+  return colons == std::string_view::npos ? scope : scope.substr(colons + 2);
+}
+
+static std::string joinScope(const std::string& outer, const std::string& inner) {
+  if (outer.empty()) return inner;
+  if (inner.empty()) return outer;
+  return outer + "::" + inner;
+}
+
+enum class TokKind : std::uint8_t { kIdent, kPunct, kLiteral };
+
+struct Token {
+  TokKind kind = TokKind::kPunct;
+  std::string_view text;
+  int line = 0;
+  int column = 0;  // UTF-16 units
+
+  bool is(std::string_view s) const { return text == s; }
+  bool ident() const { return kind == TokKind::kIdent; }
+};
+
+// Stand-ins the parser puts into a statement for skipped brace groups.
+constexpr std::string_view kInitBraces = "{}";      // initializer (or member initializer)
+constexpr std::string_view kBodyBraces = "{...}";  // class or enum body
+
+// Splits source into identifiers, punctuators ("::" and "->" are one token, everything else is one
+// character) and literals, dropping comments. Preprocessor directives are handled here: macro
+// definitions go straight to `out`, and the lines of #if branches that aren't followed are skipped.
+class Lexer {
+ public:
+  Lexer(std::string_view src, std::vector<Declaration>& out) : src_(src), out_(out) {}
+
+  bool next(Token& t) {
+    skipSpace();
+    if (pos_ >= src_.size()) return false;
+    at_bol_ = false;
+    const std::size_t start = pos_;
+    t.line = line_;
+    t.column = columnOf(start);
+    const auto c = static_cast<unsigned char>(src_[pos_]);
+    if (isIdentStart(c)) {
+      while (pos_ < src_.size() && isIdentChar(static_cast<unsigned char>(src_[pos_]))) ++pos_;
+      const std::string_view word = src_.substr(start, pos_ - start);
+      if (pos_ < src_.size() && (src_[pos_] == '"' || src_[pos_] == '\'') && isLiteralPrefix(word)) {
+        if (src_[pos_] == '"' && word.back() == 'R') {
+          rawString();
+        } else {
+          quoted(src_[pos_]);
+        }
+        t.kind = TokKind::kLiteral;
+      } else {
+        t.kind = TokKind::kIdent;
+      }
+    } else if (std::isdigit(c) || (c == '.' && pos_ + 1 < src_.size() && std::isdigit(static_cast<unsigned char>(src_[pos_ + 1])))) {
+      number();
+      t.kind = TokKind::kLiteral;
+    } else if (c == '"' || c == '\'') {
+      quoted(static_cast<char>(c));
+      t.kind = TokKind::kLiteral;
+    } else {
+      const std::string_view rest = src_.substr(pos_, 2);
+      pos_ += (rest == "::" || rest == "->") ? 2 : 1;
+      t.kind = TokKind::kPunct;
+    }
+    t.text = src_.substr(start, pos_ - start);
+    return true;
+  }
+
+ private:
+  // State of one #if chain.
+  enum class Branch : std::uint8_t {
+    kActive,    // reading the branch taken
+    kSkipRest,  // a branch was read: skip the others
+    kSeeking,   // after #if 0: skip until a branch may be taken
+    kNested,    // an #if inside skipped lines
+  };
+
+  static bool isLiteralPrefix(std::string_view w) {
+    return w == "R" || w == "u8R" || w == "uR" || w == "UR" || w == "LR" || w == "u8" || w == "u" || w == "U" ||
+           w == "L";
+  }
+
+  bool skipping() const { return inactive_ > 0; }
+
+  void newline() {
+    ++line_;
+    line_start_ = pos_ + 1;
+    at_bol_ = true;
+  }
+
+  int columnOf(std::size_t off) {
+    if (col_off_ < line_start_ || col_off_ > off) {
+      col_off_ = line_start_;
+      col_ = 0;
+    }
+    col_ += utf16Length(src_.substr(col_off_, off - col_off_));
+    col_off_ = off;
+    return col_;
+  }
+
+  void skipSpace() {
+    while (pos_ < src_.size()) {
+      const char c = src_[pos_];
+      if (c == '\n') {
+        newline();
+        ++pos_;
+      } else if (c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v') {
+        ++pos_;
+      } else if (c == '\\' && pos_ + 1 < src_.size() && (src_[pos_ + 1] == '\n' || src_[pos_ + 1] == '\r')) {
+        ++pos_;  // line continuation outside a directive
+      } else if (c == '/' && pos_ + 1 < src_.size() && src_[pos_ + 1] == '/') {
+        skipLine();
+      } else if (c == '/' && pos_ + 1 < src_.size() && src_[pos_ + 1] == '*') {
+        blockComment();
+      } else if (c == '#' && at_bol_) {
+        directive();
+      } else if (skipping()) {
+        skipLine();
+      } else {
+        return;
+      }
+    }
+  }
+
+  // Up to (not including) the end of the line.
+  void skipLine() {
+    const std::size_t nl = src_.find('\n', pos_);
+    pos_ = nl == std::string_view::npos ? src_.size() : nl;
+  }
+
+  void blockComment() {
+    pos_ += 2;
+    while (pos_ < src_.size() && !(src_[pos_] == '*' && pos_ + 1 < src_.size() && src_[pos_ + 1] == '/')) {
+      if (src_[pos_] == '\n') newline();
+      ++pos_;
+    }
+    pos_ = std::min(pos_ + 2, src_.size());
+  }
+
+  void quoted(char quote) {
+    ++pos_;
+    while (pos_ < src_.size() && src_[pos_] != quote && src_[pos_] != '\n') {
+      if (src_[pos_] == '\\' && pos_ + 1 < src_.size()) {
+        if (src_[pos_ + 1] == '\n') {
+          ++pos_;
+          newline();
+        }
+        ++pos_;
+      }
+      ++pos_;
+    }
+    if (pos_ < src_.size() && src_[pos_] == quote) ++pos_;
+  }
+
+  // R"delim( ... )delim"
+  void rawString() {
+    const std::size_t open = src_.find('(', pos_);
+    if (open == std::string_view::npos || open - pos_ > 17) {
+      quoted('"');
+      return;
+    }
+    std::string close = ")";
+    close.append(src_.substr(pos_ + 1, open - pos_ - 1));
+    close.push_back('"');
+    const std::size_t end = src_.find(close, open + 1);
+    const std::size_t stop = end == std::string_view::npos ? src_.size() : end + close.size();
+    for (; pos_ < stop; ++pos_) {
+      if (src_[pos_] == '\n') newline();
+    }
+  }
+
+  void number() {
+    while (pos_ < src_.size()) {
+      const auto c = static_cast<unsigned char>(src_[pos_]);
+      if (std::isalnum(c) || c == '_' || c == '.' || c == '\'') {
+        ++pos_;
+      } else if ((c == '+' || c == '-') && std::strchr("eEpP", src_[pos_ - 1]) != nullptr) {
+        ++pos_;  // exponent sign
+      } else {
+        break;
+      }
+    }
+  }
+
+  void directive() {
+    ++pos_;  // '#'
+    while (pos_ < src_.size() && (src_[pos_] == ' ' || src_[pos_] == '\t')) ++pos_;
+    const std::size_t name_start = pos_;
+    while (pos_ < src_.size() && isIdentChar(static_cast<unsigned char>(src_[pos_]))) ++pos_;
+    const std::string_view name = src_.substr(name_start, pos_ - name_start);
+    while (pos_ < src_.size() && (src_[pos_] == ' ' || src_[pos_] == '\t')) ++pos_;
+
+    if (name == "define" && !skipping() && pos_ < src_.size() && isIdentStart(static_cast<unsigned char>(src_[pos_]))) {
+      const std::size_t start = pos_;
+      while (pos_ < src_.size() && isIdentChar(static_cast<unsigned char>(src_[pos_]))) ++pos_;
+      Declaration d;
+      d.name = std::string(src_.substr(start, pos_ - start));
+      d.kind = DeclKind::kMacro;
+      d.line = line_;
+      d.column = columnOf(start);
+      d.length = utf16Length(d.name);
+      out_.push_back(std::move(d));
+    } else if (name == "if" || name == "ifdef" || name == "ifndef") {
+      Branch b = Branch::kActive;
+      if (skipping()) {
+        b = Branch::kNested;
+      } else if (name == "if" && isZero()) {
+        b = Branch::kSeeking;
+      }
+      push(b);
+    } else if (!branches_.empty() && (name == "elif" || name == "elifdef" || name == "elifndef" || name == "else")) {
+      const Branch b = branches_.back();
+      if (b == Branch::kActive) {
+        set(Branch::kSkipRest);
+      } else if (b == Branch::kSeeking && !(name == "elif" && isZero())) {
+        set(Branch::kActive);
+      }
+    } else if (name == "endif" && !branches_.empty()) {
+      set(Branch::kActive);
+      branches_.pop_back();
+    }
+
+    // The rest of the logical line, continuations included.
+    while (pos_ < src_.size() && src_[pos_] != '\n') {
+      if (src_[pos_] == '\\' && pos_ + 1 < src_.size() && src_[pos_ + 1] == '\n') {
+        ++pos_;
+        newline();
+      } else if (src_[pos_] == '/' && pos_ + 1 < src_.size() && src_[pos_ + 1] == '*') {
+        blockComment();
+        continue;
+      }
+      ++pos_;
+    }
+  }
+
+  // Whether an #if/#elif condition (at pos_) is a literal 0.
+  bool isZero() const {
+    if (pos_ >= src_.size() || src_[pos_] != '0') return false;
+    return pos_ + 1 >= src_.size() || !isIdentChar(static_cast<unsigned char>(src_[pos_ + 1]));
+  }
+
+  void push(Branch b) {
+    branches_.push_back(b);
+    if (b != Branch::kActive) ++inactive_;
+  }
+
+  void set(Branch b) {
+    Branch& cur = branches_.back();
+    if ((cur == Branch::kActive) != (b == Branch::kActive)) inactive_ += b == Branch::kActive ? -1 : 1;
+    cur = b;
+  }
+
+  std::string_view src_;
+  std::vector<Declaration>& out_;
+  std::size_t pos_ = 0;
+  int line_ = 0;
+  std::size_t line_start_ = 0;
+  bool at_bol_ = true;
+  std::size_t col_off_ = 0;
+  int col_ = 0;
+  std::vector<Branch> branches_;
+  int inactive_ = 0;  // entries of branches_ that aren't kActive
+};
+
+static bool isClassKey(const Token& t) {
+  return t.ident() && (t.is("class") || t.is("struct") || t.is("union") || t.is("enum"));
+}
+
+// Words that can't name a declaration.
+static bool isReserved(std::string_view w) {
+  static const std::unordered_set<std::string_view> kWords = {
+      "alignas",  "alignof",  "asm",       "auto",      "break",    "case",     "catch",    "const",
+      "consteval","constexpr","constinit", "continue",  "co_await", "co_return","co_yield", "decltype",
+      "default",  "delete",   "do",        "else",      "explicit", "export",   "extern",   "final",
+      "for",      "friend",   "goto",      "if",        "inline",   "mutable",  "new",      "noexcept",
+      "operator", "override", "register",  "requires",  "return",   "sizeof",   "static",   "static_assert",
+      "switch",   "template", "this",      "throw",     "try",      "typedef",  "typeid",   "typename",
+      "using",    "virtual",  "volatile",  "while",
+  };
+  return kWords.count(w) != 0;
+}
+
+// An EXPORT_MACRO-style word: no lowercase letters.
+static bool looksLikeMacro(std::string_view w) {
+  for (unsigned char c : w) {
+    if (std::islower(c)) return false;
+  }
+  return true;
+}
+
+// Turns tokens into declarations, one statement at a time. Namespaces, linkage specifications,
+// class bodies and enum bodies are scopes whose contents are scanned; any other brace group
+// (function bodies, initializers) is skipped as a whole.
+class Parser {
+ public:
+  explicit Parser(std::string_view src) : lex_(src, out_) { scopes_.push_back(Scope{ScopeKind::kNamespace, {}, {}, {}}); }
+
+  std::vector<Declaration> run() {
+    Token t;
+    while (lex_.next(t)) {
+      if (scopes_.back().kind == ScopeKind::kEnum) {
+        enumToken(t);
+        continue;
+      }
+      if (t.kind == TokKind::kPunct) {
+        if (t.is(";")) {
+          declaration();
+          stmt_.clear();
+          continue;
+        }
+        if (t.is("{")) {
+          openBrace();
+          continue;
+        }
+        if (t.is("}")) {
+          closeBrace();
+          continue;
+        }
+        if (t.is(":") && scopes_.back().kind == ScopeKind::kClass && isAccessLabel()) {
+          stmt_.clear();
+          continue;
+        }
+      }
+      stmt_.push_back(t);
+    }
+    return std::move(out_);
+  }
+
+ private:
+  enum class ScopeKind : std::uint8_t { kNamespace, kClass, kEnum };
+
+  struct Scope {
+    ScopeKind kind;
+    std::string container;    // of the declarations inside
+    std::vector<Token> outer;  // the enclosing statement, resumed after the closing brace
+    std::string name;         // class name (for constructors)
+    bool expect_enumerator = true;
+    int depth = 0;            // nesting inside an enum body
+  };
+
+  using Tokens = std::vector<Token>;
+
+  void add(const Token& at, std::string name, std::string container, DeclKind kind, bool definition) {
+    Declaration d;
+    d.length = utf16Length(name);
+    d.name = std::move(name);
+    d.container = std::move(container);
+    d.kind = kind;
+    d.definition = definition;
+    d.line = at.line;
+    d.column = at.column;
+    if (kind == DeclKind::kClass || kind == DeclKind::kStruct || kind == DeclKind::kUnion) {
+      classes_.insert(joinScope(d.container, d.name));
+    } else if (kind == DeclKind::kFunction && !d.container.empty()) {
+      const std::string_view last = lastComponent(d.container);
+      d.member = classes_.count(d.container) > 0 || d.name == last ||
+                 (d.name.size() == last.size() + 1 && d.name[0] == '~' && d.name.compare(1, last.size(), last) == 0);
+    }
+    out_.push_back(std::move(d));
+  }
+
+  // Skips to the brace closing one that was just read.
+  void skipBraces() {
+    int depth = 1;
+    Token t;
+    while (depth > 0 && lex_.next(t)) {
+      if (t.is("{")) ++depth;
+      if (t.is("}")) --depth;
+    }
+  }
+
+  bool isAccessLabel() const {
+    if (stmt_.empty()) return false;
+    const auto& w = stmt_.front().text;
+    if (w != "public" && w != "private" && w != "protected" && w != "signals" && w != "slots" && w != "Q_SIGNALS" &&
+        w != "Q_SLOTS") {
+      return false;
+    }
+    for (const auto& t : stmt_) {
+      if (!t.ident()) return false;
+    }
+    return true;
+  }
+
+  // Index after the group opened at `i` (by `open`), or the end.
+  static std::size_t skipGroup(const Tokens& st, std::size_t i, std::string_view open, std::string_view close) {
+    int depth = 0;
+    for (; i < st.size(); ++i) {
+      if (st[i].is(open)) ++depth;
+      if (st[i].is(close) && --depth == 0) return i + 1;
+    }
+    return st.size();
+  }
+
+  // The statement without template headers, attributes and alignment specifiers.
+  static Tokens strip(const Tokens& in) {
+    Tokens st;
+    st.reserve(in.size());
+    for (std::size_t i = 0; i < in.size();) {
+      const Token& t = in[i];
+      const bool call = i + 1 < in.size() && in[i + 1].is("(");
+      if (t.is("template") && i + 1 < in.size() && in[i + 1].is("<")) {
+        i = skipGroup(in, i + 1, "<", ">");
+      } else if (t.is("[") && i + 1 < in.size() && in[i + 1].is("[")) {
+        i = skipGroup(in, i, "[", "]");
+      } else if (call && (t.is("__attribute__") || t.is("__declspec") || t.is("alignas") || t.is("__asm__") ||
+                          t.is("asm"))) {
+        i = skipGroup(in, i + 1, "(", ")");
+      } else {
+        st.push_back(t);
+        ++i;
+      }
+    }
+    return st;
+  }
+
+  // Nesting depth of each token in (), [] and template <> (the latter only before `end`), with
+  // "<" counted only after a name. The tokens of an operator's name (`=` in operator=) get -1.
+  static std::vector<int> depths(const Tokens& st, std::size_t end) {
+    std::vector<int> d(st.size(), 0);
+    int paren = 0, angle = 0;
+    for (std::size_t i = 0; i < st.size(); ++i) {
+      const Token& t = st[i];
+      if (t.is("operator")) {
+        d[i] = paren + angle;
+        std::size_t k = i + 1;
+        if (k + 1 < st.size() && st[k].is("(") && st[k + 1].is(")")) k += 2;  // operator()
+        while (k < st.size() && !st[k].is("(")) ++k;
+        for (std::size_t j = i + 1; j < k; ++j) d[j] = -1;
+        i = k - 1;
+        continue;
+      }
+      if (t.is(")") || t.is("]")) --paren;
+      if (t.is(">") && angle > 0 && i < end) --angle;
+      d[i] = paren + angle;
+      if (t.is("(") || t.is("[")) ++paren;
+      if (t.is("<") && i < end && i > 0 && (st[i - 1].ident() || st[i - 1].is(">"))) ++angle;
+    }
+    return d;
+  }
+
+  static std::size_t findTop(const Tokens& st, const std::vector<int>& d, std::string_view what, std::size_t from = 0) {
+    for (std::size_t i = from; i < st.size(); ++i) {
+      if (d[i] == 0 && st[i].is(what)) return i;
+    }
+    return st.size();
+  }
+
+  struct QualifiedName {
+    std::size_t first = 0;  // index of the first token of the qualified name
+    std::size_t at = 0;     // index of the token the name starts at
+    std::string name;
+    std::string qualifier;  // "A::B" in A::B::name
+    bool valid = false;
+  };
+
+  // The qualifier of a name starting at `i`, walking back over "A<...>::" parts.
+  static void qualify(const Tokens& st, std::size_t i, QualifiedName& q) {
+    q.first = i;
+    while (q.first >= 2 && st[q.first - 1].is("::")) {
+      std::size_t k = q.first - 2;
+      if (st[k].is(">")) {
+        int depth = 0;
+        for (;; --k) {
+          if (st[k].is(">")) ++depth;
+          if (st[k].is("<") && --depth == 0) break;
+          if (k == 0) return;
+        }
+        if (k == 0) return;
+        --k;
+      }
+      if (!st[k].ident()) return;
+      q.qualifier = q.qualifier.empty() ? std::string(st[k].text) : std::string(st[k].text) + "::" + q.qualifier;
+      q.first = k;
+    }
+  }
+
+  // The function name whose parameter list opens at `paren`.
+  static QualifiedName functionName(const Tokens& st, std::size_t paren) {
+    QualifiedName q;
+    if (paren == 0) return q;
+    for (std::size_t i = paren; i-- > 0;) {
+      if (st[i].is("operator")) {
+        q.name = "operator";
+        for (std::size_t k = i + 1; k < paren; ++k) {
+          if (st[k].ident() && (st[k - 1].ident() || k == i + 1)) q.name.push_back(' ');
+          q.name.append(st[k].text);
+        }
+        q.at = i;
+        qualify(st, i, q);
+        q.valid = true;
+        return q;
+      }
+      if (i + 4 < paren) break;  // "operator" is close to the parenthesis
+    }
+    std::size_t i = paren - 1;
+    if (st[i].is(">")) {  // explicit specialization: f<int>(
+      int depth = 0;
+      for (;; --i) {
+        if (st[i].is(">")) ++depth;
+        if (st[i].is("<") && --depth == 0) break;
+        if (i == 0) return q;
+      }
+      if (i == 0) return q;
+      --i;
+    }
+    if (!st[i].ident() || isReserved(st[i].text)) return q;
+    q.at = i;
+    q.name = std::string(st[i].text);
+    if (i > 0 && st[i - 1].is("~")) {
+      q.name.insert(0, "~");
+      q.at = --i;
+    }
+    qualify(st, i, q);
+    q.valid = true;
+    return q;
+  }
+
+  // A function is declared with a return type, except for constructors and destructors; a bare
+  // NAME(...) at namespace scope is a macro invocation.
+  bool plausibleFunction(const QualifiedName& q) const {
+    if (q.first > 0 || !q.qualifier.empty()) return true;
+    const Scope& s = scopes_.back();
+    return s.kind == ScopeKind::kClass && !s.name.empty() && (q.name == s.name || q.name == "~" + s.name);
+  }
+
+  void openBrace() {
+    Scope& s = scopes_.back();
+    const Tokens st = strip(stmt_);
+    if (st.empty()) {
+      skipBraces();
+      return;
+    }
+
+    if (st[0].is("namespace") || (st.size() > 1 && st[0].is("inline") && st[1].is("namespace"))) {
+      // namespace a::inline b VISIBILITY(default) {
+      std::string name;
+      for (std::size_t i = st[0].is("inline") ? 2 : 1; i < st.size(); i += 2) {
+        if (st[i].is("inline")) ++i;
+        if (i >= st.size() || !st[i].ident()) break;
+        name = joinScope(name, std::string(st[i].text));
+        if (i + 1 >= st.size() || !st[i + 1].is("::")) break;
+      }
+      scopes_.push_back(Scope{ScopeKind::kNamespace, joinScope(s.container, name), {}, {}});
+      stmt_.clear();
+      return;
+    }
+    if (st.size() == 2 && st[0].is("extern") && st[1].kind == TokKind::kLiteral) {  // extern "C" {
+      scopes_.push_back(Scope{ScopeKind::kNamespace, s.container, {}, {}});
+      stmt_.clear();
+      return;
+    }
+
+    // Braces in an unclosed parenthesis (a default argument) or after '=' initialize something.
+    int open = 0;
+    for (const auto& t : st) open += t.is("(") || t.is("[") ? 1 : t.is(")") || t.is("]") ? -1 : 0;
+    const std::vector<int> d = depths(st, st.size());
+    if (open > 0 || findTop(st, d, "=") < st.size()) {
+      initializer();
+      return;
+    }
+    const std::size_t paren = findTop(st, d, "(");
+    std::size_t key = st.size();
+    for (std::size_t i = 0; i < paren; ++i) {
+      if (d[i] == 0 && isClassKey(st[i])) {
+        key = i;
+        break;
+      }
+    }
+
+    if (paren < st.size()) {
+      // After the parameters, a ':' starts a constructor's member initializers: `a_{x}` braces
+      // there belong to the statement.
+      const std::size_t close = skipGroup(st, paren, "(", ")");
+      if (findTop(st, d, ":", close) < st.size() && (st.back().ident() || st.back().is(">"))) {
+        initializer();
+        return;
+      }
+      const QualifiedName q = functionName(st, paren);
+      if (q.valid && plausibleFunction(q)) {
+        add(st[q.at], q.name, joinScope(s.container, q.qualifier), DeclKind::kFunction, true);
+      }
+      skipBraces();
+      stmt_.clear();
+      return;
+    }
+
+    if (key < st.size()) {
+      std::size_t i = key + 1;
+      DeclKind kind = DeclKind::kClass;
+      if (st[key].is("struct")) kind = DeclKind::kStruct;
+      if (st[key].is("union")) kind = DeclKind::kUnion;
+      if (st[key].is("enum")) {
+        kind = DeclKind::kEnum;
+        if (i < st.size() && (st[i].is("class") || st[i].is("struct"))) ++i;
+      }
+      // The name is the last word before the base clause / specialization arguments; a word
+      // before it is an export macro, or else the type of a `struct stat st{}` variable.
+      std::size_t name = st.size();
+      std::size_t words = 0;
+      for (; i < st.size(); ++i) {
+        if (st[i].is(":") || st[i].is("<")) break;
+        if (st[i].ident() && !st[i].is("final")) {
+          if (name < st.size() && !st[i - 1].is("::")) ++words;
+          name = i;
+        }
+      }
+      if (words > 0 && !looksLikeMacro(st[name - 1 - (st[name - 1].is("::") ? 1 : 0)].text)) {
+        initializer();
+        return;
+      }
+      QualifiedName q;
+      std::string container = s.container;
+      std::string scope_name;
+      if (name < st.size()) {
+        qualify(st, name, q);
+        container = joinScope(s.container, q.qualifier);
+        scope_name = std::string(st[name].text);
+        add(st[name], scope_name, container, kind, true);
+      }
+      const ScopeKind inner = kind == DeclKind::kEnum ? ScopeKind::kEnum : ScopeKind::kClass;
+      std::string inner_container = joinScope(container, scope_name);
+      scopes_.push_back(Scope{inner, std::move(inner_container), std::move(stmt_), std::move(scope_name)});
+      stmt_.clear();
+      return;
+    }
+
+    // `T name{...}`
+    if (st.size() >= 2 && st.back().ident()) {
+      initializer();
+      return;
+    }
+    skipBraces();
+    stmt_.clear();
+  }
+
+  void initializer() {
+    skipBraces();
+    Token t = stmt_.empty() ? Token{} : stmt_.back();
+    t.kind = TokKind::kPunct;
+    t.text = kInitBraces;
+    stmt_.push_back(t);
+  }
+
+  void closeBrace() {
+    if (scopes_.size() == 1) {  // unbalanced
+      stmt_.clear();
+      return;
+    }
+    Scope s = std::move(scopes_.back());
+    scopes_.pop_back();
+    stmt_.clear();
+    if (s.kind == ScopeKind::kNamespace) return;
+    stmt_ = std::move(s.outer);
+    Token t;
+    t.text = kBodyBraces;
+    stmt_.push_back(t);
+  }
+
+  void enumToken(const Token& t) {
+    Scope& s = scopes_.back();
+    if (s.depth == 0 && t.is("}")) {
+      closeBrace();
+      return;
+    }
+    if (t.is("(") || t.is("[") || t.is("{")) ++s.depth;
+    if (t.is(")") || t.is("]") || t.is("}")) --s.depth;
+    if (s.depth == 0 && t.is(",")) {
+      s.expect_enumerator = true;
+    } else if (s.expect_enumerator && t.ident()) {
+      add(t, std::string(t.text), s.container, DeclKind::kEnumerator, true);
+      s.expect_enumerator = false;
+    }
+  }
+
+  void declaration() {
+    Tokens st = strip(stmt_);
+    // Whatever precedes a typedef is a macro invocation without a semicolon (__BEGIN_DECLS).
+    for (std::size_t i = 1; i < st.size(); ++i) {
+      if (st[i].is("typedef")) {
+        st.erase(st.begin(), st.begin() + static_cast<std::ptrdiff_t>(i));
+        break;
+      }
+    }
+    if (st.empty()) return;
+    const Scope& s = scopes_.back();
+    const bool class_scope = s.kind == ScopeKind::kClass;
+    const std::string_view first = st[0].text;
+
+    if (first == "using") {
+      if (st.size() >= 3 && st[1].ident() && st[2].is("=")) {
+        add(st[1], std::string(st[1].text), s.container, DeclKind::kTypedef, true);
+      }
+      return;
+    }
+    if (first == "namespace" || first == "friend" || first == "static_assert" || first == "template" ||
+        (first == "extern" && st.size() > 1 && st[1].is("template"))) {
+      return;
+    }
+    const bool is_typedef = first == "typedef";
+
+    // struct X {...} a, b;  typedef struct {...} T;
+    std::size_t body = st.size();
+    for (std::size_t i = 0; i < st.size(); ++i) {
+      if (st[i].is(kBodyBraces)) body = i;
+    }
+    if (body < st.size()) {
+      if (!is_typedef && class_scope) return;
+      declarators(st, body + 1, false, s.container, is_typedef ? DeclKind::kTypedef : DeclKind::kVariable, true, false);
+      return;
+    }
+
+    // Forward declarations: class X;  enum class E : int;  class EXPORT_MACRO X;
+    // (A one-letter word is a type, not a macro: `struct S s1;` declares a variable.)
+    std::size_t lead = is_typedef ? 1 : 0;
+    while (lead < st.size() && (st[lead].is("extern") || st[lead].is("export") || st[lead].is("static"))) ++lead;
+    if (!is_typedef && lead < st.size() && isClassKey(st[lead])) {
+      std::size_t i = lead + 1;
+      if (st[lead].is("enum") && i < st.size() && (st[i].is("class") || st[i].is("struct"))) ++i;
+      std::size_t end = i;
+      while (end < st.size() && (st[end].ident() || st[end].is("::"))) ++end;
+      const bool opaque_enum = end < st.size() && st[end].is(":") && st[lead].is("enum");
+      std::size_t words = 0;
+      for (std::size_t k = i; k < end; ++k) {
+        if (st[k].ident() && (k == i || !st[k - 1].is("::"))) ++words;
+      }
+      if (end > i && st[end - 1].ident() && (end == st.size() || opaque_enum) &&
+          (words == 1 || (words == 2 && st[i].text.size() > 1 && looksLikeMacro(st[i].text)))) {
+        DeclKind kind = DeclKind::kClass;
+        if (st[lead].is("struct")) kind = DeclKind::kStruct;
+        if (st[lead].is("union")) kind = DeclKind::kUnion;
+        if (st[lead].is("enum")) kind = DeclKind::kEnum;
+        QualifiedName q;
+        qualify(st, end - 1, q);
+        add(st[end - 1], std::string(st[end - 1].text), joinScope(s.container, q.qualifier), kind, false);
+        return;
+      }
+    }
+
+    bool is_extern = false;
+    for (const auto& t : st) {
+      if (t.is("extern")) is_extern = true;
+      if (t.is("return") || t.is("goto")) return;  // lost track: this is a function body
+    }
+    declarators(st, lead, true, s.container, is_typedef ? DeclKind::kTypedef : DeclKind::kVariable, !is_extern,
+                class_scope);
+  }
+
+  // Records the names declared by the comma-separated declarators in st[from, end). With
+  // `type_first`, the first one also holds the type (so it needs a name after it). Function
+  // declarators declare functions, other ones `kind` (variables outside classes only).
+  void declarators(const Tokens& st, std::size_t from, bool type_first, const std::string& container, DeclKind kind,
+                   bool definition, bool class_scope) {
+    const std::vector<int> d = depths(st, findTop(st, depths(st, 0), "="));
+    std::size_t begin = from;
+    for (std::size_t i = from; i <= st.size(); ++i) {
+      if (i < st.size() && !(d[i] == 0 && st[i].is(","))) continue;
+      declarator(st, d, begin, i, type_first && begin == from ? 2 : 1, container, kind, definition, class_scope);
+      begin = i + 1;
+    }
+  }
+
+  void declarator(const Tokens& st, const std::vector<int>& d, std::size_t begin, std::size_t end, std::size_t min_tokens,
+                  const std::string& container, DeclKind kind, bool definition, bool class_scope) {
+    bool has_init = false;
+    for (std::size_t i = begin; i < end; ++i) {
+      if (d[i] == 0 && (st[i].is("=") || st[i].is(kInitBraces))) {
+        end = i;
+        has_init = true;
+        break;
+      }
+    }
+    if (end <= begin) return;
+    if (has_init) definition = true;
+
+    // (*name)(...), (&name)[N], (C::*name)
+    for (std::size_t i = begin; i + 2 < end; ++i) {
+      if (d[i] != 0 || !st[i].is("(")) continue;
+      std::size_t k = i + 1;
+      while (k + 1 < end && st[k].ident() && st[k + 1].is("::")) k += 2;
+      if ((st[k].is("*") || st[k].is("&") || st[k].is("^")) && k + 1 < end && st[k + 1].ident()) {
+        if (kind == DeclKind::kTypedef || !class_scope) {
+          add(st[k + 1], std::string(st[k + 1].text), container, kind, definition);
+        }
+        return;
+      }
+      break;
+    }
+
+    const std::size_t paren = findTop(st, d, "(", begin);
+    if (paren < end) {
+      if (kind == DeclKind::kTypedef) return;  // typedef int F(int): rare
+      QualifiedName q = functionName(st, paren);
+      if (!q.valid || q.first < begin || !plausibleFunction(q)) return;
+      add(st[q.at], q.name, joinScope(container, q.qualifier), DeclKind::kFunction, false);
+      return;
+    }
+
+    if (class_scope && kind != DeclKind::kTypedef) return;  // data members aren't indexed
+    if (end - begin < min_tokens) return;
+    // The name is the last word before an array bound or a bit-field width.
+    std::size_t stop = end;
+    for (std::size_t i = begin; i < end; ++i) {
+      if (d[i] == 0 && (st[i].is("[") || st[i].is(":"))) {
+        stop = i;
+        break;
+      }
+    }
+    if (stop == begin) return;
+    const Token& name = st[stop - 1];
+    if (!name.ident() || isReserved(name.text)) return;
+    QualifiedName q;
+    qualify(st, stop - 1, q);
+    if (q.first == begin && min_tokens == 2) return;  // no type: not a declaration
+    add(name, std::string(name.text), joinScope(container, q.qualifier), kind, definition);
+  }
+
+  std::vector<Declaration> out_;
+  Lexer lex_;
+  std::vector<Scope> scopes_;
+  Tokens stmt_;
+  std::unordered_set<std::string> classes_;  // classes, structs and unions seen so far ("a::B")
+};
+
+}  // namespace
+
+std::vector<Declaration> scanDeclarations(std::string_view source) {
+  if (std::memchr(source.data(), '\0', source.size()) != nullptr) return {};
+  return Parser(source).run();
+}
+
+}  // namespace slclangd
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace slclangd {
+
+enum class DeclKind : std::uint8_t {
+  kMacro,
+  kClass,
+  kStruct,
+  kUnion,
+  kEnum,
+  kEnumerator,
+  kTypedef,  // typedef or alias declaration (using X = ...)
+  kFunction,
+  kVariable,
+};
+
+struct Declaration {
+  std::string name;
+  std::string container;  // enclosing namespaces/classes, "a::B" (empty at file scope)
+  DeclKind kind = DeclKind::kVariable;
+  bool definition = true;  // false for prototypes, forward declarations and extern variables
+  // A function whose container is a class, struct or union (declared in its body, or defined out of
+  // line when the class is declared earlier in the file or the function is a constructor).
+  bool member = false;
+  int line = 0;            // 0-based
+  int column = 0;          // 0-based, in UTF-16 code units like LSP positions
+  int length = 0;          // of the name, in UTF-16 code units
+};
+
+// Finds the declarations ctags would list in C/C++ source, at the token level (no preprocessing,
+// no real parsing): macros, classes/structs/unions, enums and their enumerators, typedefs and alias
+// declarations, functions (including members declared in class bodies) and namespace-scope
+// variables. Function bodies and initializers are skipped, and only the first branch of each
+// #if/#elif/#else chain is read (so braces stay balanced), except that `#if 0` blocks are skipped.
+// Binary data (a NUL byte) yields nothing.
+std::vector<Declaration> scanDeclarations(std::string_view source);
+
+}  // namespace slclangd
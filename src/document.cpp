@@ -0,0 +1,244 @@
+#include "document.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "inproc_search.h"
+
+namespace slclangd {
+namespace {
+
+// Edits copy at most a couple of chunks, so keep them small; merging keeps them from fragmenting.
+constexpr std::size_t kChunkBytes = 16 * 1024;
+constexpr std::size_t kMinChunkBytes = kChunkBytes / 4;
+
+static std::size_t utf8SequenceLength(unsigned char lead) {
+  if (lead < 0x80) return 1;
+  if ((lead >> 5) == 0x6) return 2;
+  if ((lead >> 4) == 0xE) return 3;
+  if ((lead >> 3) == 0x1E) return 4;
+  return 1;  // stray continuation / invalid byte: count it as one unit
+}
+
+}  // namespace
+
+std::size_t utf16ToByteColumn(std::string_view line, int character) {
+  std::size_t i = 0;
+  int units = 0;
+  while (i < line.size() && units < character) {
+    std::size_t len = std::min(utf8SequenceLength(static_cast<unsigned char>(line[i])), line.size() - i);
+    units += len == 4 ? 2 : 1;  // astral code points are a surrogate pair in UTF-16
+    i += len;
+  }
+  return i;
+}
+
+int byteToUtf16Column(std::string_view line, std::size_t byte_column) {
+  std::size_t end = std::min(byte_column, line.size());
+  std::size_t i = 0;
+  int units = 0;
+  while (i < end) {
+    std::size_t len = utf8SequenceLength(static_cast<unsigned char>(line[i]));
+    units += len == 4 ? 2 : 1;
+    i += len;
+  }
+  return units;
+}
+
+Document::Document(std::string_view text) {
+  appendChunks(text, chunks_);
+  reindex();
+}
+
+Document::Document(const Document& other) {
+  std::lock_guard<std::mutex> lg(other.line_mu_);
+  chunks_ = other.chunks_;
+  byte_end_ = other.byte_end_;
+  line_end_ = other.line_end_;
+  line_starts_ = other.line_starts_;
+}
+
+Document::Document(Document&& other) noexcept
+    : chunks_(std::move(other.chunks_)),
+      byte_end_(std::move(other.byte_end_)),
+      line_end_(std::move(other.line_end_)),
+      line_starts_(std::move(other.line_starts_)) {}
+
+Document& Document::operator=(const Document& other) {
+  if (this != &other) *this = Document(other);
+  return *this;
+}
+
+Document& Document::operator=(Document&& other) noexcept {
+  if (this != &other) {
+    chunks_ = std::move(other.chunks_);
+    byte_end_ = std::move(other.byte_end_);
+    line_end_ = std::move(other.line_end_);
+    line_starts_ = std::move(other.line_starts_);
+  }
+  return *this;
+}
+
+std::shared_ptr<const Document::Chunk> Document::makeChunk(std::string text) {
+  auto c = std::make_shared<Chunk>();
+  c->newlines = static_cast<std::size_t>(std::count(text.begin(), text.end(), '\n'));
+  c->text = std::move(text);
+  return c;
+}
+
+void Document::appendChunks(std::string_view text, std::vector<std::shared_ptr<const Chunk>>& out) {
+  for (std::size_t pos = 0; pos < text.size(); pos += kChunkBytes) {
+    out.push_back(makeChunk(std::string(text.substr(pos, kChunkBytes))));
+  }
+}
+
+void Document::reindex() {
+  byte_end_.resize(chunks_.size());
+  line_end_.resize(chunks_.size());
+  std::size_t bytes = 0, lines = 0;
+  for (std::size_t i = 0; i < chunks_.size(); ++i) {
+    bytes += chunks_[i]->text.size();
+    lines += chunks_[i]->newlines;
+    byte_end_[i] = bytes;
+    line_end_[i] = lines;
+  }
+}
+
+void Document::extendLineStartsLocked() const {
+  // Scan forward from the last known line start; the table is then complete.
+  if (line_starts_.empty()) line_starts_.push_back(0);
+  if (line_starts_.size() >= lineCount()) return;
+  line_starts_.reserve(lineCount());
+  std::size_t from = line_starts_.back();
+  auto i = static_cast<std::size_t>(std::upper_bound(byte_end_.begin(), byte_end_.end(), from) - byte_end_.begin());
+  for (; i < chunks_.size(); ++i) {
+    std::size_t base = chunkBegin(i);
+    std::size_t off = from > base ? from - base : 0;
+    appendLineStarts(std::string_view(chunks_[i]->text).substr(off), static_cast<std::uint32_t>(base + off),
+                     line_starts_);
+  }
+}
+
+void Document::adjustLineStartsLocked(std::size_t begin, std::size_t end, std::string_view text) {
+  // Lines starting at or before `begin` are untouched by the edit.
+  auto keep = static_cast<std::size_t>(std::upper_bound(line_starts_.begin(), line_starts_.end(), begin) -
+                                       line_starts_.begin());
+  bool breaks_unchanged = keep < line_starts_.size() && line_starts_[keep] > end &&
+                          text.find('\n') == std::string_view::npos;
+  if (!breaks_unchanged) {
+    line_starts_.resize(keep);
+    return;
+  }
+  // Same line structure, only shifted: the common case of typing within a line.
+  const auto delta = static_cast<std::uint32_t>(text.size() - (end - begin));  // wraps for deletions
+  for (std::size_t k = keep; k < line_starts_.size(); ++k) line_starts_[k] += delta;
+}
+
+std::size_t Document::lineStart(int line) const {
+  if (line <= 0) return 0;
+  const auto target = static_cast<std::size_t>(line);
+  if (target >= lineCount()) return size();
+  std::lock_guard<std::mutex> lg(line_mu_);
+  if (target >= line_starts_.size()) extendLineStartsLocked();
+  return line_starts_[target];
+}
+
+std::string Document::line(int line) const {
+  if (line < 0 || static_cast<std::size_t>(line) >= lineCount()) return {};
+  std::size_t start = lineStart(line);
+  std::size_t stop = static_cast<std::size_t>(line) + 1 < lineCount() ? lineStart(line + 1) - 1 : size();
+  std::string out;
+  out.reserve(stop - start);
+  auto i = static_cast<std::size_t>(std::upper_bound(byte_end_.begin(), byte_end_.end(), start) - byte_end_.begin());
+  for (; i < chunks_.size() && chunkBegin(i) < stop; ++i) {
+    std::size_t base = chunkBegin(i);
+    std::size_t from = std::max(start, base) - base;
+    std::size_t to = std::min(stop, byte_end_[i]) - base;
+    out.append(chunks_[i]->text, from, to - from);
+  }
+  if (!out.empty() && out.back() == '\r') out.pop_back();
+  return out;
+}
+
+std::size_t Document::offsetAt(int line, int character) const {
+  if (line < 0) return 0;
+  if (static_cast<std::size_t>(line) >= lineCount()) return size();
+  return lineStart(line) + utf16ToByteColumn(this->line(line), character);
+}
+
+void Document::replace(std::size_t begin, std::size_t end, std::string_view text) {
+  const std::size_t n = size();
+  begin = std::min(begin, n);
+  end = std::min(std::max(end, begin), n);
+  {
+    std::lock_guard<std::mutex> lg(line_mu_);
+    adjustLineStartsLocked(begin, end, text);
+  }
+  if (chunks_.empty()) {
+    appendChunks(text, chunks_);
+    reindex();
+    return;
+  }
+
+  // Chunks [first, last] hold the edited range (an insertion at the very end edits the last chunk).
+  auto chunkOf = [&](std::size_t off) {
+    auto i = static_cast<std::size_t>(std::upper_bound(byte_end_.begin(), byte_end_.end(), off) - byte_end_.begin());
+    return std::min(i, chunks_.size() - 1);
+  };
+  std::size_t first = chunkOf(begin);
+  std::size_t last = end > begin ? chunkOf(end - 1) : first;
+
+  std::string merged;
+  const std::string& head = chunks_[first]->text;
+  const std::string& tail = chunks_[last]->text;
+  std::size_t head_len = begin - chunkBegin(first);
+  std::size_t tail_from = end - chunkBegin(last);
+  merged.reserve(head_len + text.size() + (tail.size() - tail_from));
+  merged.append(head, 0, head_len);
+  merged.append(text);
+  merged.append(tail, tail_from, std::string::npos);
+
+  // Fold a small result into a neighbour so deletions don't leave a trail of tiny chunks.
+  if (merged.size() < kMinChunkBytes) {
+    if (last + 1 < chunks_.size()) {
+      merged += chunks_[++last]->text;
+    } else if (first > 0) {
+      merged.insert(0, chunks_[--first]->text);
+    }
+  }
+
+  std::vector<std::shared_ptr<const Chunk>> replacement;
+  appendChunks(merged, replacement);
+  chunks_.erase(chunks_.begin() + static_cast<std::ptrdiff_t>(first), chunks_.begin() + static_cast<std::ptrdiff_t>(last) + 1);
+  chunks_.insert(chunks_.begin() + static_cast<std::ptrdiff_t>(first), replacement.begin(), replacement.end());
+  reindex();
+}
+
+std::string Document::str() const {
+  std::string out;
+  out.reserve(size());
+  for (const auto& c : chunks_) out += c->text;
+  return out;
+}
+
+bool Document::contains(std::string_view needle) const {
+  if (needle.empty()) return true;
+  std::string seam;
+  for (std::size_t i = 0; i < chunks_.size(); ++i) {
+    const std::string& text = chunks_[i]->text;
+    if (findFixedString(text, needle) != std::string_view::npos) return true;
+    // A match starting in the chunk's last needle.size() - 1 bytes ends in the ones after them.
+    const std::size_t overlap = needle.size() - 1;
+    if (overlap == 0 || i + 1 == chunks_.size()) continue;
+    seam.assign(text, text.size() - std::min(text.size(), overlap));
+    const std::size_t tail = seam.size();
+    for (std::size_t j = i + 1; j < chunks_.size() && seam.size() < tail + overlap; ++j) {
+      seam.append(chunks_[j]->text, 0, tail + overlap - seam.size());
+    }
+    if (findFixedString(seam, needle) != std::string_view::npos) return true;
+  }
+  return false;
+}
+
+}  // namespace slclangd
+
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace slclangd {
+
+// Byte length of the first `character` UTF-16 code units of `line` (LSP positions count UTF-16
+// units by default). Clamped to the line length.
+std::size_t utf16ToByteColumn(std::string_view line, int character);
+
+// Inverse of utf16ToByteColumn(): UTF-16 code units in the first `byte_column` bytes of `line`.
+int byteToUtf16Column(std::string_view line, std::size_t byte_column);
+
+// Text of an open editor buffer, stored as a rope of immutable chunks: an edit only copies the
+// chunks it touches (a few KB) instead of the whole document, and copies of a Document share
+// their chunks. Per-chunk byte and newline totals are kept as prefix sums, so finding the chunk
+// holding a line or byte offset is a binary search.
+//
+// Line starts are additionally cached in a flat table that is filled lazily (one vectorized
+// newline scan) and kept across edits: entries before an edit stay valid, entries after it are
+// shifted when the edit doesn't add or remove line breaks and rescanned on demand otherwise. A
+// line lookup is then O(1). The table holds 32-bit offsets, so documents are limited to 4 GiB.
+class Document final {
+ public:
+  Document() = default;
+  explicit Document(std::string_view text);
+  Document(const Document& other);
+  Document(Document&& other) noexcept;
+  Document& operator=(const Document& other);
+  Document& operator=(Document&& other) noexcept;
+
+  std::size_t size() const { return byte_end_.empty() ? 0 : byte_end_.back(); }
+  std::size_t lineCount() const { return (line_end_.empty() ? 0 : line_end_.back()) + 1; }
+
+  // Byte offset of the LSP position (`line`, `character`); `character` counts UTF-16 code units.
+  // Positions past the end of a line (or of the document) are clamped.
+  std::size_t offsetAt(int line, int character) const;
+
+  // Replaces the bytes in [begin, end) with `text`.
+  void replace(std::size_t begin, std::size_t end, std::string_view text);
+
+  // Text of `line` (0-based) without its line terminator; empty if out of range.
+  std::string line(int line) const;
+
+  std::string str() const;
+
+  // Whether `needle` occurs in the text, without materializing it.
+  bool contains(std::string_view needle) const;
+
+  // Calls `fn(text, newlines)` for each piece of the text in order, with the number of '\n' in it.
+  template <typename Fn>
+  void forEachChunk(Fn&& fn) const {
+    for (const auto& c : chunks_) fn(std::string_view(c->text), c->newlines);
+  }
+
+ private:
+  struct Chunk {
+    std::string text;
+    std::size_t newlines = 0;
+  };
+
+  static std::shared_ptr<const Chunk> makeChunk(std::string text);
+  static void appendChunks(std::string_view text, std::vector<std::shared_ptr<const Chunk>>& out);
+  void reindex();
+  std::size_t chunkBegin(std::size_t i) const { return i == 0 ? 0 : byte_end_[i - 1]; }
+  std::size_t lineStart(int line) const;
+  void extendLineStartsLocked() const;
+  void adjustLineStartsLocked(std::size_t begin, std::size_t end, std::string_view text);
+
+  std::vector<std::shared_ptr<const Chunk>> chunks_;
+  std::vector<std::size_t> byte_end_;  // bytes in chunks [0, i]
+  std::vector<std::size_t> line_end_;  // newlines in chunks [0, i]
+
+  // Start offsets of lines [0, line_starts_.size()); complete once it has lineCount() entries.
+  // Filled from const readers, hence the mutex.
+  mutable std::mutex line_mu_;
+  mutable std::vector<std::uint32_t> line_starts_;
+};
+
+}  // namespace slclangd
+
@@ -0,0 +1,53 @@
+#include "document_store.h"
+
+#include <utility>
+
+namespace slclangd {
+
+const std::vector<Declaration>& DocumentSnapshot::declarations() const {
+  std::call_once(decls_once_, [this]() { decls_ = scanDeclarations(text.str()); });
+  return decls_;
+}
+
+DocumentStore::DocumentStore() : map_(std::make_shared<const Map>()) {}
+
+DocumentStore::Snapshot DocumentStore::get(const std::string& uri) const {
+  std::shared_ptr<const Map> map = map_.load(std::memory_order_acquire);
+  auto it = map->find(uri);
+  if (it == map->end()) return nullptr;
+  return it->second->current.load(std::memory_order_acquire);
+}
+
+void DocumentStore::publish(const std::string& uri, Snapshot snapshot) {
+  std::lock_guard<std::mutex> lg(write_mu_);
+  std::shared_ptr<const Map> map = map_.load(std::memory_order_acquire);
+  auto it = map->find(uri);
+  if (it != map->end()) {
+    it->second->current.store(std::move(snapshot), std::memory_order_release);
+    return;
+  }
+  auto slot = std::make_shared<Slot>();
+  slot->current.store(std::move(snapshot), std::memory_order_relaxed);
+  auto next = std::make_shared<Map>(*map);
+  next->emplace(uri, std::move(slot));
+  map_.store(std::move(next), std::memory_order_release);
+}
+
+void DocumentStore::erase(const std::string& uri) {
+  std::lock_guard<std::mutex> lg(write_mu_);
+  std::shared_ptr<const Map> map = map_.load(std::memory_order_acquire);
+  if (map->find(uri) == map->end()) return;
+  auto next = std::make_shared<Map>(*map);
+  next->erase(uri);
+  map_.store(std::move(next), std::memory_order_release);
+}
+
+std::vector<std::pair<std::string, DocumentStore::Snapshot>> DocumentStore::all() const {
+  std::shared_ptr<const Map> map = map_.load(std::memory_order_acquire);
+  std::vector<std::pair<std::string, Snapshot>> out;
+  out.reserve(map->size());
+  for (const auto& [uri, slot] : *map) out.emplace_back(uri, slot->current.load(std::memory_order_acquire));
+  return out;
+}
+
+}  // namespace slclangd
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "decl_scanner.h"
+#include "document.h"
+
+namespace slclangd {
+
+// One version of an open document. Never modified once published, so a request can keep using
+// the snapshot it started with while newer edits arrive.
+struct DocumentSnapshot {
+  DocumentSnapshot(Document text, int version) : text(std::move(text)), version(version) {}
+
+  // What scanDeclarations() finds in `text`: scanned by the first request that asks, then shared by
+  // every later one until the next edit publishes a new snapshot.
+  const std::vector<Declaration>& declarations() const;
+
+  Document text;
+  int version = 0;
+
+ private:
+  mutable std::once_flag decls_once_;
+  mutable std::vector<Declaration> decls_;
+};
+
+// Open documents by URI, shared between the main loop (which applies didOpen/didChange/didClose)
+// and the request workers. The URI map and each document's current snapshot are atomic
+// shared_ptrs, so readers never wait on the store's mutex. (They aren't lock-free: libstdc++ guards
+// each atomic shared_ptr with an internal spinlock, held only to copy the pointer and bump its
+// count.) An edit publishes a new snapshot into the document's slot; open/close copy the (small)
+// map and swap it in. Writers are serialized among themselves only.
+class DocumentStore final {
+ public:
+  using Snapshot = std::shared_ptr<const DocumentSnapshot>;
+
+  DocumentStore();
+
+  DocumentStore(const DocumentStore&) = delete;
+  DocumentStore& operator=(const DocumentStore&) = delete;
+
+  // Current snapshot of `uri`, or nullptr if it isn't open.
+  Snapshot get(const std::string& uri) const;
+
+  // Makes `snapshot` the current version of `uri` (opening it if needed).
+  void publish(const std::string& uri, Snapshot snapshot);
+
+  void erase(const std::string& uri);
+
+  // Current snapshots of all open documents.
+  std::vector<std::pair<std::string, Snapshot>> all() const;
+
+ private:
+  struct Slot {
+    std::atomic<Snapshot> current;
+  };
+  using Map = std::unordered_map<std::string, std::shared_ptr<Slot>>;
+
+  std::atomic<std::shared_ptr<const Map>> map_;
+  std::mutex write_mu_;
+};
+
+}  // namespace slclangd
@@ -0,0 +1,291 @@
+#include "file_watcher.h"
+
+#include "ignore_rules.h"
+#include "inproc_search.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace slclangd {
+namespace {
+
+constexpr std::uint32_t kWatchMask =
+    IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+// Deliver a batch once nothing happened for kQuietMs, or at the latest kMaxDelay after its first event.
+constexpr int kQuietMs = 50;
+constexpr auto kMaxDelay = std::chrono::milliseconds(500);
+
+static bool isIgnoreFile(const char* name) { return std::strcmp(name, ".gitignore") == 0 || std::strcmp(name, ".ignore") == 0; }
+
+}  // namespace
+
+FileWatcher::FileWatcher(std::string root, Callbacks callbacks)
+    : root_(std::move(root)), callbacks_(std::move(callbacks)) {}
+
+FileWatcher::~FileWatcher() { stop(); }
+
+bool FileWatcher::start() {
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) return false;
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ < 0) {
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+    return false;
+  }
+  addWatchTree(root_, /*report_files=*/false);
+  // git replaces the index by renaming index.lock over it.
+  git_wd_ = inotify_add_watch(inotify_fd_, joinPath(root_, ".git").c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+  thread_ = std::thread([this]() { run(); });
+  return true;
+}
+
+void FileWatcher::stop() {
+  if (thread_.joinable()) {
+    stopping_.store(true, std::memory_order_release);
+    std::uint64_t one = 1;
+    (void)!write(wake_fd_, &one, sizeof(one));
+    thread_.join();
+  }
+  if (inotify_fd_ >= 0) close(inotify_fd_);
+  if (wake_fd_ >= 0) close(wake_fd_);
+  inotify_fd_ = -1;
+  wake_fd_ = -1;
+  git_wd_ = -1;
+}
+
+std::size_t FileWatcher::watchCount() const {
+  std::lock_guard<std::mutex> lg(mu_);
+  return dir_by_wd_.size();
+}
+
+std::string FileWatcher::relativePath(const std::string& path) const {
+  if (path.size() <= root_.size()) return {};
+  return path.substr(root_.back() == '/' ? root_.size() : root_.size() + 1);
+}
+
+void FileWatcher::addWatchTree(const std::string& dir, bool report_files) {
+  // Like the search, skip ignored directories: node_modules and the like would otherwise use up
+  // fs.inotify.max_user_watches.
+  struct Pending {
+    std::string path;
+    std::string rel;        // same format as IgnoreScope::dir
+    IgnoreScopePtr ignore;  // rules in effect inside it
+  };
+  Pending top{dir, relativePath(dir), nullptr};
+  if (IgnoreChecker(root_).ignoredDir(top.rel, top.ignore)) return;
+  if (!top.rel.empty()) top.rel.push_back('/');
+  std::vector<Pending> stack;
+  stack.push_back(std::move(top));
+  while (!stack.empty()) {
+    Pending cur = std::move(stack.back());
+    stack.pop_back();
+
+    int wd = inotify_add_watch(inotify_fd_, cur.path.c_str(), kWatchMask);
+    if (wd < 0) {
+      // ENOSPC: fs.inotify.max_user_watches exhausted. Changes below `cur` go unnoticed: keep
+      // watching what we can, but say so (and, once running, have the indexes rescan).
+      markIncomplete(report_files);
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lg(mu_);
+      auto [it, added] = dir_by_wd_.emplace(wd, cur.path);
+      // Already watched under another path (symlinks): its events only name that one. Under the
+      // same path, the tree is being rewalked for directories that changed rules no longer ignore.
+      if (!added && it->second != cur.path) {
+        markIncomplete(false);
+        continue;
+      }
+    }
+
+    DIR* d = opendir(cur.path.c_str());
+    if (!d) continue;
+    while (dirent* e = readdir(d)) {
+      if (std::strcmp(e->d_name, ".") == 0 || std::strcmp(e->d_name, "..") == 0) continue;
+      std::string path = joinPath(cur.path, e->d_name);
+      unsigned char type = e->d_type;
+      if (type == DT_UNKNOWN || type == DT_LNK) {
+        // Like the search, follow symlinks to directories.
+        struct stat st {};
+        if (stat(path.c_str(), &st) != 0) continue;
+        type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+      }
+      if (type == DT_DIR) {
+        std::string rel = cur.rel + e->d_name;
+        if (isExcludedDir(e->d_name) || (cur.ignore && isIgnored(cur.ignore.get(), rel, true))) continue;
+        rel.push_back('/');
+        IgnoreScopePtr ignore = enterIgnoreScope(cur.ignore, path, rel);
+        stack.push_back(Pending{std::move(path), std::move(rel), std::move(ignore)});
+      } else if (report_files && type == DT_REG) {
+        // Files created before our watch was in place would otherwise be missed.
+        queue(std::move(path), FileEvent::Kind::kAdded, false);
+      }
+    }
+    closedir(d);
+  }
+}
+
+void FileWatcher::markIncomplete(bool events_lost) {
+  complete_.store(false, std::memory_order_release);
+  if (events_lost && !overflowed_) {
+    overflowed_ = true;
+    if (pending_.empty()) first_pending_ = std::chrono::steady_clock::now();
+  }
+}
+
+bool FileWatcher::dropWatchesUnder(const std::string& path) {
+  // Watches follow the inode; drop the ones below a directory that left the tree.
+  // (A move within the tree re-adds them under the new name via IN_MOVED_TO.)
+  const std::string prefix = path + "/";
+  bool dropped = false;
+  std::lock_guard<std::mutex> lg(mu_);
+  for (auto it = dir_by_wd_.begin(); it != dir_by_wd_.end();) {
+    if (it->second == path || it->second.rfind(prefix, 0) == 0) {
+      (void)inotify_rm_watch(inotify_fd_, it->first);
+      it = dir_by_wd_.erase(it);
+      dropped = true;
+    } else {
+      ++it;
+    }
+  }
+  return dropped;
+}
+
+void FileWatcher::queue(std::string path, FileEvent::Kind kind, bool is_dir) {
+  if (pending_.empty()) first_pending_ = std::chrono::steady_clock::now();
+  auto it = pending_.find(path);
+  if (it == pending_.end()) {
+    pending_order_.push_back(path);
+    FileEvent ev{path, kind, is_dir};
+    pending_.emplace(std::move(path), std::move(ev));
+    return;
+  }
+  // Created then written is still "added"; anything else takes the latest state.
+  if (!(it->second.kind == FileEvent::Kind::kAdded && kind == FileEvent::Kind::kModified)) it->second.kind = kind;
+  it->second.is_dir = is_dir;
+}
+
+void FileWatcher::flush() {
+  if (overflowed_) {
+    overflowed_ = false;
+    pending_.clear();
+    pending_order_.clear();
+    if (callbacks_.on_overflow) callbacks_.on_overflow();
+    return;
+  }
+  if (pending_.empty()) return;
+  std::vector<FileEvent> events;
+  events.reserve(pending_order_.size());
+  for (auto& path : pending_order_) {
+    auto it = pending_.find(path);
+    if (it != pending_.end()) events.push_back(std::move(it->second));
+  }
+  pending_.clear();
+  pending_order_.clear();
+  if (callbacks_.on_events) callbacks_.on_events(std::move(events));
+}
+
+void FileWatcher::handleEvents(const char* buf, std::size_t len) {
+  for (std::size_t off = 0; off < len;) {
+    const auto* ev = reinterpret_cast<const inotify_event*>(buf + off);
+    off += sizeof(inotify_event) + ev->len;
+
+    if (ev->mask & IN_Q_OVERFLOW) {
+      overflowed_ = true;
+      if (pending_.empty()) first_pending_ = std::chrono::steady_clock::now();
+      continue;
+    }
+    if (ev->wd == git_wd_) {
+      if (ev->mask & IN_IGNORED) {
+        git_wd_ = -1;
+      } else if (ev->len != 0 && std::strcmp(ev->name, "index") == 0) {
+        queue(joinPath(root_, ".git/index"), FileEvent::Kind::kModified, false);
+      }
+      continue;
+    }
+
+    std::string dir;
+    {
+      std::lock_guard<std::mutex> lg(mu_);
+      auto it = dir_by_wd_.find(ev->wd);
+      if (it == dir_by_wd_.end()) continue;
+      if (ev->mask & IN_IGNORED) {
+        dir_by_wd_.erase(it);
+        continue;
+      }
+      dir = it->second;
+    }
+    if (ev->len == 0) continue;  // event about the watched directory itself
+
+    const bool is_dir = (ev->mask & IN_ISDIR) != 0;
+    std::string path = joinPath(dir, ev->name);
+    if (is_dir) {
+      if (isExcludedDir(ev->name)) continue;
+      if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+        addWatchTree(path, /*report_files=*/true);
+      } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        if (ev->mask & IN_MOVED_FROM) (void)dropWatchesUnder(path);
+        queue(std::move(path), FileEvent::Kind::kRemoved, true);
+      }
+      continue;
+    }
+
+    // Symlinks to directories are watched (and reported) like the directories themselves.
+    if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+      struct stat st {};
+      if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        addWatchTree(path, /*report_files=*/true);
+      } else {
+        queue(std::move(path), FileEvent::Kind::kAdded, false);
+      }
+    } else if (ev->mask & IN_CLOSE_WRITE) {
+      queue(std::move(path), FileEvent::Kind::kModified, false);
+    } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+      const bool was_dir = dropWatchesUnder(path);
+      queue(std::move(path), FileEvent::Kind::kRemoved, was_dir);
+    }
+    // Directories the old rules ignored aren't watched yet. (Newly ignored ones keep their watches:
+    // the indexes drop their files either way.)
+    if (isIgnoreFile(ev->name)) addWatchTree(dir, /*report_files=*/false);
+  }
+}
+
+void FileWatcher::run() {
+  alignas(inotify_event) char buf[64 * 1024];
+  pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+  while (!stopping_.load(std::memory_order_acquire)) {
+    const bool have_pending = !pending_.empty() || overflowed_;
+    int r = poll(fds, 2, have_pending ? kQuietMs : -1);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[1].revents != 0) break;
+    if (r == 0) {
+      flush();  // quiet period elapsed
+      continue;
+    }
+    if (fds[0].revents & POLLIN) {
+      while (true) {
+        ssize_t n = read(inotify_fd_, buf, sizeof(buf));
+        if (n <= 0) break;
+        handleEvents(buf, static_cast<std::size_t>(n));
+      }
+    }
+    if ((!pending_.empty() || overflowed_) && std::chrono::steady_clock::now() - first_pending_ >= kMaxDelay) flush();
+  }
+}
+
+}  // namespace slclangd
+
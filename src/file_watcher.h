@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace slclangd {
+
+struct FileEvent {
+  enum class Kind {
+    kAdded,
+    kModified,
+    kRemoved,
+  };
+  std::string path;
+  Kind kind = Kind::kModified;
+  bool is_dir = false;  // kAdded/kRemoved of a whole directory (moved in/out or deleted)
+};
+
+// Recursive inotify watcher for a workspace root. Every directory the search enters (all below the
+// root, following symlinks, except build/, .git/ and ignored ones) gets its own watch; new
+// directories are watched as they appear and the files they already contain are reported as added.
+// Of .git/ only the index is watched: a rewrite of .git/index is reported as a modified file, since
+// the search lists a repository's tracked files from it.
+//
+// Events are coalesced per path and delivered in batches from the watcher thread once the tree
+// has been quiet for a short while (or a batch has been pending too long), so a branch switch
+// touching tens of thousands of files arrives as a handful of callbacks.
+class FileWatcher final {
+ public:
+  struct Callbacks {
+    std::function<void(std::vector<FileEvent> events)> on_events;
+    // The kernel queue overflowed (or a watch couldn't be added, see complete()): events were
+    // lost, rescan.
+    std::function<void()> on_overflow;
+  };
+
+  FileWatcher(std::string root, Callbacks callbacks);
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  // Adds the watches and starts the watcher thread. Returns false if inotify is unavailable.
+  bool start();
+  void stop();
+
+  std::size_t watchCount() const;
+  // False once some directory the search walks couldn't be watched (out of inotify watches, or
+  // reached through a symlink to one already watched): changes there may go unreported for good.
+  bool complete() const { return complete_.load(std::memory_order_acquire); }
+
+ private:
+  void run();
+  // `path` relative to the root.
+  std::string relativePath(const std::string& path) const;
+  void addWatchTree(const std::string& dir, bool report_files);
+  // `events_lost`: from the watcher thread, also report an overflow.
+  void markIncomplete(bool events_lost);
+  // Removes the watches of `path` and the directories below it; false if there were none.
+  bool dropWatchesUnder(const std::string& path);
+  void handleEvents(const char* buf, std::size_t len);
+  void queue(std::string path, FileEvent::Kind kind, bool is_dir);
+  void flush();
+
+  std::string root_;
+  Callbacks callbacks_;
+  int inotify_fd_ = -1;
+  int wake_fd_ = -1;
+  int git_wd_ = -1;  // the root's .git/, for its index
+  std::thread thread_;
+  std::atomic_bool stopping_{false};
+  std::atomic_bool complete_{true};
+
+  mutable std::mutex mu_;
+  std::unordered_map<int, std::string> dir_by_wd_;
+
+  // Only touched from the watcher thread.
+  std::unordered_map<std::string, FileEvent> pending_;
+  std::vector<std::string> pending_order_;
+  std::chrono::steady_clock::time_point first_pending_;
+  bool overflowed_ = false;
+};
+
+}  // namespace slclangd
+
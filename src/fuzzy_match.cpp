@@ -0,0 +1,176 @@
+#include "fuzzy_match.h"
+
+#include <algorithm>
+#include <array>
+
+namespace slclangd {
+namespace {
+
+constexpr int kNeg = -16000;  // unreachable state
+constexpr int kMaxBonus = 5;  // per matched character, see match()
+
+enum CharClass : std::uint8_t { kPunct, kLower, kUpper, kDigit };
+enum Role : std::uint8_t { kTail, kHead, kSeparator };
+
+// Bytes >= 0x80 (UTF-8 sequences) count as lowercase letters.
+constexpr std::array<CharClass, 256> kClasses = [] {
+  std::array<CharClass, 256> t{};
+  for (int c = 0; c < 256; ++c) {
+    t[c] = (c >= 'a' && c <= 'z') || c >= 0x80 ? kLower : c >= 'A' && c <= 'Z' ? kUpper : c >= '0' && c <= '9' ? kDigit : kPunct;
+  }
+  return t;
+}();
+
+static CharClass classOf(char c) { return kClasses[static_cast<unsigned char>(c)]; }
+
+constexpr std::array<char, 256> kLowered = [] {
+  std::array<char, 256> t{};
+  for (int c = 0; c < 256; ++c) t[c] = static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+  return t;
+}();
+
+static char toLower(char c) { return kLowered[static_cast<unsigned char>(c)]; }
+
+// Segments start after punctuation, at an uppercase letter following a lowercase one or a digit
+// (or ending a run of capitals, like the S of "HTTPServer"), and at the first digit of a number.
+constexpr Role roleOf(CharClass prev, CharClass cur, CharClass next) {
+  if (cur == kPunct) return kSeparator;
+  if (prev == kPunct) return kHead;
+  if (cur == kUpper && (prev != kUpper || next == kLower)) return kHead;
+  if (cur == kDigit && prev != kDigit) return kHead;
+  return kTail;
+}
+
+// roleOf() by (prev, cur, next) classes, which saves its branches per byte.
+constexpr std::array<Role, 64> kRoles = [] {
+  std::array<Role, 64> t{};
+  for (int i = 0; i < 64; ++i) {
+    t[i] = roleOf(static_cast<CharClass>(i >> 4), static_cast<CharClass>((i >> 2) & 3), static_cast<CharClass>(i & 3));
+  }
+  return t;
+}();
+
+// Calls on_byte(i, role) for each byte of `s`; the first is preceded and the last followed by
+// punctuation.
+template <typename Fn>
+static void forEachRole(std::string_view s, Fn&& on_byte) {
+  unsigned window = classOf(s.empty() ? '\0' : s[0]);  // (prev << 2 | cur), prev = kPunct
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    const unsigned next = i + 1 < s.size() ? classOf(s[i + 1]) : kPunct;
+    window = (window << 2 | next) & 63;
+    on_byte(i, kRoles[window]);
+  }
+}
+
+static void computeRoles(std::string_view s, std::uint8_t* out) {
+  forEachRole(s, [&](std::size_t i, Role role) { out[i] = role; });
+}
+
+// Signature bits: one per letter (case-insensitively), one for all digits, one for everything else;
+// the low half for characters anywhere in the word, the high half for those starting a segment.
+static std::uint64_t signatureBit(char c, bool at_segment_start) {
+  const auto byte = static_cast<unsigned char>(c);
+  const CharClass cls = classOf(c);
+  const int bit = cls == kUpper ? byte - 'A' : byte >= 'a' && byte <= 'z' ? byte - 'a' : cls == kDigit ? 26 : 27;
+  return (std::uint64_t{1} << bit) << (at_segment_start ? 32 : 0);
+}
+
+static float score(int raw, std::size_t pattern_size, std::size_t word_size) {
+  const float quality = std::clamp(static_cast<float>(raw) / static_cast<float>(kMaxBonus * pattern_size), 0.0f, 1.0f);
+  // Of two equally good matches, the shorter identifier is likelier the one meant.
+  const float coverage = static_cast<float>(pattern_size) / static_cast<float>(word_size);
+  return (0.1f + 0.9f * quality) * (0.75f + 0.25f * coverage);
+}
+
+}  // namespace
+
+FuzzyMatcher::FuzzyMatcher(std::string_view pattern) : pattern_(pattern.substr(0, kMaxPattern)) {
+  lower_.reserve(pattern_.size());
+  for (char c : pattern_) lower_.push_back(toLower(c));
+  computeRoles(pattern_, pattern_roles_);
+  for (std::size_t p = 0; p < pattern_.size(); ++p) {
+    required_ |= signatureBit(pattern_[p], false);
+    if (p == 0 || pattern_roles_[p] == kHead) required_ |= signatureBit(pattern_[p], true);
+  }
+}
+
+std::uint64_t FuzzyMatcher::signature(std::string_view word) {
+  std::uint8_t roles[kMaxWord];
+  word = word.substr(0, kMaxWord);
+  computeRoles(word, roles);
+  std::uint64_t sig = 0;
+  for (std::size_t w = 0; w < word.size(); ++w) sig |= signatureBit(word[w], false) | signatureBit(word[w], roles[w] != kTail);
+  return sig;
+}
+
+std::optional<float> FuzzyMatcher::match(std::string_view word) {
+  const std::size_t np = lower_.size();
+  if (np == 0) return 1.0f;
+  word = word.substr(0, kMaxWord);
+  const std::size_t nw = word.size();
+  if (nw < np) return std::nullopt;
+
+  // Row 0: nothing matched yet. Skipping the start of the word or of a segment costs.
+  miss_[0][0] = 0;
+  hit_[0][0] = kNeg;
+  forEachRole(word, [&](std::size_t w, Role role) {
+    word_roles_[w] = role;
+    word_lower_[w] = toLower(word[w]);
+    word_skip_[w] = w == 0 ? 3 : role == kHead ? 1 : 0;
+    miss_[0][w + 1] = static_cast<std::int16_t>(miss_[0][w] - word_skip_[w]);
+    hit_[0][w + 1] = kNeg;
+  });
+
+  // Row p + 1: pattern[0, p] matched within word[0, w + 1). Each row starts where the previous one
+  // first matched, and word[w] can only match pattern[p] if the rest of the pattern fits after it.
+  std::size_t from = 0;
+  for (std::size_t p = 0; p < np; ++p) {
+    const std::int16_t* prev_miss = miss_[p];
+    const std::int16_t* prev_hit = hit_[p];
+    std::int16_t* miss = miss_[p + 1];
+    std::int16_t* hit = hit_[p + 1];
+    const bool last = p + 1 == np;
+    const std::size_t end = nw - (np - p - 1);
+    const std::size_t stop = last ? nw : end;  // the next row reads no further
+    const char lc = lower_[p];
+    const char exact = pattern_[p];
+    // The query's first character and its own segment starts may only land on segment starts.
+    const bool needs_head = p == 0 || pattern_roles_[p] == kHead;
+    std::size_t next_from = 0;
+    miss[from] = hit[from] = kNeg;
+    for (std::size_t w = from; w < stop; ++w) {
+      int h = kNeg;
+      const std::uint8_t role = word_roles_[w];
+      if (w < end && word_lower_[w] == lc && !(needs_head && role == kTail)) {
+        const int bonus = (word[w] == exact ? 1 : 0) + (role == kHead ? 2 : 0);
+        // Consecutive matches are worth more; resuming in the middle of a segment is penalized.
+        h = std::max(prev_miss[w] + bonus - (role == kTail ? 2 : 0), prev_hit[w] + bonus + 2);
+        if (h > kNeg / 2) {
+          if (next_from == 0) next_from = w + 1;
+        } else {
+          h = kNeg;
+        }
+      }
+      hit[w + 1] = static_cast<std::int16_t>(h);
+      // After the last match the rest of the word is skipped for free.
+      const int m = std::max(miss[w], hit[w]) - (last ? 0 : word_skip_[w]);
+      miss[w + 1] = static_cast<std::int16_t>(std::max(m, kNeg));
+    }
+    if (next_from == 0) return std::nullopt;
+    from = next_from;
+  }
+
+  const int raw = std::max(miss_[np][nw], hit_[np][nw]);
+  if (raw <= kNeg / 2) return std::nullopt;
+  return score(raw, np, nw);
+}
+
+float FuzzyMatcher::bestScore(std::size_t word_size) const {
+  const std::size_t np = lower_.size();
+  if (np == 0) return 1.0f;
+  // Every character after the first can at best continue a run onto a segment start.
+  const int raw = kMaxBonus * static_cast<int>(np) - 2;
+  return score(raw, np, std::clamp(word_size, np, kMaxWord));
+}
+
+}  // namespace slclangd
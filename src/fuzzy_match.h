@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace slclangd {
+
+// Matches identifiers against a workspace/symbol query the way clangd does: the query's characters
+// must appear in the identifier in order, ignoring case, and the first of them (and any uppercase
+// one following a lowercase one, as in "lspSrv") must start a segment of it ("lsp_server",
+// "LspServer", "HTTPServer" have segments at every word). Matches aligned with segment starts, runs of
+// consecutive characters and exact case score higher; skipped segments and long identifiers lower.
+//
+// Uses fixed scratch tables and a byte-class table: construct one per query (it's not thread-safe)
+// and call match() for each candidate without allocating.
+class FuzzyMatcher final {
+ public:
+  static constexpr std::size_t kMaxPattern = 63;  // longer queries are truncated
+  static constexpr std::size_t kMaxWord = 127;    // only the start of longer identifiers is matched
+
+  explicit FuzzyMatcher(std::string_view pattern);
+
+  // In (0, 1], higher is better; nullopt if `word` doesn't match. An empty pattern matches
+  // everything with score 1.
+  std::optional<float> match(std::string_view word);
+
+  // Which characters `word` contains and which start its segments, for mayMatch().
+  static std::uint64_t signature(std::string_view word);
+  // False if no word with this signature matches (much cheaper than match()).
+  bool mayMatch(std::uint64_t word_signature) const { return (word_signature & required_) == required_; }
+
+  // No identifier `word_size` bytes long scores higher than this (it decreases with the size).
+  float bestScore(std::size_t word_size) const;
+
+  // The pattern, lowercased: every match contains it as a subsequence.
+  const std::string& lowerPattern() const { return lower_; }
+
+ private:
+  std::string pattern_;
+  std::string lower_;
+  std::uint8_t pattern_roles_[kMaxPattern];
+  std::uint64_t required_ = 0;  // signature bits every match has
+  // The word being matched: lowercased, segment roles, cost of skipping each byte.
+  char word_lower_[kMaxWord];
+  std::uint8_t word_roles_[kMaxWord];
+  std::uint8_t word_skip_[kMaxWord];
+  // Best scores with p pattern and w word characters consumed, ending on a skipped or matched
+  // word character.
+  std::int16_t miss_[kMaxPattern + 1][kMaxWord + 1];
+  std::int16_t hit_[kMaxPattern + 1][kMaxWord + 1];
+};
+
+}  // namespace slclangd
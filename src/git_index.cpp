@@ -0,0 +1,160 @@
+#include "git_index.h"
+
+#include "inproc_search.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <sys/stat.h>
+
+namespace slclangd {
+namespace {
+
+static std::string joinDir(const std::string& dir, std::string_view name) {
+  std::string p = dir;
+  if (!p.empty() && p.back() != '/') p.push_back('/');
+  p += name;
+  return p;
+}
+
+static std::string_view trim(std::string_view s) {
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+  return s;
+}
+
+// `<work_tree>/.git`, or the directory a `.git` file points to ("gitdir: ...", used by linked
+// worktrees and submodules).
+static std::optional<std::string> gitDir(const std::string& work_tree, std::string& buf) {
+  const std::string dot_git = joinDir(work_tree, ".git");
+  struct stat st {};
+  if (stat(dot_git.c_str(), &st) != 0) return std::nullopt;
+  if (S_ISDIR(st.st_mode)) return dot_git;
+  if (!readWholeFile(dot_git, buf) || buf.rfind("gitdir:", 0) != 0) return std::nullopt;
+  std::string_view dir = trim(std::string_view(buf).substr(7));
+  if (dir.empty()) return std::nullopt;
+  if (dir.front() == '/') return std::string(dir);
+  return joinDir(work_tree, dir);
+}
+
+// Object ids are 20 bytes (SHA-1) unless the repository uses extensions.objectFormat = sha256.
+static std::size_t objectIdBytes(const std::string& git_dir, std::string& buf) {
+  // Linked worktrees keep the config in the main repository's git dir.
+  std::string common = git_dir;
+  if (readWholeFile(joinDir(git_dir, "commondir"), buf)) {
+    std::string_view dir = trim(buf);
+    if (!dir.empty()) common = dir.front() == '/' ? std::string(dir) : joinDir(git_dir, dir);
+  }
+  if (!readWholeFile(joinDir(common, "config"), buf)) return 20;
+  std::transform(buf.begin(), buf.end(), buf.begin(), [](unsigned char c) { return std::tolower(c); });
+  const std::size_t key = buf.find("objectformat");
+  if (key == std::string::npos) return 20;
+  const std::string_view line = std::string_view(buf).substr(key, buf.find('\n', key) - key);
+  return line.find("sha256") != std::string_view::npos ? 32 : 20;
+}
+
+static std::uint32_t be32(const char* p) {
+  const auto* u = reinterpret_cast<const unsigned char*>(p);
+  return (std::uint32_t{u[0]} << 24) | (std::uint32_t{u[1]} << 16) | (std::uint32_t{u[2]} << 8) | u[3];
+}
+
+static std::uint16_t be16(const char* p) {
+  const auto* u = reinterpret_cast<const unsigned char*>(p);
+  return static_cast<std::uint16_t>((u[0] << 8) | u[1]);
+}
+
+// git's offset varint (varint.c): 7 bits per byte, most significant first, with a +1 bias on
+// every continuation so each value has one encoding.
+static bool readVarint(const char*& p, const char* end, std::size_t& out) {
+  if (p == end) return false;
+  auto c = static_cast<unsigned char>(*p++);
+  std::size_t v = c & 127;
+  while (c & 128) {
+    if (p == end || v >= (SIZE_MAX >> 7)) return false;
+    c = static_cast<unsigned char>(*p++);
+    v = ((v + 1) << 7) | (c & 127);
+  }
+  out = v;
+  return true;
+}
+
+// See gitformat-index(5).
+static bool parseIndex(std::string_view index, std::size_t id_bytes, std::vector<std::string>& paths) {
+  if (index.size() < 12 + id_bytes || index.substr(0, 4) != "DIRC") return false;
+  const std::uint32_t version = be32(index.data() + 4);
+  if (version < 2 || version > 4) return false;
+  const std::uint32_t count = be32(index.data() + 8);
+
+  const char* p = index.data() + 12;
+  const char* end = index.data() + index.size() - id_bytes;  // trailing checksum
+  const std::size_t fixed = 40 + id_bytes + 2;                // stat data, object id, flags
+  std::string name;
+  bool have_last = false;
+  for (std::uint32_t i = 0; i < count; ++i) {
+    const char* entry = p;
+    if (static_cast<std::size_t>(end - p) < fixed) return false;
+    const std::uint32_t mode = be32(p + 24);
+    const std::uint16_t flags = be16(p + 40 + id_bytes);
+    p += fixed;
+    bool skip_worktree = false;
+    if (flags & 0x4000) {  // extended flags
+      if (version < 3 || end - p < 2) return false;
+      skip_worktree = (be16(p) & 0x4000) != 0;
+      p += 2;
+    }
+    if (version == 4) {
+      // Prefix-compressed: how much of the previous name to drop, then the NUL-terminated rest.
+      std::size_t strip = 0;
+      if (!readVarint(p, end, strip) || strip > name.size()) return false;
+      name.resize(name.size() - strip);
+      const auto* nul = static_cast<const char*>(std::memchr(p, '\0', static_cast<std::size_t>(end - p)));
+      if (!nul) return false;
+      name.append(p, nul);
+      p = nul + 1;
+    } else {
+      const auto* nul = static_cast<const char*>(std::memchr(p, '\0', static_cast<std::size_t>(end - p)));
+      if (!nul) return false;
+      name.assign(p, nul);
+      // Padded with 1-8 NULs to a multiple of 8 bytes.
+      p = entry + ((static_cast<std::size_t>(nul - entry) + 8) & ~std::size_t{7});
+      if (p > end) return false;
+    }
+
+    switch (mode >> 12) {
+      case 010:  // regular file
+      case 012:  // symlink
+        if (skip_worktree) break;
+        // Unmerged paths have one entry per stage, next to each other.
+        if (have_last && paths.back() == name) break;
+        paths.push_back(name);
+        have_last = true;
+        break;
+      case 004:  // sparse-index directory: the files below it aren't listed
+        return false;
+      default:  // gitlink (submodule)
+        break;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool readGitIndex(const std::string& work_tree, std::vector<std::string>& paths) {
+  std::string buf;
+  const auto git_dir = gitDir(work_tree, buf);
+  if (!git_dir) return false;
+  const std::size_t id_bytes = objectIdBytes(*git_dir, buf);
+  if (!readWholeFile(joinDir(*git_dir, "index"), buf)) return false;
+  const std::size_t old_size = paths.size();
+  if (!parseIndex(buf, id_bytes, paths)) {
+    paths.resize(old_size);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace slclangd
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace slclangd {
+
+// Appends the paths (relative to `work_tree`, in index order) of the files tracked by the git
+// repository checked out at `work_tree`, read straight from its index file (versions 2-4) instead
+// of walking the tree or running git. Submodules, skip-worktree entries and the extra stages of
+// unmerged paths are left out.
+//
+// Returns false, appending nothing, if `work_tree` isn't the top of a work tree or its index
+// can't be used (missing, malformed, or sparse); callers then walk the tree instead.
+bool readGitIndex(const std::string& work_tree, std::vector<std::string>& paths);
+
+}  // namespace slclangd
@@ -1,13 +1,23 @@
 #include "grep_search.h"
 
+#include "batch_reader.h"
+#include "document_store.h"
+#include "inproc_search.h"
+
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cctype>
 #include <csignal>
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <thread>
@@ -63,6 +73,309 @@ static int findColumn0(const std::string& haystack, const std::string& needle) {
   }
 }
 
+static int grepDelayMs() {
+  // Debug knob: slow down result collection so cancellation can be exercised by hand.
+  if (const char* d = std::getenv("SLCLANGD_GREP_DELAY_MS")) {
+    try {
+      return std::stoi(d);
+    } catch (...) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+std::atomic<SearchBackend> g_backend{SearchBackend::kAuto};
+std::atomic<std::size_t> g_search_threads{0};
+
+static std::size_t searchThreads() {
+  std::size_t n = g_search_threads.load(std::memory_order_relaxed);
+  if (n == 0) n = std::thread::hardware_concurrency();
+  return std::max<std::size_t>(n, 1);
+}
+
+// Searches already run on a request worker; the threads they add on top come out of one budget of
+// searchThreads() - 1, so concurrent searches share the cores instead of each taking all of them.
+std::mutex g_scan_threads_mu;
+std::size_t g_scan_threads_busy = 0;
+
+class ScanThreads {
+ public:
+  // Up to `want` threads in all, counting the caller's.
+  explicit ScanThreads(std::size_t want) {
+    if (want <= 1) return;
+    std::lock_guard<std::mutex> lg(g_scan_threads_mu);
+    const std::size_t limit = searchThreads() - 1;
+    if (g_scan_threads_busy < limit) extra_ = std::min(want - 1, limit - g_scan_threads_busy);
+    g_scan_threads_busy += extra_;
+  }
+  ~ScanThreads() {
+    std::lock_guard<std::mutex> lg(g_scan_threads_mu);
+    g_scan_threads_busy -= extra_;
+  }
+  ScanThreads(const ScanThreads&) = delete;
+  ScanThreads& operator=(const ScanThreads&) = delete;
+
+  std::size_t count() const { return 1 + extra_; }
+
+ private:
+  std::size_t extra_ = 0;
+};
+
+static SearchBackend backendFromEnv() {
+  if (const char* b = std::getenv("SLCLANGD_SEARCH_BACKEND")) {
+    if (auto parsed = parseSearchBackend(b); parsed && *parsed != SearchBackend::kAuto) return *parsed;
+  }
+  return SearchBackend::kInProcess;
+}
+
+// Readers own an io_uring and pinned buffers, so searches borrow them from a small free list
+// instead of setting one up per call.
+std::mutex g_readers_mu;
+std::vector<std::unique_ptr<BatchFileReader>> g_idle_readers;
+
+class ReaderLease {
+ public:
+  ReaderLease() {
+    std::lock_guard<std::mutex> lg(g_readers_mu);
+    if (!g_idle_readers.empty()) {
+      reader_ = std::move(g_idle_readers.back());
+      g_idle_readers.pop_back();
+    }
+  }
+  ~ReaderLease() {
+    if (!reader_) return;
+    std::lock_guard<std::mutex> lg(g_readers_mu);
+    if (g_idle_readers.size() < 2 * std::max(1u, std::thread::hardware_concurrency())) {
+      g_idle_readers.push_back(std::move(reader_));
+    }
+  }
+  ReaderLease(const ReaderLease&) = delete;
+  ReaderLease& operator=(const ReaderLease&) = delete;
+
+  BatchFileReader& get() {
+    if (!reader_) reader_ = std::make_unique<BatchFileReader>();
+    return *reader_;
+  }
+
+ private:
+  std::unique_ptr<BatchFileReader> reader_;
+};
+
+// Forwards one search's progress to its SearchProgress (if any): serializes the calls and only
+// reports the file count every kFileReportInterval.
+class ProgressSink {
+ public:
+  static constexpr auto kFileReportInterval = std::chrono::milliseconds(50);
+
+  explicit ProgressSink(const SearchProgress* progress) : progress_(progress) {}
+  ProgressSink(const ProgressSink&) = delete;
+  ProgressSink& operator=(const ProgressSink&) = delete;
+
+  void addTotal(std::size_t files) { total_.fetch_add(files, std::memory_order_relaxed); }
+
+  // Reports out[from, end), the matches appended since `from`, if there are any.
+  void matches(const std::vector<GrepMatch>& out, std::size_t from) {
+    if (!progress_ || !progress_->on_matches || from >= out.size()) return;
+    std::vector<GrepMatch> batch(out.begin() + static_cast<std::ptrdiff_t>(from), out.end());
+    std::lock_guard<std::mutex> lg(mu_);
+    progress_->on_matches(batch);
+  }
+
+  void scanned(std::size_t files) {
+    const std::size_t n = scanned_.fetch_add(files, std::memory_order_relaxed) + files;
+    if (!progress_ || !progress_->on_files) return;
+    // Whoever holds the lock reports a count at least as recent.
+    std::unique_lock<std::mutex> lk(mu_, std::try_to_lock);
+    if (!lk.owns_lock()) return;
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_report_ < kFileReportInterval) return;
+    last_report_ = now;
+    progress_->on_files(n, total_.load(std::memory_order_relaxed));
+  }
+
+ private:
+  const SearchProgress* progress_;
+  std::mutex mu_;
+  std::chrono::steady_clock::time_point last_report_{};
+  std::atomic<std::size_t> scanned_{0};
+  std::atomic<std::size_t> total_{0};
+};
+
+// One in-process search. Files are scanned in parallel, but their matches are kept in path order,
+// so the ones that make the max_results cut don't depend on which thread got there first.
+struct InProcessSearch {
+  const std::string& needle;
+  int max_results;
+  int delay_ms = grepDelayMs();
+  std::atomic_bool* cancelled;
+  ProgressSink& progress;
+  std::atomic_bool full{false};  // max_results kept
+
+  bool stopped() const {
+    return full.load(std::memory_order_relaxed) || (cancelled && cancelled->load(std::memory_order_acquire));
+  }
+
+  // Appends the matches in one file's contents to `out` (at most max_results in all), applying the
+  // same filtering as runGrep(). Returns false once the search should stop.
+  bool scan(const std::string& path, std::string_view contents, std::vector<GrepMatch>& out) {
+    const bool more = scanLines(path, contents, 0, out);
+    progress.scanned(1);
+    return more;
+  }
+
+  // scan() for whole lines of a file that start after its first `line_base` lines.
+  bool scanLines(const std::string& path, std::string_view lines, int line_base, std::vector<GrepMatch>& out) {
+    if (stopped()) return false;
+    bool more = true;
+    scanBufferLines(lines, needle, [&](int line_no, std::string_view line) {
+      if (cancelled && cancelled->load(std::memory_order_acquire)) {
+        more = false;
+        return false;
+      }
+      if (delay_ms > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+      }
+      GrepMatch m;
+      m.path = path;
+      m.line = line_base + line_no;
+      m.text = std::string(line);
+      m.column = findColumn0(m.text, needle);
+      if (m.column < 0) return true;  // filtered out (comment-only line or match only in quotes)
+      out.push_back(std::move(m));
+      if (static_cast<int>(out.size()) < max_results) return true;
+      more = false;
+      return false;
+    });
+    return more && !stopped();
+  }
+
+  // Scans an open buffer a chunk at a time rather than copying it out of its rope. The lines split
+  // across chunks are put back together in `seam`.
+  void scanDocument(const std::string& path, const Document& doc, std::vector<GrepMatch>& out) {
+    // Checked up front since scanBufferLines() only sees a chunk: a NUL anywhere makes it binary.
+    if (!doc.contains(needle) || doc.contains(std::string_view("\0", 1))) return;
+    std::string seam;
+    int line_base = 0;
+    bool more = true;
+    doc.forEachChunk([&](std::string_view text, std::size_t newlines) {
+      if (!more) return;
+      if (newlines == 0) {
+        seam.append(text);
+        return;
+      }
+      const std::size_t first_nl = text.find('\n');
+      const std::size_t last_nl = text.rfind('\n');
+      seam.append(text.substr(0, first_nl + 1));
+      more = scanLines(path, seam, line_base, out);
+      ++line_base;
+      if (more && last_nl > first_nl) {
+        more = scanLines(path, text.substr(first_nl + 1, last_nl - first_nl), line_base, out);
+      }
+      line_base += static_cast<int>(newlines) - 1;
+      seam.assign(text.substr(last_nl + 1));
+    });
+    if (more && !seam.empty()) scanLines(path, seam, line_base, out);
+  }
+
+  // Moves `found` onto the end of the kept matches in `out`, up to max_results, and reports them.
+  void keep(std::vector<GrepMatch>& found, std::vector<GrepMatch>& out) {
+    const std::size_t first_new = out.size();
+    for (auto& m : found) {
+      if (static_cast<int>(out.size()) >= max_results) break;
+      out.push_back(std::move(m));
+    }
+    progress.matches(out, first_new);
+    if (static_cast<int>(out.size()) >= max_results) full.store(true, std::memory_order_relaxed);
+  }
+
+  // Scans the in-memory buffers, in path order. Returns false once the search should stop.
+  bool scanOverlay(const SearchOverlay* overlay, std::vector<GrepMatch>& out) {
+    if (!overlay) return !stopped();
+    std::vector<const SearchOverlay::value_type*> entries;
+    entries.reserve(overlay->size());
+    for (const auto& entry : *overlay) entries.push_back(&entry);
+    std::sort(entries.begin(), entries.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+    for (const auto* entry : entries) {
+      std::vector<GrepMatch> found;
+      scanDocument(entry->first, entry->second->text, found);
+      progress.scanned(1);
+      keep(found, out);
+      if (stopped()) return false;
+    }
+    return true;
+  }
+
+  // Scans `paths` with up to `threads` threads (the caller's included), a reader batch at a time.
+  // Each batch's matches are kept once every batch before it is in, so `out` follows `paths`.
+  void scanFiles(const std::vector<std::string>& paths, std::size_t threads, std::vector<GrepMatch>& out) {
+    constexpr std::size_t kBatch = BatchFileReader::kDefaultDepth;
+    const std::size_t batches = (paths.size() + kBatch - 1) / kBatch;
+    std::vector<std::optional<std::vector<GrepMatch>>> done(batches);
+    std::atomic<std::size_t> next{0};
+    std::mutex mu;
+    std::size_t kept = 0;  // batches before this one are in `out`
+    auto work = [&]() {
+      ReaderLease reader;
+      std::vector<std::string> batch;
+      while (!stopped()) {
+        const std::size_t b = next.fetch_add(1, std::memory_order_relaxed);
+        if (b >= batches) return;
+        batch.assign(paths.begin() + static_cast<std::ptrdiff_t>(b * kBatch),
+                     paths.begin() + static_cast<std::ptrdiff_t>(std::min((b + 1) * kBatch, paths.size())));
+        std::vector<GrepMatch> found;
+        reader.get().readAll(
+            batch, [&](std::size_t i, std::string_view contents) { return scan(batch[i], contents, found); },
+            cancelled);
+        std::lock_guard<std::mutex> lg(mu);
+        done[b] = std::move(found);
+        for (; kept < batches && done[kept] && !stopped(); ++kept) {
+          keep(*done[kept], out);
+          done[kept].reset();
+        }
+      }
+    };
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < std::min(threads, batches); ++i) workers.emplace_back(work);
+    work();
+    for (auto& t : workers) t.join();
+  }
+};
+
+static bool inOverlay(const SearchOverlay* overlay, const std::string& path) {
+  return overlay && overlay->count(path) != 0;
+}
+
+// `files` minus the paths whose open buffer is searched instead.
+static std::vector<std::string> withoutOverlay(const std::vector<std::string>& files, const SearchOverlay* overlay) {
+  std::vector<std::string> out;
+  out.reserve(files.size());
+  for (const auto& f : files) {
+    if (!inOverlay(overlay, f)) out.push_back(f);
+  }
+  return out;
+}
+
+// The files under `root` a search covers, minus the ones searched in `overlay`, in path order.
+static std::vector<std::string> listFiles(const std::string& root,
+                                          const std::vector<std::string>& extensions,
+                                          std::size_t threads,
+                                          const SearchOverlay* overlay,
+                                          std::atomic_bool* cancelled) {
+  std::vector<std::vector<std::string>> listed(threads);
+  enumerateSourceFiles(
+      root, extensions, threads,
+      [&](const std::string& path, std::size_t worker) {
+        if (!inOverlay(overlay, path)) listed[worker].push_back(path);
+        return true;
+      },
+      cancelled);
+  std::vector<std::string> files = std::move(listed[0]);
+  for (std::size_t i = 1; i < listed.size(); ++i) files.insert(files.end(), listed[i].begin(), listed[i].end());
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
 static void closeIfValid(int fd) {
   if (fd >= 0) close(fd);
 }
@@ -71,10 +384,21 @@ static std::vector<GrepMatch> runGrep(const std::vector<std::string>& args_str,
                                       const std::string& needle,
                                       int max_results,
                                       std::atomic_bool* cancelled,
-                                      std::atomic<pid_t>* child_pid) {
+                                      std::atomic<pid_t>* child_pid,
+                                      ProgressSink& progress) {
   std::vector<GrepMatch> out;
   if (needle.empty() || max_results <= 0) return out;
 
+  // In the C locale bytes are just bytes, so grep -I skips a file for its NUL bytes only, like the
+  // in-process backend. (In a UTF-8 locale it also drops matches from a line with invalid UTF-8
+  // onwards.)
+  static char kCLocale[] = "LC_ALL=C";
+  std::vector<char*> envp{kCLocale};
+  for (char** e = environ; *e; ++e) {
+    if (std::strncmp(*e, "LC_ALL=", 7) != 0) envp.push_back(*e);
+  }
+  envp.push_back(nullptr);
+
   int pipefd[2] = {-1, -1};
   if (pipe(pipefd) != 0) {
     return out;
@@ -99,7 +423,7 @@ static std::vector<GrepMatch> runGrep(const std::vector<std::string>& args_str,
     for (auto& s : const_cast<std::vector<std::string>&>(args_str)) argv.push_back(s.data());
     argv.push_back(nullptr);
 
-    execvp("grep", argv.data());
+    execvpe("grep", argv.data(), envp.data());
     _exit(127);
   }
 
@@ -117,14 +441,8 @@ static std::vector<GrepMatch> runGrep(const std::vector<std::string>& args_str,
   char* lineptr = nullptr;
   size_t n = 0;
   int collected = 0;
-  int delay_ms = 0;
-  if (const char* d = std::getenv("SLCLANGD_GREP_DELAY_MS")) {
-    try {
-      delay_ms = std::stoi(d);
-    } catch (...) {
-      delay_ms = 0;
-    }
-  }
+  std::size_t unreported = 0;  // grep prints a file's matches together: report them per file
+  int delay_ms = grepDelayMs();
   while (true) {
     if (cancelled && cancelled->load(std::memory_order_acquire)) {
       (void)kill(pid, SIGTERM);
@@ -158,6 +476,10 @@ static std::vector<GrepMatch> runGrep(const std::vector<std::string>& args_str,
     if (m.column < 0) {
       continue;  // filtered out (comment-only line or match only in quotes)
     }
+    if (unreported < out.size() && out[unreported].path != m.path) {
+      progress.matches(out, unreported);
+      unreported = out.size();
+    }
     out.push_back(std::move(m));
     if (++collected >= max_results) {
       (void)kill(pid, SIGTERM);
@@ -166,68 +488,164 @@ static std::vector<GrepMatch> runGrep(const std::vector<std::string>& args_str,
   }
   if (lineptr) free(lineptr);
   fclose(f);
+  progress.matches(out, unreported);
 
   int status = 0;
   (void)waitpid(pid, &status, 0);
   return out;
 }
 
+// Runs `grep -nH` over an explicit list of files.
+static std::vector<GrepMatch> runGrepOnFiles(const std::vector<std::string>& files,
+                                             const std::string& needle,
+                                             int max_results,
+                                             std::atomic_bool* cancelled,
+                                             std::atomic<pid_t>* child_pid,
+                                             ProgressSink& progress,
+                                             bool small_chunks) {
+  std::vector<std::string> base_args;
+  base_args.push_back("grep");
+  base_args.push_back("-nH");  // line numbers + always print filename
+  base_args.push_back("--binary-files=without-match");
+  base_args.push_back("--color=never");
+  base_args.push_back("-F");
+  base_args.push_back("--");
+  base_args.push_back(needle);
+
+  // Long candidate lists (e.g. from the trigram index) are split across several grep runs to
+  // stay well below ARG_MAX, and into smaller ones when progress is shown: grep only tells which
+  // files matched, so the file count moves a run at a time.
+  constexpr std::size_t kMaxArgBytes = 128 * 1024;
+  constexpr std::size_t kProgressChunkFiles = 256;
+  const std::size_t max_files = small_chunks ? kProgressChunkFiles : files.size();
+  std::vector<GrepMatch> out;
+  std::size_t next = 0;
+  while (next < files.size() && static_cast<int>(out.size()) < max_results) {
+    if (cancelled && cancelled->load(std::memory_order_acquire)) break;
+    std::vector<std::string> args_str = base_args;
+    const std::size_t first = next;
+    std::size_t bytes = 0;
+    for (; next < files.size() && next - first < max_files &&
+           (bytes == 0 || bytes + files[next].size() < kMaxArgBytes);
+         ++next) {
+      bytes += files[next].size() + 1;
+      args_str.push_back(files[next]);
+    }
+    auto part = runGrep(args_str, needle, max_results - static_cast<int>(out.size()), cancelled, child_pid, progress);
+    for (auto& m : part) out.push_back(std::move(m));
+    progress.scanned(next - first);
+  }
+  return out;
+}
+
+// The grep backend with open buffers: they are scanned in-process (GNU grep can only read files),
+// then grep searches `files` for whatever is left of max_results.
+static std::vector<GrepMatch> runGrepWithOverlay(const std::vector<std::string>& files,
+                                                 const std::string& needle,
+                                                 int max_results,
+                                                 std::atomic_bool* cancelled,
+                                                 std::atomic<pid_t>* child_pid,
+                                                 const SearchOverlay* overlay,
+                                                 const SearchProgress* progress) {
+  std::vector<GrepMatch> out;
+  if (needle.empty() || max_results <= 0) return out;
+  ProgressSink sink(progress);
+  sink.addTotal(files.size() + (overlay ? overlay->size() : 0));
+  InProcessSearch search{needle, max_results, grepDelayMs(), cancelled, sink};
+  if (!search.scanOverlay(overlay, out)) return out;
+  auto part = runGrepOnFiles(files, needle, max_results - static_cast<int>(out.size()), cancelled, child_pid, sink,
+                             progress != nullptr);
+  for (auto& m : part) out.push_back(std::move(m));
+  return out;
+}
+
 }  // namespace
 
+void setSearchBackend(SearchBackend backend) { g_backend.store(backend, std::memory_order_relaxed); }
+
+void setSearchThreads(std::size_t threads) { g_search_threads.store(threads, std::memory_order_relaxed); }
+
+SearchBackend activeSearchBackend() {
+  SearchBackend b = g_backend.load(std::memory_order_relaxed);
+  if (b != SearchBackend::kAuto) return b;
+  static const SearchBackend from_env = backendFromEnv();
+  return from_env;
+}
+
+// GNU grep's --include works with glob patterns; we accept a comma-separated list like "cpp,hpp,h".
+std::vector<std::string> splitExtensionList(const std::string& list) {
+  std::vector<std::string> out;
+  std::istringstream iss(list);
+  std::string ext;
+  while (std::getline(iss, ext, ',')) {
+    if (!ext.empty() && ext[0] == '.') ext.erase(0, 1);
+    if (ext.empty()) continue;
+    out.push_back(ext);
+  }
+  return out;
+}
+
+std::optional<SearchBackend> parseSearchBackend(const std::string& name) {
+  if (name == "auto") return SearchBackend::kAuto;
+  if (name == "grep") return SearchBackend::kGrep;
+  if (name == "inproc" || name == "in-process") return SearchBackend::kInProcess;
+  return std::nullopt;
+}
+
 std::vector<GrepMatch> grepFixedString(const std::string& root_dir,
                                        const std::string& needle,
                                        int max_results,
                                        std::optional<std::string> only_extensions,
                                        std::atomic_bool* cancelled,
-                                       std::atomic<pid_t>* child_pid) {
-  std::vector<std::string> args_str;
-  args_str.push_back("grep");
-  args_str.push_back("-RIn");          // recursive, line numbers
-  args_str.push_back("--binary-files=without-match");
-  args_str.push_back("--color=never");
-  args_str.push_back("--exclude-dir=build");
-  args_str.push_back("--exclude-dir=.git");
-
-  // Best-effort extension filter (if caller wants it):
-  // GNU grep's --include works with glob patterns; we accept a comma-separated list like "cpp,hpp,h".
-  if (only_extensions && !only_extensions->empty()) {
-    std::istringstream iss(*only_extensions);
-    std::string ext;
-    while (std::getline(iss, ext, ',')) {
-      if (!ext.empty() && ext[0] == '.') ext.erase(0, 1);
-      if (ext.empty()) continue;
-      args_str.push_back(std::string("--include=*.") + ext);
-    }
+                                       std::atomic<pid_t>* child_pid,
+                                       const SearchOverlay* overlay,
+                                       const SearchProgress* progress) {
+  const std::vector<std::string> extensions =
+      only_extensions ? splitExtensionList(*only_extensions) : std::vector<std::string>{};
+  if (activeSearchBackend() == SearchBackend::kInProcess) {
+    if (needle.empty() || max_results <= 0) return {};
+    ProgressSink sink(progress);
+    if (overlay) sink.addTotal(overlay->size());
+    InProcessSearch search{needle, max_results, grepDelayMs(), cancelled, sink};
+    std::vector<GrepMatch> out;
+    if (!search.scanOverlay(overlay, out)) return out;
+    ScanThreads threads(searchThreads());
+    const std::vector<std::string> files = listFiles(root_dir, extensions, threads.count(), overlay, cancelled);
+    sink.addTotal(files.size());
+    search.scanFiles(files, threads.count(), out);
+    return out;
   }
 
-  args_str.push_back("-F");
-  args_str.push_back("--");
-  args_str.push_back(needle);
-  args_str.push_back(root_dir);
-
-  return runGrep(args_str, needle, max_results, cancelled, child_pid);
+  // GNU grep knows nothing about ignore files or git indexes: list the files the same way and
+  // pass them explicitly, so both backends search the same set.
+  const std::vector<std::string> files = listFiles(root_dir, extensions, 1, overlay, cancelled);
+  if (cancelled && cancelled->load(std::memory_order_acquire)) return {};
+  return runGrepWithOverlay(files, needle, max_results, cancelled, child_pid, overlay, progress);
 }
 
 std::vector<GrepMatch> grepFixedStringInFiles(const std::vector<std::string>& files,
                                               const std::string& needle,
                                               int max_results,
                                               std::atomic_bool* cancelled,
-                                              std::atomic<pid_t>* child_pid) {
-  if (files.empty()) return {};
-
-  std::vector<std::string> args_str;
-  args_str.push_back("grep");
-  args_str.push_back("-nH");  // line numbers + always print filename
-  args_str.push_back("--binary-files=without-match");
-  args_str.push_back("--color=never");
-  args_str.push_back("-F");
-  args_str.push_back("--");
-  args_str.push_back(needle);
-  for (const auto& f : files) args_str.push_back(f);
+                                              std::atomic<pid_t>* child_pid,
+                                              const SearchOverlay* overlay,
+                                              const SearchProgress* progress) {
+  if (files.empty() && (!overlay || overlay->empty())) return {};
+  const std::vector<std::string> on_disk = overlay ? withoutOverlay(files, overlay) : std::vector<std::string>{};
+  const std::vector<std::string>& paths = overlay ? on_disk : files;
+
+  if (activeSearchBackend() == SearchBackend::kInProcess) {
+    std::vector<GrepMatch> out;
+    if (needle.empty() || max_results <= 0) return out;
+    ProgressSink sink(progress);
+    sink.addTotal(paths.size() + (overlay ? overlay->size() : 0));
+    InProcessSearch search{needle, max_results, grepDelayMs(), cancelled, sink};
+    if (!search.scanOverlay(overlay, out)) return out;
+    search.scanFiles(paths, 1, out);
+    return out;
+  }
 
-  return runGrep(args_str, needle, max_results, cancelled, child_pid);
+  return runGrepWithOverlay(paths, needle, max_results, cancelled, child_pid, overlay, progress);
 }
 
 }  // namespace slclangd
-
-
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <sys/types.h>
+#include <unordered_map>
 #include <vector>
 
 namespace slclangd {
@@ -15,21 +19,63 @@ struct GrepMatch {
   std::string text;   // the full line text (best-effort)
 };
 
-// Runs GNU grep recursively and returns matches. Uses fixed-string search (-F).
+enum class SearchBackend {
+  kAuto,       // SLCLANGD_SEARCH_BACKEND=grep|inproc if set, otherwise in-process
+  kGrep,       // fork/exec GNU grep and parse its output
+  kInProcess,  // SIMD fixed-string search inside the server process
+};
+
+struct DocumentSnapshot;
+
+// Unsaved editor buffers (path -> snapshot), searched in memory in place of the files on disk at the
+// same paths, with either backend. Keys are spelled the way the search reports paths (root-joined
+// for grepFixedString(), as listed for grepFixedStringInFiles()). Every entry is searched, whether
+// or not the search would have visited its path: the caller picks the buffers in scope. Buffers are
+// scanned in place, a rope chunk at a time.
+using SearchOverlay = std::unordered_map<std::string, std::shared_ptr<const DocumentSnapshot>>;
+
+// Optional streaming hooks for a search, so callers can show results before it finishes. Calls are
+// serialized but may come from any of the search's threads.
+struct SearchProgress {
+  // Each batch of new matches as soon as it is found; together they are exactly the returned matches.
+  std::function<void(const std::vector<GrepMatch>& batch)> on_matches;
+  // Files searched so far, out of `total` (0 while unknown, e.g. during a directory walk).
+  // Rate-limited.
+  std::function<void(std::size_t scanned, std::size_t total)> on_files;
+};
+
+// Selects the backend used by grepFixedString()/grepFixedStringInFiles(). Both backends return
+// the same matches; `child_pid` is only ever set by the grep backend.
+void setSearchBackend(SearchBackend backend);
+SearchBackend activeSearchBackend();  // never kAuto
+std::optional<SearchBackend> parseSearchBackend(const std::string& name);
+
+// Threads the in-process backend uses to walk and scan a directory tree in grepFixedString()
+// (0 = one per core). A limit on all concurrent searches together, not per search.
+void setSearchThreads(std::size_t threads);
+
+// Splits a comma-separated extension list like "cpp,.hpp,h" into {"cpp", "hpp", "h"}.
+std::vector<std::string> splitExtensionList(const std::string& list);
+
+// Searches the tree recursively (like grep -RIn) and returns matches. Uses fixed-string search (-F).
+// The files searched are those listed by enumerateSourceFiles(): ignore files are honored, and
+// a git work tree's tracked files come from its index.
 std::vector<GrepMatch> grepFixedString(const std::string& root_dir,
                                        const std::string& needle,
                                        int max_results,
                                        std::optional<std::string> only_extensions = std::nullopt,
                                        std::atomic_bool* cancelled = nullptr,
-                                       std::atomic<pid_t>* child_pid = nullptr);
+                                       std::atomic<pid_t>* child_pid = nullptr,
+                                       const SearchOverlay* overlay = nullptr,
+                                       const SearchProgress* progress = nullptr);
 
-// Runs GNU grep over an explicit list of file paths. Uses fixed-string search (-F).
+// Searches an explicit list of file paths (like grep -nH). Uses fixed-string search (-F).
 std::vector<GrepMatch> grepFixedStringInFiles(const std::vector<std::string>& files,
                                               const std::string& needle,
                                               int max_results,
                                               std::atomic_bool* cancelled = nullptr,
-                                              std::atomic<pid_t>* child_pid = nullptr);
+                                              std::atomic<pid_t>* child_pid = nullptr,
+                                              const SearchOverlay* overlay = nullptr,
+                                              const SearchProgress* progress = nullptr);
 
 }  // namespace slclangd
-
-
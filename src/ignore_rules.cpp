@@ -0,0 +1,190 @@
+#include "ignore_rules.h"
+
+#include "inproc_search.h"
+
+#include <utility>
+
+namespace slclangd {
+namespace {
+
+constexpr std::size_t kNpos = std::string_view::npos;
+
+// Matches the bracket expression starting at p[pi] == '[' against `ch`. Returns false if it isn't
+// terminated (the '[' is then literal); otherwise sets `end` past the ']' and `matched`.
+static bool matchClass(std::string_view p, std::size_t pi, char ch, std::size_t& end, bool& matched) {
+  std::size_t i = pi + 1;
+  bool negate = false;
+  if (i < p.size() && (p[i] == '!' || p[i] == '^')) {
+    negate = true;
+    ++i;
+  }
+  bool found = false;
+  for (bool first = true; i < p.size(); first = false) {
+    if (p[i] == ']' && !first) {
+      end = i + 1;
+      matched = ch != '/' && found != negate;
+      return true;
+    }
+    char lo = p[i];
+    if (lo == '\\' && i + 1 < p.size()) lo = p[++i];
+    ++i;
+    char hi = lo;
+    if (i + 1 < p.size() && p[i] == '-' && p[i + 1] != ']') {
+      hi = p[++i];
+      if (hi == '\\' && i + 1 < p.size()) hi = p[++i];
+      ++i;
+    }
+    if (lo <= ch && ch <= hi) found = true;
+  }
+  return false;
+}
+
+// gitignore glob matching of p[pi..] against s[si..] (wildmatch with WM_PATHNAME semantics).
+static bool globMatch(std::string_view p, std::size_t pi, std::string_view s, std::size_t si) {
+  while (pi < p.size()) {
+    const char c = p[pi];
+    if (c == '*') {
+      const bool whole_component = pi + 1 < p.size() && p[pi + 1] == '*' && (pi == 0 || p[pi - 1] == '/') &&
+                                   (pi + 2 == p.size() || p[pi + 2] == '/');
+      if (whole_component) {
+        if (pi + 2 == p.size()) return true;  // trailing "/**": everything inside
+        // "**/": zero or more directories.
+        for (std::size_t i = si;; ++i) {
+          if (globMatch(p, pi + 3, s, i)) return true;
+          i = s.find('/', i);
+          if (i == kNpos) return false;
+        }
+      }
+      while (pi < p.size() && p[pi] == '*') ++pi;
+      for (std::size_t i = si;; ++i) {
+        if (globMatch(p, pi, s, i)) return true;
+        if (i == s.size() || s[i] == '/') return false;
+      }
+    }
+    if (si == s.size()) return false;
+    if (c == '?') {
+      if (s[si] == '/') return false;
+      ++pi;
+      ++si;
+      continue;
+    }
+    if (c == '[') {
+      std::size_t end = 0;
+      bool matched = false;
+      if (matchClass(p, pi, s[si], end, matched)) {
+        if (!matched) return false;
+        pi = end;
+        ++si;
+        continue;
+      }
+    }
+    char lit = c;
+    if (c == '\\' && pi + 1 < p.size()) lit = p[++pi];
+    if (s[si] != lit) return false;
+    ++pi;
+    ++si;
+  }
+  return si == s.size();
+}
+
+}  // namespace
+
+void IgnoreRules::parse(std::string_view text) {
+  while (!text.empty()) {
+    const std::size_t nl = text.find('\n');
+    std::string_view line = text.substr(0, nl);
+    text = nl == kNpos ? std::string_view() : text.substr(nl + 1);
+
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    // Trailing spaces are dropped unless escaped with a backslash.
+    while (!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+      line.remove_suffix(1);
+    }
+    if (line.empty() || line.front() == '#') continue;
+
+    Pattern pat;
+    if (line.front() == '!') {
+      pat.negate = true;
+      line.remove_prefix(1);
+    }
+    if (!line.empty() && line.back() == '/') {
+      pat.dir_only = true;
+      line.remove_suffix(1);
+    }
+    pat.anchored = line.find('/') != kNpos;
+    if (!line.empty() && line.front() == '/') line.remove_prefix(1);
+    if (line.empty()) continue;
+    pat.glob = std::string(line);
+    pat.literal = line.find_first_of("*?[\\") == kNpos;
+    patterns_.push_back(std::move(pat));
+  }
+}
+
+IgnoreRules::Verdict IgnoreRules::match(std::string_view rel, bool is_dir) const {
+  const std::string_view name = rel.substr(rel.rfind('/') + 1);
+  for (auto it = patterns_.rbegin(); it != patterns_.rend(); ++it) {
+    if (it->dir_only && !is_dir) continue;
+    const std::string_view subject = it->anchored ? rel : name;
+    const bool hit = it->literal ? subject == it->glob : globMatch(it->glob, 0, subject, 0);
+    if (hit) return it->negate ? Verdict::kIncluded : Verdict::kIgnored;
+  }
+  return Verdict::kUnmatched;
+}
+
+IgnoreScopePtr enterIgnoreScope(const IgnoreScopePtr& parent, const std::string& abs_dir, std::string rel_dir) {
+  std::string base = abs_dir;
+  if (!base.empty() && base.back() != '/') base.push_back('/');
+  IgnoreRules rules;
+  std::string buf;
+  if (rel_dir.empty() && readWholeFile(base + ".git/info/exclude", buf)) rules.parse(buf);
+  for (const char* name : {".gitignore", ".ignore"}) {
+    if (readWholeFile(base + name, buf)) rules.parse(buf);
+  }
+  if (rules.empty()) return parent;
+  return std::make_shared<const IgnoreScope>(IgnoreScope{std::move(rel_dir), std::move(rules), parent});
+}
+
+bool isIgnored(const IgnoreScope* scope, std::string_view rel, bool is_dir) {
+  for (; scope; scope = scope->parent.get()) {
+    auto verdict = scope->rules.match(rel.substr(scope->dir.size()), is_dir);
+    if (verdict != IgnoreRules::Verdict::kUnmatched) return verdict == IgnoreRules::Verdict::kIgnored;
+  }
+  return false;
+}
+
+IgnoreChecker::IgnoreChecker(std::string root) : root_(std::move(root)) {
+  if (!root_.empty() && root_.back() != '/') root_.push_back('/');
+  stack_.push_back(Dir{"", enterIgnoreScope(nullptr, root_, ""), false});
+}
+
+bool IgnoreChecker::ignored(std::string_view rel) {
+  const std::size_t slash = rel.rfind('/');
+  const Dir& top = descend(slash == kNpos ? std::string_view() : rel.substr(0, slash + 1));
+  return top.ignored || isIgnored(top.scope.get(), rel, false);
+}
+
+bool IgnoreChecker::ignoredDir(std::string_view rel, IgnoreScopePtr& scope) {
+  std::string dir(rel);
+  if (!dir.empty() && dir.back() != '/') dir.push_back('/');
+  const Dir& top = descend(dir);
+  scope = top.scope;
+  return top.ignored;
+}
+
+const IgnoreChecker::Dir& IgnoreChecker::descend(std::string_view dir) {
+  while (stack_.size() > 1 && dir.substr(0, stack_.back().rel.size()) != stack_.back().rel) stack_.pop_back();
+
+  // Descend to `dir` one component at a time, like a walk would.
+  while (stack_.back().rel.size() < dir.size()) {
+    const Dir& top = stack_.back();
+    const std::size_t end = dir.find('/', top.rel.size());
+    Dir next;
+    next.rel = std::string(dir.substr(0, end + 1));
+    next.ignored = top.ignored || isIgnored(top.scope.get(), dir.substr(0, end), true);
+    next.scope = next.ignored ? top.scope : enterIgnoreScope(top.scope, root_ + next.rel, next.rel);
+    stack_.push_back(std::move(next));
+  }
+  return stack_.back();
+}
+
+}  // namespace slclangd
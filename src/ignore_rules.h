@@ -0,0 +1,81 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace slclangd {
+
+// The patterns of one directory's ignore files, in gitignore(5) syntax: `!` negation, trailing `/`
+// for directories only, patterns containing a `/` anchored to the directory, `*`/`?`/`[...]` that
+// don't cross `/`, and `**` spanning any number of directories.
+class IgnoreRules final {
+ public:
+  enum class Verdict { kUnmatched, kIgnored, kIncluded };
+
+  // Appends the patterns in `text` (one ignore file); later patterns take precedence.
+  void parse(std::string_view text);
+  bool empty() const { return patterns_.empty(); }
+
+  // `rel` is relative to the directory the rules came from. The last matching pattern decides.
+  Verdict match(std::string_view rel, bool is_dir) const;
+
+ private:
+  struct Pattern {
+    std::string glob;
+    bool negate = false;
+    bool dir_only = false;
+    bool anchored = false;  // matched against the whole relative path, not just the last component
+    bool literal = false;   // no wildcards: plain comparison
+  };
+
+  std::vector<Pattern> patterns_;
+};
+
+// The rules in effect in one directory of a walk: those read there plus its ancestors' (nearer
+// directories win, as in git).
+struct IgnoreScope {
+  std::string dir;  // relative to the walk root: "" for the root, otherwise ending in '/'
+  IgnoreRules rules;
+  std::shared_ptr<const IgnoreScope> parent;
+};
+using IgnoreScopePtr = std::shared_ptr<const IgnoreScope>;
+
+// Returns the scope for directory `abs_dir` (`rel_dir` below the walk root, same format as
+// IgnoreScope::dir), reading its .gitignore and .ignore (and .git/info/exclude at the root).
+// Returns `parent` itself if the directory adds no rules, so rule-less trees cost nothing.
+IgnoreScopePtr enterIgnoreScope(const IgnoreScopePtr& parent, const std::string& abs_dir, std::string rel_dir);
+
+// True if `rel` (relative to the walk root, no trailing '/') is ignored in `scope`. Only the entry
+// itself is checked; walks never descend into ignored directories.
+bool isIgnored(const IgnoreScope* scope, std::string_view rel, bool is_dir);
+
+// Answers whether a path below `root` would be skipped by an ignore-aware walk of `root`, checking
+// every directory on the way. Scopes are kept for the directories of the previous query, so
+// paths grouped by directory (e.g. sorted) each read the ignore files along their path once.
+class IgnoreChecker final {
+ public:
+  explicit IgnoreChecker(std::string root);
+
+  // `rel` names a file, relative to the root.
+  bool ignored(std::string_view rel);
+  // `rel` names a directory, relative to the root ("" for the root itself). If it isn't skipped,
+  // `scope` is set to the rules in effect inside it.
+  bool ignoredDir(std::string_view rel, IgnoreScopePtr& scope);
+
+ private:
+  struct Dir {
+    std::string rel;  // same format as IgnoreScope::dir
+    IgnoreScopePtr scope;
+    bool ignored = false;
+  };
+
+  // Moves the stack to directory `dir` (same format as IgnoreScope::dir) and returns its entry.
+  const Dir& descend(std::string_view dir);
+
+  std::string root_;
+  std::vector<Dir> stack_;  // the root, then each directory of the last path
+};
+
+}  // namespace slclangd
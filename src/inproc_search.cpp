@@ -0,0 +1,562 @@
+#include "inproc_search.h"
+
+#include "git_index.h"
+#include "ignore_rules.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SLCLANGD_X86 1
+#endif
+
+namespace slclangd {
+namespace {
+
+constexpr std::size_t kNpos = std::string_view::npos;
+
+static std::size_t findScalar(std::string_view hay, std::string_view needle) {
+  const void* p = memmem(hay.data(), hay.size(), needle.data(), needle.size());
+  if (!p) return kNpos;
+  return static_cast<std::size_t>(static_cast<const char*>(p) - hay.data());
+}
+
+#ifdef SLCLANGD_X86
+
+// First/last-byte filter: compare a block against the needle's first byte and the block shifted by
+// (k - 1) against its last byte; only candidate positions where both agree get a memcmp.
+__attribute__((target("avx2"))) static std::size_t findAvx2(std::string_view hay, std::string_view needle) {
+  const std::size_t n = hay.size();
+  const std::size_t k = needle.size();
+  if (k > n) return kNpos;
+  const char* s = hay.data();
+  const __m256i first = _mm256_set1_epi8(needle.front());
+  const __m256i last = _mm256_set1_epi8(needle.back());
+  std::size_t i = 0;
+  for (; i + k - 1 + 32 <= n; i += 32) {
+    const __m256i bf = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+    const __m256i bl = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + k - 1));
+    auto mask = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, bf), _mm256_cmpeq_epi8(last, bl))));
+    while (mask != 0) {
+      const unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+      if (k <= 2 || std::memcmp(s + i + bit + 1, needle.data() + 1, k - 2) == 0) return i + bit;
+      mask &= mask - 1;
+    }
+  }
+  std::size_t tail = findScalar(hay.substr(i), needle);
+  return tail == kNpos ? kNpos : i + tail;
+}
+
+static std::size_t findSse2(std::string_view hay, std::string_view needle) {
+  const std::size_t n = hay.size();
+  const std::size_t k = needle.size();
+  if (k > n) return kNpos;
+  const char* s = hay.data();
+  const __m128i first = _mm_set1_epi8(needle.front());
+  const __m128i last = _mm_set1_epi8(needle.back());
+  std::size_t i = 0;
+  for (; i + k - 1 + 16 <= n; i += 16) {
+    const __m128i bf = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    const __m128i bl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + k - 1));
+    auto mask =
+        static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, bf), _mm_cmpeq_epi8(last, bl))));
+    while (mask != 0) {
+      const unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+      if (k <= 2 || std::memcmp(s + i + bit + 1, needle.data() + 1, k - 2) == 0) return i + bit;
+      mask &= mask - 1;
+    }
+  }
+  std::size_t tail = findScalar(hay.substr(i), needle);
+  return tail == kNpos ? kNpos : i + tail;
+}
+
+__attribute__((target("avx2"))) static void lineStartsAvx2(std::string_view data,
+                                                          std::uint32_t base,
+                                                          std::vector<std::uint32_t>& out) {
+  const char* s = data.data();
+  const std::size_t n = data.size();
+  const __m256i nl = _mm256_set1_epi8('\n');
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    auto mask = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(nl, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)))));
+    while (mask != 0) {
+      out.push_back(base + static_cast<std::uint32_t>(i + static_cast<unsigned>(__builtin_ctz(mask)) + 1));
+      mask &= mask - 1;
+    }
+  }
+  for (; i < n; ++i) {
+    if (s[i] == '\n') out.push_back(base + static_cast<std::uint32_t>(i + 1));
+  }
+}
+
+static void lineStartsSse2(std::string_view data, std::uint32_t base, std::vector<std::uint32_t>& out) {
+  const char* s = data.data();
+  const std::size_t n = data.size();
+  const __m128i nl = _mm_set1_epi8('\n');
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    auto mask = static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(nl, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)))));
+    while (mask != 0) {
+      out.push_back(base + static_cast<std::uint32_t>(i + static_cast<unsigned>(__builtin_ctz(mask)) + 1));
+      mask &= mask - 1;
+    }
+  }
+  for (; i < n; ++i) {
+    if (s[i] == '\n') out.push_back(base + static_cast<std::uint32_t>(i + 1));
+  }
+}
+
+#endif  // SLCLANGD_X86
+
+static void lineStartsScalar(std::string_view data, std::uint32_t base, std::vector<std::uint32_t>& out) {
+  const char* p = data.data();
+  const char* end = p + data.size();
+  while (p < end) {
+    const void* nl = std::memchr(p, '\n', static_cast<std::size_t>(end - p));
+    if (!nl) break;
+    p = static_cast<const char*>(nl) + 1;
+    out.push_back(base + static_cast<std::uint32_t>(p - data.data()));
+  }
+}
+
+using FindFn = std::size_t (*)(std::string_view, std::string_view);
+
+using LineStartsFn = void (*)(std::string_view, std::uint32_t, std::vector<std::uint32_t>&);
+
+struct Kernel {
+  FindFn find;
+  LineStartsFn line_starts;
+  const char* name;
+};
+
+static const Kernel& kernel() {
+  static const Kernel k = []() -> Kernel {
+#ifdef SLCLANGD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {&findAvx2, &lineStartsAvx2, "avx2"};
+    if (__builtin_cpu_supports("sse2")) return {&findSse2, &lineStartsSse2, "sse2"};
+#endif
+    return {&findScalar, &lineStartsScalar, "scalar"};
+  }();
+  return k;
+}
+
+static std::size_t countNewlines(const char* p, std::size_t n) {
+  std::size_t c = 0;
+  const char* end = p + n;
+  while (p < end) {
+    const void* nl = std::memchr(p, '\n', static_cast<std::size_t>(end - p));
+    if (!nl) break;
+    ++c;
+    p = static_cast<const char*>(nl) + 1;
+  }
+  return c;
+}
+
+std::atomic_bool g_git_index_listing{true};
+
+struct Walker {
+  const std::vector<std::string>& extensions;
+  const std::function<bool(const std::string&)>& on_file;
+  std::atomic_bool* cancelled;
+  std::set<std::pair<dev_t, ino_t>> ancestors;  // cycle guard for followed symlinks
+  bool stop = false;
+
+  // `rel` is `dir` relative to the root ("" or ending in '/'); `parent_ignore` holds the rules
+  // in effect in its parent.
+  void walk(const std::string& dir, const std::string& rel, const IgnoreScopePtr& parent_ignore) {
+    if (stop) return;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    struct stat dst {};
+    if (fstat(dirfd(d), &dst) != 0 || !ancestors.insert({dst.st_dev, dst.st_ino}).second) {
+      closedir(d);
+      return;
+    }
+    const IgnoreScopePtr ignore = enterIgnoreScope(parent_ignore, dir, rel);
+
+    // Read the whole directory first so we don't hold one fd per level while recursing.
+    std::vector<std::pair<std::string, unsigned char>> entries;
+    while (dirent* e = readdir(d)) {
+      if (std::strcmp(e->d_name, ".") == 0 || std::strcmp(e->d_name, "..") == 0) continue;
+      entries.emplace_back(e->d_name, e->d_type);
+    }
+    closedir(d);
+
+    for (const auto& [name, type] : entries) {
+      if (stop) break;
+      if (cancelled && cancelled->load(std::memory_order_acquire)) {
+        stop = true;
+        break;
+      }
+      std::string path = joinPath(dir, name.c_str());
+      bool is_dir = type == DT_DIR;
+      bool is_reg = type == DT_REG;
+      if (type == DT_LNK || type == DT_UNKNOWN) {
+        struct stat st {};
+        if (stat(path.c_str(), &st) != 0) continue;
+        is_dir = S_ISDIR(st.st_mode);
+        is_reg = S_ISREG(st.st_mode);
+      }
+      if (!is_dir && (!is_reg || !hasAllowedExtension(name, extensions))) continue;
+      if (ignore && isIgnored(ignore.get(), rel + name, is_dir)) continue;
+      if (is_dir) {
+        if (!isExcludedDir(name)) walk(path, rel + name + '/', ignore);
+        continue;
+      }
+      if (!on_file(path)) stop = true;
+    }
+    ancestors.erase({dst.st_dev, dst.st_ino});
+  }
+};
+
+// One directory still to be read by the parallel walker. `chain` lists the directories above it
+// (shared between siblings) for the symlink cycle check.
+struct DirId {
+  dev_t dev;
+  ino_t ino;
+  std::shared_ptr<const DirId> parent;
+};
+
+struct DirTask {
+  std::string path;
+  std::shared_ptr<const DirId> chain;
+  std::string rel;          // `path` relative to the root: "" or ending in '/'
+  IgnoreScopePtr ignore;  // rules in effect in the parent directory
+};
+
+class ParallelWalker {
+ public:
+  ParallelWalker(const std::vector<std::string>& extensions,
+                 std::size_t threads,
+                 const std::function<bool(const std::string&, std::size_t)>& on_file,
+                 std::atomic_bool* cancelled)
+      : extensions_(extensions), on_file_(on_file), cancelled_(cancelled), queues_(threads) {}
+
+  void run(const std::string& root) {
+    push(0, DirTask{root, nullptr, "", nullptr});
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < queues_.size(); ++i) workers.emplace_back([this, i]() { work(i); });
+    work(0);
+    for (auto& t : workers) t.join();
+  }
+
+ private:
+  struct Queue {
+    std::mutex mu;
+    std::deque<DirTask> tasks;
+  };
+
+  bool stopped() const {
+    return stop_.load(std::memory_order_relaxed) || (cancelled_ && cancelled_->load(std::memory_order_acquire));
+  }
+
+  void push(std::size_t worker, DirTask task) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lg(queues_[worker].mu);
+    queues_[worker].tasks.push_back(std::move(task));
+  }
+
+  // Own queue from the back (depth first, warm caches), others' from the front.
+  bool take(std::size_t worker, DirTask& task) {
+    for (std::size_t k = 0; k < queues_.size(); ++k) {
+      Queue& q = queues_[(worker + k) % queues_.size()];
+      std::lock_guard<std::mutex> lg(q.mu);
+      if (q.tasks.empty()) continue;
+      if (k == 0) {
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+      } else {
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void work(std::size_t worker) {
+    std::vector<char> dents(64 * 1024);
+    auto idle = std::chrono::microseconds(0);
+    while (!stopped()) {
+      DirTask task;
+      if (!take(worker, task)) {
+        // Nothing queued anywhere: done once no worker is still reading a directory.
+        if (pending_.load(std::memory_order_acquire) == 0) return;
+        idle = std::min(idle * 2 + std::chrono::microseconds(10), std::chrono::microseconds(1000));
+        std::this_thread::sleep_for(idle);
+        continue;
+      }
+      idle = std::chrono::microseconds(0);
+      readDir(worker, task, dents);
+      pending_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+  }
+
+  void readDir(std::size_t worker, const DirTask& task, std::vector<char>& dents) {
+    int fd = openat(AT_FDCWD, task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat dst {};
+    if (fstat(fd, &dst) != 0) {
+      close(fd);
+      return;
+    }
+    for (const DirId* a = task.chain.get(); a; a = a->parent.get()) {
+      if (a->dev == dst.st_dev && a->ino == dst.st_ino) {
+        close(fd);
+        return;
+      }
+    }
+    auto self = std::make_shared<const DirId>(DirId{dst.st_dev, dst.st_ino, task.chain});
+    const IgnoreScopePtr ignore = enterIgnoreScope(task.ignore, task.path, task.rel);
+    std::string rel;
+
+    while (!stopped()) {
+      long n = syscall(SYS_getdents64, fd, dents.data(), dents.size());
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      for (long off = 0; off < n;) {
+        // glibc's dirent64 has the kernel's linux_dirent64 layout.
+        const auto* e = reinterpret_cast<const struct dirent64*>(dents.data() + off);
+        off += e->d_reclen;
+        const char* name = e->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) continue;
+        bool is_dir = e->d_type == DT_DIR;
+        bool is_reg = e->d_type == DT_REG;
+        if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN) {
+          struct stat st {};
+          if (fstatat(fd, name, &st, 0) != 0) continue;
+          is_dir = S_ISDIR(st.st_mode);
+          is_reg = S_ISREG(st.st_mode);
+        }
+        if (!is_dir && (!is_reg || !hasAllowedExtension(name, extensions_))) continue;
+        if (ignore) {
+          rel.assign(task.rel).append(name);
+          if (isIgnored(ignore.get(), rel, is_dir)) continue;
+        }
+        if (is_dir) {
+          if (!isExcludedDir(name)) push(worker, DirTask{joinPath(task.path, name), self, task.rel + name + '/', ignore});
+          continue;
+        }
+        if (!on_file_(joinPath(task.path, name), worker)) {
+          stop_.store(true, std::memory_order_relaxed);
+          break;
+        }
+      }
+    }
+    close(fd);
+  }
+
+  const std::vector<std::string>& extensions_;
+  const std::function<bool(const std::string&, std::size_t)>& on_file_;
+  std::atomic_bool* cancelled_;
+  std::vector<Queue> queues_;
+  std::atomic<std::size_t> pending_{0};  // directories queued or being read
+  std::atomic_bool stop_{false};
+};
+
+// Hands `paths` out to `threads` workers, a chunk at a time.
+static void forEachPathParallel(const std::vector<std::string>& paths,
+                                std::size_t threads,
+                                const std::function<bool(const std::string&, std::size_t)>& on_file,
+                                std::atomic_bool* cancelled) {
+  constexpr std::size_t kChunk = 64;
+  std::atomic<std::size_t> next{0};
+  std::atomic_bool stop{false};
+  auto work = [&](std::size_t worker) {
+    while (!stop.load(std::memory_order_relaxed) && !(cancelled && cancelled->load(std::memory_order_acquire))) {
+      const std::size_t begin = next.fetch_add(kChunk, std::memory_order_relaxed);
+      if (begin >= paths.size()) return;
+      for (std::size_t i = begin; i < std::min(begin + kChunk, paths.size()); ++i) {
+        if (!on_file(paths[i], worker)) {
+          stop.store(true, std::memory_order_relaxed);
+          return;
+        }
+      }
+    }
+  };
+  threads = std::min(threads, (paths.size() + kChunk - 1) / kChunk);
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < threads; ++i) workers.emplace_back(work, i);
+  work(0);
+  for (auto& t : workers) t.join();
+}
+
+}  // namespace
+
+std::size_t findFixedString(std::string_view hay, std::string_view needle) {
+  if (needle.empty()) return 0;
+  if (needle.size() == 1) {
+    const void* p = std::memchr(hay.data(), needle.front(), hay.size());
+    return p ? static_cast<std::size_t>(static_cast<const char*>(p) - hay.data()) : kNpos;
+  }
+  return kernel().find(hay, needle);
+}
+
+const char* fixedStringKernelName() { return kernel().name; }
+
+void appendLineStarts(std::string_view data, std::uint32_t base, std::vector<std::uint32_t>& out) {
+  kernel().line_starts(data, base, out);
+}
+
+bool scanBufferLines(std::string_view data, std::string_view needle, const LineMatchFn& on_match) {
+  if (std::memchr(data.data(), '\0', data.size()) != nullptr) return false;
+  if (needle.empty()) return true;
+
+  const char* base = data.data();
+  const std::size_t n = data.size();
+  int line_no = 1;      // number of the line starting at `pos`
+  std::size_t pos = 0;  // always a line start
+  while (pos < n) {
+    std::size_t hit = findFixedString(data.substr(pos), needle);
+    if (hit == kNpos) break;
+    hit += pos;
+
+    const void* prev_nl = memrchr(base + pos, '\n', hit - pos);
+    std::size_t line_start = prev_nl ? static_cast<std::size_t>(static_cast<const char*>(prev_nl) - base) + 1 : pos;
+    line_no += static_cast<int>(countNewlines(base + pos, line_start - pos));
+    const void* next_nl = std::memchr(base + hit, '\n', n - hit);
+    std::size_t line_end = next_nl ? static_cast<std::size_t>(static_cast<const char*>(next_nl) - base) : n;
+
+    // A needle containing '\n' can match across lines; grep never reports that.
+    if (line_end >= hit + needle.size()) {
+      std::string_view line(base + line_start, line_end - line_start);
+      while (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+      if (!on_match(line_no, line)) return true;
+    }
+    pos = line_end + 1;
+    ++line_no;
+  }
+  return true;
+}
+
+bool readWholeFile(const std::string& path, std::string& buf) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return false;
+  }
+  buf.resize(static_cast<std::size_t>(st.st_size));
+  std::size_t got = 0;
+  while (true) {
+    if (got == buf.size()) buf.resize(buf.size() + 4096);  // file grew since fstat
+    ssize_t r = read(fd, buf.data() + got, buf.size() - got);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) {
+      close(fd);
+      return false;
+    }
+    if (r == 0) break;
+    got += static_cast<std::size_t>(r);
+  }
+  close(fd);
+  buf.resize(got);
+  return true;
+}
+
+bool hasAllowedExtension(std::string_view path, const std::vector<std::string>& extensions) {
+  if (extensions.empty()) return true;
+  for (const auto& ext : extensions) {
+    if (path.size() <= ext.size()) continue;
+    if (path[path.size() - ext.size() - 1] != '.') continue;
+    if (path.substr(path.size() - ext.size()) == ext) return true;
+  }
+  return false;
+}
+
+bool isExcludedDir(std::string_view name) { return name == "build" || name == ".git"; }
+
+std::string joinPath(const std::string& dir, const char* name) {
+  std::string p = dir;
+  if (p.empty() || p.back() != '/') p.push_back('/');
+  p += name;
+  return p;
+}
+
+bool inExcludedDir(std::string_view rel) {
+  std::size_t start = 0;
+  for (std::size_t slash = rel.find('/'); slash != std::string_view::npos; slash = rel.find('/', start)) {
+    if (isExcludedDir(rel.substr(start, slash - start))) return true;
+    start = slash + 1;
+  }
+  return false;
+}
+
+void walkSourceTree(const std::string& root,
+                    const std::vector<std::string>& extensions,
+                    const std::function<bool(const std::string& path)>& on_file,
+                    std::atomic_bool* cancelled) {
+  Walker w{extensions, on_file, cancelled, {}, false};
+  w.walk(root, "", nullptr);
+}
+
+void walkSourceTreeParallel(const std::string& root,
+                            const std::vector<std::string>& extensions,
+                            std::size_t threads,
+                            const std::function<bool(const std::string& path, std::size_t worker)>& on_file,
+                            std::atomic_bool* cancelled) {
+  ParallelWalker w(extensions, std::max<std::size_t>(threads, 1), on_file, cancelled);
+  w.run(root);
+}
+
+void setGitIndexListing(bool enabled) { g_git_index_listing.store(enabled, std::memory_order_relaxed); }
+
+bool gitIndexListing() { return g_git_index_listing.load(std::memory_order_relaxed); }
+
+ListedFiles::ListedFiles(const std::string& root) {
+  if (!gitIndexListing() || !readGitIndex(root, tracked_)) return;
+  all_ = false;
+  if (!std::is_sorted(tracked_.begin(), tracked_.end())) std::sort(tracked_.begin(), tracked_.end());
+}
+
+bool ListedFiles::contains(std::string_view rel) const {
+  if (all_) return true;
+  auto it = std::lower_bound(tracked_.begin(), tracked_.end(), rel,
+                             [](const std::string& a, std::string_view b) { return std::string_view(a) < b; });
+  return it != tracked_.end() && *it == rel;
+}
+
+void enumerateSourceFiles(const std::string& root,
+                          const std::vector<std::string>& extensions,
+                          std::size_t threads,
+                          const std::function<bool(const std::string& path, std::size_t worker)>& on_file,
+                          std::atomic_bool* cancelled) {
+  std::vector<std::string> tracked;
+  if (!gitIndexListing() || !readGitIndex(root, tracked)) {
+    walkSourceTreeParallel(root, extensions, threads, on_file, cancelled);
+    return;
+  }
+  // The index is sorted, so the ignore checker reads each directory's ignore files once.
+  IgnoreChecker ignore(root);
+  std::vector<std::string> paths;
+  for (const auto& rel : tracked) {
+    if (!hasAllowedExtension(rel, extensions) || inExcludedDir(rel) || ignore.ignored(rel)) continue;
+    paths.push_back(joinPath(root, rel.c_str()));
+  }
+  forEachPathParallel(paths, std::max<std::size_t>(threads, 1), on_file, cancelled);
+}
+
+}  // namespace slclangd
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace slclangd {
+
+// Returns the offset of the first occurrence of `needle` in `hay`, or npos.
+// Uses an AVX2/SSE2 first/last-byte filter when the CPU supports it (picked once at runtime).
+std::size_t findFixedString(std::string_view hay, std::string_view needle);
+
+// Name of the kernel used by findFixedString(): "avx2", "sse2" or "scalar".
+const char* fixedStringKernelName();
+
+// Appends `base + i + 1` for every '\n' at offset i of `data`, i.e. the offsets of the lines that
+// follow. Vectorized like findFixedString().
+void appendLineStarts(std::string_view data, std::uint32_t base, std::vector<std::uint32_t>& out);
+
+// Called for each matching line with its 1-based number and its text (without "\n"/"\r\n").
+// Return false to stop scanning.
+using LineMatchFn = std::function<bool(int line_no, std::string_view line)>;
+
+// Reports every line of `data` containing `needle`, once per line (grep -n semantics).
+// Returns false without reporting anything if `data` looks binary (contains a NUL byte),
+// like grep --binary-files=without-match in the C locale, which the grep backend runs it in. Bytes
+// that aren't valid UTF-8 don't count: lines with them are matched like any other.
+bool scanBufferLines(std::string_view data, std::string_view needle, const LineMatchFn& on_match);
+
+// Reads a whole file into `buf` (reused across calls to avoid reallocations).
+bool readWholeFile(const std::string& path, std::string& buf);
+
+// Returns true if `path` ends with ".<ext>" for one of `extensions` (or the list is empty).
+bool hasAllowedExtension(std::string_view path, const std::vector<std::string>& extensions);
+
+// True for the directory names the walks skip: build/ and .git/.
+bool isExcludedDir(std::string_view name);
+
+// True if a directory component of `rel` (a path relative to the root) is one the walks skip.
+bool inExcludedDir(std::string_view rel);
+
+// `dir` + "/" + `name`, without doubling a trailing '/' of `dir`.
+std::string joinPath(const std::string& dir, const char* name);
+
+// Enumerates regular files below `root` like `grep -R --exclude-dir=build --exclude-dir=.git`
+// (symlinks are followed, directory cycles are skipped). `extensions` mirrors --include=*.ext.
+// Entries matched by .gitignore/.ignore files (and the root's .git/info/exclude) are skipped, and
+// ignored directories aren't entered. The callback returns false to stop the walk.
+void walkSourceTree(const std::string& root,
+                    const std::vector<std::string>& extensions,
+                    const std::function<bool(const std::string& path)>& on_file,
+                    std::atomic_bool* cancelled = nullptr);
+
+// Same enumeration as walkSourceTree(), by `threads` workers in parallel: directories are read
+// with openat()/getdents64() and handed out through per-worker deques (idle workers steal from
+// the others), and each file is passed to `on_file` right away on the worker that found it, so
+// scanning overlaps the walk. `worker` (< threads) indexes per-thread state; `on_file` must be
+// thread-safe otherwise. Returning false stops all workers. Visiting order is unspecified.
+void walkSourceTreeParallel(const std::string& root,
+                            const std::vector<std::string>& extensions,
+                            std::size_t threads,
+                            const std::function<bool(const std::string& path, std::size_t worker)>& on_file,
+                            std::atomic_bool* cancelled = nullptr);
+
+// Whether enumerateSourceFiles() may list a repository's files from its git index (default on).
+void setGitIndexListing(bool enabled);
+bool gitIndexListing();
+
+// The files enumerateSourceFiles() takes from `root`'s git index, if it does: the indexes check
+// changed files against this so that they cover the same files as a full scan (an untracked file
+// is dropped like a deleted one). Outside a git work tree, or with git index listing off, it
+// contains every file. Reads the index once, on construction.
+class ListedFiles final {
+ public:
+  explicit ListedFiles(const std::string& root);
+
+  bool contains(std::string_view rel) const;
+
+ private:
+  bool all_ = true;
+  std::vector<std::string> tracked_;  // sorted
+};
+
+// The files a workspace search covers, with walkSourceTreeParallel()'s interface. If `root` is the
+// top of a git work tree, its tracked files are read from the git index instead of walking the
+// directories (like `git grep`, untracked files are then left out); ignore files, excluded
+// directories and `extensions` apply either way. Otherwise the tree is walked.
+void enumerateSourceFiles(const std::string& root,
+                          const std::vector<std::string>& extensions,
+                          std::size_t threads,
+                          const std::function<bool(const std::string& path, std::size_t worker)>& on_file,
+                          std::atomic_bool* cancelled = nullptr);
+
+}  // namespace slclangd
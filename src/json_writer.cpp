@@ -0,0 +1,157 @@
+#include "json_writer.h"
+
+#include <charconv>
+
+namespace slclangd {
+namespace {
+
+// Length of the valid UTF-8 sequence at the start of `s`, or 0 if it is malformed (truncated,
+// overlong, a surrogate or beyond U+10FFFF).
+static std::size_t validUtf8Length(std::string_view s) {
+  const auto b0 = static_cast<unsigned char>(s[0]);
+  std::size_t len;
+  std::uint32_t cp;
+  if (b0 >= 0xC2 && b0 <= 0xDF) {
+    len = 2;
+    cp = b0 & 0x1F;
+  } else if (b0 >= 0xE0 && b0 <= 0xEF) {
+    len = 3;
+    cp = b0 & 0x0F;
+  } else if (b0 >= 0xF0 && b0 <= 0xF4) {
+    len = 4;
+    cp = b0 & 0x07;
+  } else {
+    return 0;
+  }
+  if (s.size() < len) return 0;
+  for (std::size_t i = 1; i < len; ++i) {
+    const auto b = static_cast<unsigned char>(s[i]);
+    if ((b & 0xC0) != 0x80) return 0;
+    cp = (cp << 6) | (b & 0x3F);
+  }
+  if ((len == 3 && (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF))) || (len == 4 && (cp < 0x10000 || cp > 0x10FFFF))) {
+    return 0;
+  }
+  return len;
+}
+
+}  // namespace
+
+void JsonWriter::separate() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+  if (first_.empty()) return;
+  if (first_.back()) {
+    first_.back() = false;
+  } else {
+    out_ += ',';
+  }
+}
+
+void JsonWriter::beginObject() {
+  separate();
+  out_ += '{';
+  first_.push_back(true);
+}
+
+void JsonWriter::endObject() {
+  out_ += '}';
+  first_.pop_back();
+}
+
+void JsonWriter::beginArray() {
+  separate();
+  out_ += '[';
+  first_.push_back(true);
+}
+
+void JsonWriter::endArray() {
+  out_ += ']';
+  first_.pop_back();
+}
+
+void JsonWriter::key(std::string_view k) {
+  separate();
+  appendEscaped(k);
+  out_ += ':';
+  after_key_ = true;
+}
+
+void JsonWriter::value(std::string_view s) {
+  separate();
+  appendEscaped(s);
+}
+
+void JsonWriter::value(std::int64_t n) {
+  separate();
+  char buf[24];
+  auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), n);
+  (void)ec;
+  out_.append(buf, end);
+}
+
+void JsonWriter::value(bool b) {
+  separate();
+  out_ += b ? "true" : "false";
+}
+
+void JsonWriter::null() {
+  separate();
+  out_ += "null";
+}
+
+void JsonWriter::raw(std::string_view json) {
+  separate();
+  out_ += json;
+}
+
+void JsonWriter::appendEscaped(std::string_view s) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  out_ += '"';
+  std::size_t i = 0;
+  while (i < s.size()) {
+    // Copy runs of plain ASCII in one go.
+    std::size_t run = i;
+    while (run < s.size()) {
+      const auto c = static_cast<unsigned char>(s[run]);
+      if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\') break;
+      ++run;
+    }
+    out_.append(s, i, run - i);
+    i = run;
+    if (i == s.size()) break;
+
+    const auto c = static_cast<unsigned char>(s[i]);
+    if (c >= 0x80) {
+      std::size_t len = validUtf8Length(s.substr(i));
+      if (len == 0) {
+        out_ += "\xEF\xBF\xBD";  // U+FFFD
+        ++i;
+      } else {
+        out_.append(s, i, len);
+        i += len;
+      }
+      continue;
+    }
+    switch (c) {
+      case '"': out_ += "\\\""; break;
+      case '\\': out_ += "\\\\"; break;
+      case '\b': out_ += "\\b"; break;
+      case '\f': out_ += "\\f"; break;
+      case '\n': out_ += "\\n"; break;
+      case '\r': out_ += "\\r"; break;
+      case '\t': out_ += "\\t"; break;
+      default:
+        out_ += "\\u00";
+        out_ += kHex[c >> 4];
+        out_ += kHex[c & 0xF];
+        break;
+    }
+    ++i;
+  }
+  out_ += '"';
+}
+
+}  // namespace slclangd
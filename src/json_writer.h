@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace slclangd {
+
+// Appends compact JSON to a string without building a DOM; used for large LSP results
+// (thousands of Locations), where nlohmann::json's per-node allocations dominate.
+// Separators are inserted automatically:
+//
+//   JsonWriter w(out);
+//   w.beginObject();
+//   w.key("line"); w.value(3);
+//   w.endObject();
+//
+// Strings are escaped like nlohmann's dump(), except that invalid UTF-8 becomes U+FFFD instead of
+// throwing.
+class JsonWriter final {
+ public:
+  explicit JsonWriter(std::string& out) : out_(out) {}
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  void key(std::string_view k);
+  void value(std::string_view s);
+  void value(const char* s) { value(std::string_view(s)); }
+  void value(std::int64_t n);
+  void value(int n) { value(static_cast<std::int64_t>(n)); }
+  void value(bool b);
+  void null();
+  // Already-encoded JSON (e.g. a request id or a nlohmann::json::dump()).
+  void raw(std::string_view json);
+
+ private:
+  void separate();
+  void appendEscaped(std::string_view s);
+
+  std::string& out_;
+  std::vector<bool> first_;  // per open container: nothing written into it yet
+  bool after_key_ = false;
+};
+
+}  // namespace slclangd
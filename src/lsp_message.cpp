@@ -0,0 +1,131 @@
+#include "lsp_message.h"
+
+#include <utility>
+
+namespace slclangd::lsp {
+namespace {
+
+using json = nlohmann::json;
+
+// Builds the message DOM like nlohmann's own SAX DOM parser, tracking just enough of the path to
+// recognise the text payloads and divert them.
+class MessageSax final {
+ public:
+  explicit MessageSax(Message& out) : out_(out) {}
+
+  json& root() { return root_; }
+
+  bool null() { return add(nullptr); }
+  bool boolean(bool v) { return add(v); }
+  bool number_integer(json::number_integer_t v) { return add(v); }
+  bool number_unsigned(json::number_unsigned_t v) { return add(v); }
+  bool number_float(json::number_float_t v, const json::string_t&) { return add(v); }
+  bool binary(json::binary_t& v) { return add(std::move(v)); }
+
+  bool string(json::string_t& v) {
+    if (!frames_.empty() && frames_.back().node->is_object() && key_ == "text") {
+      if (frames_.back().where == Where::kTextDocument) {
+        out_.text = std::move(v);
+        return true;
+      }
+      if (frames_.back().where == Where::kChange) {
+        out_.change_texts.back() = std::move(v);
+        return true;
+      }
+    }
+    return add(std::move(v));
+  }
+
+  bool start_object(std::size_t) { return open(json::value_t::object); }
+  bool start_array(std::size_t) { return open(json::value_t::array); }
+  bool end_object() { return close(); }
+  bool end_array() { return close(); }
+
+  bool key(json::string_t& k) {
+    key_ = std::move(k);
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string&, const json::exception&) { return false; }
+
+ private:
+  enum class Where { kOther, kRoot, kParams, kTextDocument, kContentChanges, kChange };
+
+  struct Frame {
+    json* node;
+    Where where;
+  };
+
+  // Where a container opened at the current position sits in the message.
+  Where childWhere(json::value_t type) const {
+    if (frames_.empty()) return type == json::value_t::object ? Where::kRoot : Where::kOther;
+    const Where parent = frames_.back().where;
+    const bool is_object = type == json::value_t::object;
+    if (parent == Where::kRoot && is_object && key_ == "params") return Where::kParams;
+    if (parent == Where::kParams && is_object && key_ == "textDocument") return Where::kTextDocument;
+    if (parent == Where::kParams && !is_object && key_ == "contentChanges") return Where::kContentChanges;
+    if (parent == Where::kContentChanges && is_object) return Where::kChange;
+    return Where::kOther;
+  }
+
+  template <typename Value>
+  json* place(Value&& v) {
+    if (frames_.empty()) {
+      root_ = json(std::forward<Value>(v));
+      return &root_;
+    }
+    json* parent = frames_.back().node;
+    if (parent->is_array()) {
+      // Keep change_texts index-aligned with contentChanges, whatever the elements are.
+      if (frames_.back().where == Where::kContentChanges) out_.change_texts.emplace_back();
+      parent->emplace_back(std::forward<Value>(v));
+      return &parent->back();
+    }
+    // The member is only created here, so diverted payloads leave no key behind.
+    json& slot = (*parent)[key_];
+    slot = json(std::forward<Value>(v));
+    return &slot;
+  }
+
+  template <typename Value>
+  bool add(Value&& v) {
+    place(std::forward<Value>(v));
+    return true;
+  }
+
+  bool open(json::value_t type) {
+    const Where where = childWhere(type);
+    frames_.push_back({place(type), where});
+    return true;
+  }
+
+  bool close() {
+    frames_.pop_back();
+    return true;
+  }
+
+  Message& out_;
+  json root_;
+  std::vector<Frame> frames_;
+  std::string key_;  // last key seen in the innermost object
+};
+
+}  // namespace
+
+bool parseMessage(std::string_view body, Message& out) {
+  MessageSax sax(out);
+  if (!json::sax_parse(body.begin(), body.end(), &sax) || !sax.root().is_object()) return false;
+
+  json& root = sax.root();
+  if (auto it = root.find("method"); it != root.end() && it->is_string()) {
+    out.method = std::move(it->get_ref<std::string&>());
+  }
+  if (auto it = root.find("id"); it != root.end()) {
+    out.has_id = true;
+    out.id = std::move(*it);
+  }
+  if (auto it = root.find("params"); it != root.end()) out.params = std::move(*it);
+  return true;
+}
+
+}  // namespace slclangd::lsp
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.hpp"
+
+namespace slclangd::lsp {
+
+// An incoming JSON-RPC message, parsed in a single SAX pass.
+//
+// `params` is a regular DOM, except for the document text of didOpen/didChange
+// (params.textDocument.text and params.contentChanges[i].text): those can be megabytes, so the
+// parser's decoded string is moved straight into `text` / `change_texts` instead of being copied
+// into the tree and out again.
+struct Message {
+  std::string method;  // empty if missing or not a string
+  bool has_id = false;
+  nlohmann::json id;
+  nlohmann::json params = nlohmann::json::object();
+  std::optional<std::string> text;                        // params.textDocument.text
+  std::vector<std::optional<std::string>> change_texts;  // params.contentChanges[i].text
+};
+
+// Returns false if `body` isn't a JSON object.
+bool parseMessage(std::string_view body, Message& out);
+
+}  // namespace slclangd::lsp
@@ -6,14 +6,20 @@
 #include <cstdlib>
 #include <filesystem>
 #include <functional>
+#include <numeric>
 #include <optional>
 #include <string_view>
-#include <unordered_set>
 #include <string>
+#include <memory>
 #include <thread>
+#include <tuple>
 #include <vector>
 
+#include "fuzzy_match.h"
 #include "grep_search.h"
+#include "inproc_search.h"
+#include "json_writer.h"
+#include "match_score.h"
 #include "uri.h"
 
 #include "json.hpp"
@@ -23,6 +29,9 @@ using nlohmann::json;
 
 namespace {
 
+// Source extensions searched in the workspace (grep --include style, comma-separated).
+constexpr const char* kSourceExtensions = "c,cc,cpp,cxx,h,hh,hpp,hxx";
+
 static std::string getStringOr(const json& j, const char* key, const std::string& def = {}) {
   if (!j.is_object()) return def;
   auto it = j.find(key);
@@ -37,211 +46,113 @@ static int getIntOr(const json& j, const char* key, int def = 0) {
   return it->get<int>();
 }
 
-static std::string wordAt(const std::string& text, int line0, int ch0) {
-  if (line0 < 0 || ch0 < 0) return {};
-  int cur_line = 0;
-  std::size_t line_start = 0;
-  for (std::size_t i = 0; i <= text.size(); ++i) {
-    if (i == text.size() || text[i] == '\n') {
-      if (cur_line == line0) {
-        std::size_t line_end = i;
-        std::string_view line(text.data() + line_start, line_end - line_start);
-        std::size_t c = static_cast<std::size_t>(std::min<int>(ch0, static_cast<int>(line.size())));
-
-        auto is_word = [](unsigned char x) { return std::isalnum(x) || x == '_'; };
-        std::size_t L = c;
-        if (L > 0 && L == line.size()) L--;
-        while (L > 0 && is_word(static_cast<unsigned char>(line[L])) == false && is_word(static_cast<unsigned char>(line[L - 1]))) {
-          L--;
-        }
-        std::size_t start = L;
-        while (start > 0 && is_word(static_cast<unsigned char>(line[start - 1]))) start--;
-        std::size_t end = L;
-        while (end < line.size() && is_word(static_cast<unsigned char>(line[end]))) end++;
-        if (end <= start) return {};
-        return std::string(line.substr(start, end - start));
-      }
-      cur_line++;
-      line_start = i + 1;
-    }
+// `col` is a byte column (see utf16ToByteColumn()).
+static std::string wordAt(std::string_view line, std::size_t col) {
+  std::size_t c = std::min(col, line.size());
+
+  auto is_word = [](unsigned char x) { return std::isalnum(x) || x == '_'; };
+  std::size_t L = c;
+  if (L > 0 && L == line.size()) L--;
+  while (L > 0 && is_word(static_cast<unsigned char>(line[L])) == false && is_word(static_cast<unsigned char>(line[L - 1]))) {
+    L--;
   }
-  return {};
-}
-
-static bool isInLineCommentAt(const std::string& text, int line0, int ch0) {
-  if (line0 < 0 || ch0 < 0) return false;
-  int cur_line = 0;
-  std::size_t line_start = 0;
-  for (std::size_t i = 0; i <= text.size(); ++i) {
-    if (i == text.size() || text[i] == '\n') {
-      if (cur_line == line0) {
-        std::size_t line_end = i;
-        std::string_view line(text.data() + line_start, line_end - line_start);
-        std::size_t col = static_cast<std::size_t>(std::min<int>(ch0, static_cast<int>(line.size())));
-
-        auto is_escaped_quote = [&](std::size_t pos) -> bool {
-          std::size_t bs = 0;
-          while (pos > 0 && line[pos - 1] == '\\') {
-            ++bs;
-            --pos;
-          }
-          return (bs % 2) == 1;
-        };
-
-        bool in_string = false;
-        for (std::size_t j = 0; j + 1 < line.size(); ++j) {
-          if (line[j] == '"' && !is_escaped_quote(j)) in_string = !in_string;
-          if (!in_string && line[j] == '/' && line[j + 1] == '/') {
-            return col >= j;
-          }
-        }
-        return false;
-      }
-      cur_line++;
-      line_start = i + 1;
+  std::size_t start = L;
+  while (start > 0 && is_word(static_cast<unsigned char>(line[start - 1]))) start--;
+  std::size_t end = L;
+  while (end < line.size() && is_word(static_cast<unsigned char>(line[end]))) end++;
+  if (end <= start) return {};
+  return std::string(line.substr(start, end - start));
+}
+
+static bool isInLineCommentAt(std::string_view line, std::size_t col) {
+  col = std::min(col, line.size());
+
+  auto is_escaped_quote = [&](std::size_t pos) -> bool {
+    std::size_t bs = 0;
+    while (pos > 0 && line[pos - 1] == '\\') {
+      ++bs;
+      --pos;
+    }
+    return (bs % 2) == 1;
+  };
+
+  bool in_string = false;
+  for (std::size_t j = 0; j + 1 < line.size(); ++j) {
+    if (line[j] == '"' && !is_escaped_quote(j)) in_string = !in_string;
+    if (!in_string && line[j] == '/' && line[j + 1] == '/') {
+      return col >= j;
     }
   }
   return false;
 }
 
-static bool isStopWord(std::string_view sym) {
-  if (sym.empty()) return true;
-  std::string lower;
-  lower.reserve(sym.size());
-  for (unsigned char c : sym) lower.push_back(static_cast<char>(std::tolower(c)));
-
-  static const std::unordered_set<std::string> kStop = {
-      // very common C/C++ keywords that shouldn't trigger grep
-      "alignas",   "alignof",   "asm",      "auto",     "bool",     "break",   "case",   "catch",
-      "char",      "char8_t",   "char16_t", "char32_t", "class",    "concept", "const",  "consteval",
-      "constexpr", "constinit", "continue", "co_await", "co_return","co_yield","decltype","default",
-      "delete",    "do",        "double",   "dynamic_cast","else",  "enum",    "explicit","export",
-      "extern",    "false",     "float",    "for",      "friend",   "goto",    "if",     "inline",
-      "int",       "long",      "mutable",  "namespace","new",      "noexcept","nullptr","operator",
-      "private",   "protected", "public",   "register", "reinterpret_cast","requires","return",
-      "short",     "signed",    "sizeof",   "static",   "static_assert","static_cast","struct",
-      "switch",    "template",  "this",     "thread_local","throw", "true",    "try",    "typedef",
-      "typeid",    "typename",  "union",    "unsigned", "using",    "virtual", "void",   "volatile",
-      "wchar_t",   "while",
-  };
-  return kStop.find(lower) != kStop.end();
+// Encoded results of the async handlers (see Server::AsyncHandler).
+constexpr const char* kNullJson = "null";
+constexpr const char* kEmptyArrayJson = "[]";
+
+static void writePosition(JsonWriter& w, int line, int character) {
+  w.beginObject();
+  w.key("line");
+  w.value(line);
+  w.key("character");
+  w.value(character);
+  w.endObject();
 }
 
-struct MatchRank {
-  GrepMatch m;
-  int score = 0;
-  std::string abs_path;
-};
-
-static bool isWsOrBolBefore(const std::string& line, int col0) {
-  if (col0 <= 0) return true;
-  char c = line[static_cast<std::size_t>(col0 - 1)];
-  return c == ' ' || c == '\t';
-}
-
-static std::optional<int> macroNameStartIfDefine(const std::string& line) {
-  std::size_t i = 0;
-  while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
-  if (i >= line.size() || line[i] != '#') return std::nullopt;
-  ++i;
-  while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
-  constexpr std::string_view kDefine = "define";
-  if (i + kDefine.size() > line.size()) return std::nullopt;
-  if (std::string_view(line).substr(i, kDefine.size()) != kDefine) return std::nullopt;
-  i += kDefine.size();
-  if (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i]))) return std::nullopt;
-  while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
-  if (i >= line.size()) return std::nullopt;
-  return static_cast<int>(i);
-}
-
-static int scoreMatchLine(const std::string& line, int col0, std::string_view needle) {
-  if (col0 < 0) return -100000;
-  int score = 0;
+// Location of a `len`-byte match; GrepMatch columns are bytes, LSP characters are UTF-16 units.
+static void writeLocation(JsonWriter& w, const std::string& abs_path, const GrepMatch& m, std::size_t len) {
+  const auto begin = static_cast<std::size_t>(std::max(m.column, 0));
+  w.beginObject();
+  w.key("uri");
+  w.value(pathToFileUri(abs_path));
+  w.key("range");
+  w.beginObject();
+  w.key("start");
+  writePosition(w, m.line - 1, byteToUtf16Column(m.text, begin));
+  w.key("end");
+  writePosition(w, m.line - 1, byteToUtf16Column(m.text, begin + len));
+  w.endObject();
+  w.endObject();
+}
 
-  auto prevNonSpace = [&](int before) -> char {
-    int k = before;
-    while (k > 0) {
-      char c = line[static_cast<std::size_t>(k - 1)];
-      if (c != ' ' && c != '\t') return c;
-      --k;
-    }
-    return '\0';
-  };
+// Location of a scanned declaration's name (its columns are UTF-16 units already).
+static void writeDeclarationLocation(JsonWriter& w, const std::string& abs_path, const Declaration& d) {
+  w.beginObject();
+  w.key("uri");
+  w.value(pathToFileUri(abs_path));
+  w.key("range");
+  w.beginObject();
+  w.key("start");
+  writePosition(w, d.line, d.column);
+  w.key("end");
+  writePosition(w, d.line, d.column + d.length);
+  w.endObject();
+  w.endObject();
+}
 
-  auto prevIdentifier = [&](int before) -> std::string {
-    // Walk left: skip whitespace, then common punctuation, then collect identifier.
-    int k = before;
-    while (k > 0 && (line[static_cast<std::size_t>(k - 1)] == ' ' || line[static_cast<std::size_t>(k - 1)] == '\t')) --k;
-    while (k > 0) {
-      char c = line[static_cast<std::size_t>(k - 1)];
-      if (c == '*' || c == '&' || c == ':' || c == '<' || c == '>' || c == ',' || c == '(') {
-        --k;
-        continue;
-      }
-      break;
-    }
-    while (k > 0 && (line[static_cast<std::size_t>(k - 1)] == ' ' || line[static_cast<std::size_t>(k - 1)] == '\t')) --k;
-
-    int end = k;
-    while (k > 0) {
-      unsigned char uc = static_cast<unsigned char>(line[static_cast<std::size_t>(k - 1)]);
-      if (std::isalnum(uc) || uc == '_') {
-        --k;
-        continue;
-      }
-      break;
-    }
-    if (end <= k) return {};
-    std::string tok = line.substr(static_cast<std::size_t>(k), static_cast<std::size_t>(end - k));
-    for (auto& ch : tok) ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
-    return tok;
-  };
+// very common C/C++ keywords that shouldn't trigger grep
+constexpr std::string_view kStopWordList[] = {
+    "alignas",   "alignof",   "asm",      "auto",     "bool",     "break",   "case",   "catch",
+    "char",      "char8_t",   "char16_t", "char32_t", "class",    "concept", "const",  "consteval",
+    "constexpr", "constinit", "continue", "co_await", "co_return","co_yield","decltype","default",
+    "delete",    "do",        "double",   "dynamic_cast","else",  "enum",    "explicit","export",
+    "extern",    "false",     "float",    "for",      "friend",   "goto",    "if",     "inline",
+    "int",       "long",      "mutable",  "namespace","new",      "noexcept","nullptr","operator",
+    "private",   "protected", "public",   "register", "reinterpret_cast","requires","return",
+    "short",     "signed",    "sizeof",   "static",   "static_assert","static_cast","struct",
+    "switch",    "template",  "this",     "thread_local","throw", "true",    "try",    "typedef",
+    "typeid",    "typename",  "union",    "unsigned", "using",    "virtual", "void",   "volatile",
+    "wchar_t",   "while",
+};
+constexpr auto kStopWords = makeKeywordTable<512>(kStopWordList);
 
-  // Strong signal: macro definition (#define <needle> ...)
-  if (auto macro_start = macroNameStartIfDefine(line)) {
-    if (*macro_start == col0) score += 100;
-  }
-
-  // Boundary before token indicates likely declaration/definition site.
-  if (isWsOrBolBefore(line, col0)) score += 25;
-
-  // Template-ish / qualified type-ish: previous non-space is '>' (e.g. vector<T> foo(...))
-  if (prevNonSpace(col0) == '>') score += 20;
-
-  int end = col0 + static_cast<int>(needle.size());
-  if (end < 0) end = 0;
-  if (end > static_cast<int>(line.size())) end = static_cast<int>(line.size());
-
-  // Lookahead after token.
-  // - immediate ';' after token: very likely a declaration (e.g. "int foo;")
-  if (end < static_cast<int>(line.size()) && line[static_cast<std::size_t>(end)] == ';') score += 40;
-
-  // - next non-space is '(' : function-like (decl/def/call), still a good signal.
-  std::size_t j = static_cast<std::size_t>(end);
-  while (j < line.size() && (line[j] == ' ' || line[j] == '\t')) ++j;
-  if (j < line.size() && line[j] == '(') score += 60;
-
-  // If it's function-like and preceded by a primitive return type, boost more.
-  // Heuristic examples: "int foo(", "void bar(", "unsigned long baz(".
-  if (j < line.size() && line[j] == '(') {
-    std::string prev = prevIdentifier(col0);
-    static const std::unordered_set<std::string> kPrim = {
-        "void", "bool", "char", "short", "int", "long", "float", "double",
-        "signed", "unsigned",
-        "wchar_t", "char8_t", "char16_t", "char32_t",
-        "size_t", "ssize_t",
-        "int8_t", "uint8_t", "int16_t", "uint16_t", "int32_t", "uint32_t", "int64_t", "uint64_t",
-        "intptr_t", "uintptr_t",
-        // Common kernel typedefs
-        "u8", "u16", "u32", "u64",
-        "s8", "s16", "s32", "s64",
-    };
-    if (!prev.empty() && kPrim.find(prev) != kPrim.end()) score += 30;
-  }
+static bool isStopWord(std::string_view sym) { return sym.empty() || kStopWords.contains(sym); }
 
-  return score;
-}
+struct MatchRank {
+  const GrepMatch* m = nullptr;  // into the ranked matches
+  int score = 0;
+  std::shared_ptr<const std::string> abs_path;  // shared by the matches in one file
+};
 
 static std::vector<MatchRank> rankAndFilterMatches(const std::vector<GrepMatch>& matches,
                                                    std::string_view needle,
@@ -249,32 +160,127 @@ static std::vector<MatchRank> rankAndFilterMatches(const std::vector<GrepMatch>&
                                                    int current_line1,
                                                    const std::string& prefer_abs_path,
                                                    const std::function<std::string(const std::string&)>& make_abs) {
-  std::vector<MatchRank> out;
-  out.reserve(matches.size());
-  for (const auto& m : matches) {
-    MatchRank r;
-    r.m = m;
-    r.abs_path = make_abs(m.path);
+  const std::vector<int> scores = scoreMatchLines(matches, needle.size());
+
+  // Matches come grouped by file: resolve each run's path once, and order paths by their rank
+  // among the runs' so sorting the matches compares integers.
+  struct Run {
+    std::shared_ptr<const std::string> abs_path;
+    std::uint32_t rank = 0;
+  };
+  std::vector<Run> runs;
+  std::vector<std::uint32_t> run_of(matches.size());
+  for (std::size_t i = 0; i < matches.size(); ++i) {
+    if (i == 0 || matches[i].path != matches[i - 1].path) runs.push_back(Run{std::make_shared<const std::string>(make_abs(matches[i].path))});
+    run_of[i] = static_cast<std::uint32_t>(runs.size() - 1);
+  }
+  std::vector<std::uint32_t> by_path(runs.size());
+  std::iota(by_path.begin(), by_path.end(), 0);
+  std::sort(by_path.begin(), by_path.end(),
+            [&](std::uint32_t a, std::uint32_t b) { return *runs[a].abs_path < *runs[b].abs_path; });
+  for (std::size_t i = 1; i < by_path.size(); ++i) {
+    const Run& prev = runs[by_path[i - 1]];
+    runs[by_path[i]].rank = prev.rank + (*prev.abs_path == *runs[by_path[i]].abs_path ? 0 : 1);
+  }
+
+  struct Key {
+    int score;
+    std::uint32_t path;  // Run::rank
+    int line;
+    int column;
+    std::uint32_t index;  // into matches, so equal keys keep their order
+  };
+  std::vector<Key> keys;
+  keys.reserve(matches.size());
+  for (std::size_t i = 0; i < matches.size(); ++i) {
+    const GrepMatch& m = matches[i];
+    const Run& run = runs[run_of[i]];
     if (!current_abs_path.empty() && current_line1 > 0) {
-      if (r.abs_path == current_abs_path && m.line == current_line1) {
+      if (*run.abs_path == current_abs_path && m.line == current_line1) {
         continue;  // ignore exact same line; user is already there
       }
     }
-    r.score = scoreMatchLine(m.text, m.column, needle);
+    int score = scores[i];
     // Prefer matches in the same file as the query (useful for references),
     // but do not outrank real "definition-like" signals.
-    if (!prefer_abs_path.empty() && r.abs_path == prefer_abs_path) r.score += 10;
-    out.push_back(std::move(r));
+    if (!prefer_abs_path.empty() && *run.abs_path == prefer_abs_path) score += 10;
+    keys.push_back(Key{score, run.rank, m.line, m.column, static_cast<std::uint32_t>(i)});
   }
-  std::stable_sort(out.begin(), out.end(), [](const MatchRank& a, const MatchRank& b) {
+  std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
     if (a.score != b.score) return a.score > b.score;
-    if (a.abs_path != b.abs_path) return a.abs_path < b.abs_path;
-    if (a.m.line != b.m.line) return a.m.line < b.m.line;
-    return a.m.column < b.m.column;
+    return std::tie(a.path, a.line, a.column, a.index) < std::tie(b.path, b.line, b.column, b.index);
   });
+
+  std::vector<MatchRank> out;
+  out.reserve(keys.size());
+  for (const Key& k : keys) out.push_back(MatchRank{&matches[k.index], k.score, runs[run_of[k.index]].abs_path});
   return out;
 }
 
+static void writeSymbolInformation(JsonWriter& w, const MatchRank& r, const std::string& query) {
+  // The identifier the query was found in (it may be part of a longer one).
+  std::string name = wordAt(r.m->text, static_cast<std::size_t>(std::max(r.m->column, 0)));
+  w.beginObject();
+  w.key("name");
+  w.value(name.empty() ? query : name);
+  w.key("kind");
+  w.value(13);  // Variable (arbitrary; we're grep-based)
+  w.key("location");
+  writeLocation(w, *r.abs_path, *r.m, query.size());
+  w.endObject();
+}
+
+// LSP SymbolKind, mapped the way clangd maps its index's kinds. `member`: a function whose
+// container is a class.
+static int symbolKindOf(const Declaration& d, bool member) {
+  if (d.kind == DeclKind::kFunction && member) {
+    const std::size_t colons = d.container.rfind("::");
+    const std::string_view cls =
+        colons == std::string::npos ? std::string_view(d.container) : std::string_view(d.container).substr(colons + 2);
+    const std::string_view name = d.name[0] == '~' ? std::string_view(d.name).substr(1) : std::string_view(d.name);
+    return name == cls ? 9 : 6;  // Constructor (destructors too, as in clangd), Method
+  }
+  switch (d.kind) {
+    case DeclKind::kMacro: return 15;       // String
+    case DeclKind::kClass: return 5;        // Class
+    case DeclKind::kStruct: return 23;      // Struct
+    case DeclKind::kUnion: return 5;        // Class
+    case DeclKind::kEnum: return 10;        // Enum
+    case DeclKind::kEnumerator: return 22;  // EnumMember
+    case DeclKind::kTypedef: return 5;      // Class
+    case DeclKind::kFunction: return 12;    // Function
+    case DeclKind::kVariable: return 13;    // Variable
+  }
+  return 13;
+}
+
+static void writeDeclarationSymbolInformation(JsonWriter& w,
+                                              const std::string& abs_path,
+                                              const Declaration& d,
+                                              bool member) {
+  w.beginObject();
+  w.key("name");
+  w.value(d.name);
+  w.key("kind");
+  w.value(symbolKindOf(d, member));
+  w.key("location");
+  writeDeclarationLocation(w, abs_path, d);
+  // The enclosing namespaces and classes ("a::B"); absent at file scope.
+  if (!d.container.empty()) {
+    w.key("containerName");
+    w.value(d.container);
+  }
+  w.endObject();
+}
+
+// LSP ProgressToken (integer | string), or null if `params` has none under `key`.
+static json progressToken(const json& params, const char* key) {
+  if (!params.is_object()) return nullptr;
+  auto it = params.find(key);
+  if (it == params.end() || !(it->is_string() || it->is_number_integer())) return nullptr;
+  return *it;
+}
+
 static json nullResult() { return nullptr; }
 
 static std::string inflightKey(const json& id) {
@@ -284,16 +290,112 @@ static std::string inflightKey(const json& id) {
 
 }  // namespace
 
-Server::Server(Transport& transport, std::vector<std::string> serve_files)
-    : transport_(transport), serve_files_(std::move(serve_files)) {
+Server::Server(Transport& transport, ServerOptions options)
+    : transport_(transport), serve_files_(std::move(options.serve_files)), use_index_(options.use_index) {
   const char* t1 = std::getenv("SLCLANGD_TRACE");
   const char* t2 = std::getenv("CLANGD_TRACE");  // used by vscode-clangd extension
   auto enabled = [](const char* v) {
     return v && *v && std::string(v) != "0";
   };
   trace_ = enabled(t1) || enabled(t2);
+  pool_ = std::make_unique<ThreadPool>(options.worker_threads ? options.worker_threads : ThreadPool::defaultThreads());
+}
+
+Server::~Server() {
+  {
+    // Stop in-flight searches so joining the pool doesn't wait for them to finish.
+    std::lock_guard<std::mutex> lg(inflight_mu_);
+    for (auto& [key, inflight] : inflight_) cancelInFlight(*inflight);
+  }
+  // The indexing threads and the watcher's callbacks use the members: finish them first.
+  stop_indexing_.store(true, std::memory_order_release);
+  if (indexing_thread_.joinable()) indexing_thread_.join();
+  if (watcher_) watcher_->stop();
 }
 
+void Server::cancelInFlight(InFlight& inflight) {
+  inflight.cancelled.store(true, std::memory_order_release);
+  pid_t pid = inflight.grep_pid.load(std::memory_order_acquire);
+  if (pid > 0) {
+    (void)kill(pid, SIGTERM);
+  }
+  // A shared search only stops once all the requests waiting on it are cancelled.
+  search_flights_.cancel(&inflight.cancelled);
+}
+
+// Reports a search's progress against the tokens of the request it answers: a workDoneToken gets
+// begin/report/end with the share of files searched so far, a partialResultToken gets the results
+// in batches as the search finds them. Each batch is ranked on its own, and once any has been sent
+// the response itself must be empty.
+class Server::RequestProgress final {
+ public:
+  // Writes one batch of matches as a JSON array of results; returns how many it wrote.
+  using EncodeFn = std::function<std::size_t(JsonWriter& w, const std::vector<GrepMatch>& matches)>;
+
+  RequestProgress(Server& server, const json& params, const char* title, EncodeFn encode)
+      : server_(server),
+        work_done_token_(progressToken(params, "workDoneToken")),
+        partial_result_token_(progressToken(params, "partialResultToken")),
+        encode_(std::move(encode)) {
+    if (!work_done_token_.is_null()) {
+      send(work_done_token_, json{{"kind", "begin"}, {"title", title}, {"cancellable", false}, {"percentage", 0}}.dump());
+      hooks_.on_files = [this](std::size_t scanned, std::size_t total) {
+        json value{{"kind", "report"}};
+        if (total > 0) {
+          value["message"] = std::to_string(scanned) + "/" + std::to_string(total) + " files";
+          value["percentage"] = std::min<std::size_t>(scanned * 100 / total, 99);
+        } else {
+          value["message"] = std::to_string(scanned) + " files";
+        }
+        // Superseded by the next report anyway.
+        send(work_done_token_, value.dump(), /*droppable=*/true);
+      };
+    }
+    if (!partial_result_token_.is_null()) {
+      hooks_.on_matches = [this](const std::vector<GrepMatch>& batch) {
+        std::string value;
+        JsonWriter w(value);
+        if (encode_(w, batch) == 0) return;
+        send(partial_result_token_, value);
+        streamed_ = true;
+      };
+    }
+  }
+
+  ~RequestProgress() {
+    if (!work_done_token_.is_null()) send(work_done_token_, R"({"kind":"end"})");
+  }
+
+  RequestProgress(const RequestProgress&) = delete;
+  RequestProgress& operator=(const RequestProgress&) = delete;
+
+  // Hooks for searchWorkspace(), or null if the client passed neither token.
+  const SearchProgress* search() const { return hooks_.on_files || hooks_.on_matches ? &hooks_ : nullptr; }
+
+  // Whether results went out as partial results. Only read once the search has returned.
+  bool streamed() const { return streamed_; }
+
+ private:
+  void send(const json& token, std::string_view value, bool droppable = false) {
+    std::string params;
+    JsonWriter w(params);
+    w.beginObject();
+    w.key("token");
+    w.raw(token.dump());
+    w.key("value");
+    w.raw(value);
+    w.endObject();
+    server_.sendEncodedNotification("$/progress", params, droppable);
+  }
+
+  Server& server_;
+  const json work_done_token_;
+  const json partial_result_token_;
+  const EncodeFn encode_;
+  SearchProgress hooks_;
+  bool streamed_ = false;
+};
+
 int Server::run() {
   while (!exit_requested_) {
     auto msg = transport_.readMessage();
@@ -304,30 +406,26 @@ int Server::run() {
   return shutdown_received_ ? 0 : 1;
 }
 
-void Server::handleMessage(const std::string& body) {
-  json j = json::parse(body, nullptr, false);
-  if (j.is_discarded() || !j.is_object()) {
-    transport_.logLine("Failed to parse JSON: " + body);
+void Server::handleMessage(std::string_view body) {
+  Message msg;
+  if (!parseMessage(body, msg)) {
+    transport_.logLine("Failed to parse JSON: " + std::string(body));
     return;
   }
 
-  const auto method_it = j.find("method");
-  if (method_it == j.end() || !method_it->is_string()) {
+  if (msg.method.empty()) {
     return;
   }
-  std::string method = method_it->get<std::string>();
-  if (trace_) transport_.logLine(std::string("LSP <= ") + method);
-  json params = j.value("params", json::object());
+  if (trace_) transport_.logLine(std::string("LSP <= ") + msg.method);
 
-  const auto id_it = j.find("id");
-  if (id_it != j.end()) {
-    handleRequest(method, *id_it, params);
+  if (msg.has_id) {
+    handleRequest(msg.method, msg.id, std::move(msg.params));
   } else {
-    handleNotification(method, params);
+    handleNotification(msg);
   }
 }
 
-void Server::handleRequest(const std::string& method, const json& id, const json& params) {
+void Server::handleRequest(const std::string& method, const json& id, json params) {
   try {
     if (method == "initialize") {
       replyResult(id, onInitialize(params));
@@ -351,96 +449,21 @@ void Server::handleRequest(const std::string& method, const json& id, const json
       return;
     }
     if (method == "workspace/symbol") {
-      // Potentially slow: run async so $/cancelRequest can be processed.
-      auto inflight = std::make_shared<InFlight>();
-      {
-        std::lock_guard<std::mutex> lg(inflight_mu_);
-        inflight_[inflightKey(id)] = inflight;
-      }
-      std::thread([this, id, params, inflight]() {
-        json result = nullptr;
-        try {
-          result = onWorkspaceSymbol(params, &inflight->cancelled, &inflight->grep_pid);
-          if (inflight->cancelled.load(std::memory_order_acquire)) {
-            replyError(id, -32800, "Request cancelled");
-          } else {
-            replyResult(id, result);
-          }
-        } catch (const std::exception& e) {
-          replyError(id, -32603, std::string("Internal error: ") + e.what());
-        }
-        std::lock_guard<std::mutex> lg(inflight_mu_);
-        inflight_.erase(inflightKey(id));
-      }).detach();
+      runAsync(method, id, std::move(params), &Server::onWorkspaceSymbol, ThreadPool::Priority::kBackground);
       return;
     }
     if (method == "textDocument/hover") {
-      auto inflight = std::make_shared<InFlight>();
-      {
-        std::lock_guard<std::mutex> lg(inflight_mu_);
-        inflight_[inflightKey(id)] = inflight;
-      }
-      std::thread([this, id, params, inflight]() {
-        json result = nullptr;
-        try {
-          result = onHover(params, &inflight->cancelled, &inflight->grep_pid);
-          if (inflight->cancelled.load(std::memory_order_acquire)) {
-            replyError(id, -32800, "Request cancelled");
-          } else {
-            replyResult(id, result);
-          }
-        } catch (const std::exception& e) {
-          replyError(id, -32603, std::string("Internal error: ") + e.what());
-        }
-        std::lock_guard<std::mutex> lg(inflight_mu_);
-        inflight_.erase(inflightKey(id));
-      }).detach();
+      // Hover follows the mouse: a newer hover on the same document makes older ones worthless.
+      std::string uri = getStringOr(params.value("textDocument", json::object()), "uri");
+      runAsync(method, id, std::move(params), &Server::onHover, ThreadPool::Priority::kInteractive, method + " " + uri);
       return;
     }
     if (method == "textDocument/definition") {
-      auto inflight = std::make_shared<InFlight>();
-      {
-        std::lock_guard<std::mutex> lg(inflight_mu_);
-        inflight_[inflightKey(id)] = inflight;
-      }
-      std::thread([this, id, params, inflight]() {
-        json result = nullptr;
-        try {
-          result = onDefinition(params, &inflight->cancelled, &inflight->grep_pid);
-          if (inflight->cancelled.load(std::memory_order_acquire)) {
-            replyError(id, -32800, "Request cancelled");
-          } else {
-            replyResult(id, result);
-          }
-        } catch (const std::exception& e) {
-          replyError(id, -32603, std::string("Internal error: ") + e.what());
-        }
-        std::lock_guard<std::mutex> lg(inflight_mu_);
-        inflight_.erase(inflightKey(id));
-      }).detach();
+      runAsync(method, id, std::move(params), &Server::onDefinition, ThreadPool::Priority::kInteractive);
       return;
     }
     if (method == "textDocument/references") {
-      auto inflight = std::make_shared<InFlight>();
-      {
-        std::lock_guard<std::mutex> lg(inflight_mu_);
-        inflight_[inflightKey(id)] = inflight;
-      }
-      std::thread([this, id, params, inflight]() {
-        json result = nullptr;
-        try {
-          result = onReferences(params, &inflight->cancelled, &inflight->grep_pid);
-          if (inflight->cancelled.load(std::memory_order_acquire)) {
-            replyError(id, -32800, "Request cancelled");
-          } else {
-            replyResult(id, result);
-          }
-        } catch (const std::exception& e) {
-          replyError(id, -32603, std::string("Internal error: ") + e.what());
-        }
-        std::lock_guard<std::mutex> lg(inflight_mu_);
-        inflight_.erase(inflightKey(id));
-      }).detach();
+      runAsync(method, id, std::move(params), &Server::onReferences, ThreadPool::Priority::kBackground);
       return;
     }
 
@@ -450,7 +473,60 @@ void Server::handleRequest(const std::string& method, const json& id, const json
   }
 }
 
-void Server::handleNotification(const std::string& method, const json& params) {
+void Server::runAsync(const std::string& method,
+                      const json& id,
+                      json params,
+                      AsyncHandler handler,
+                      ThreadPool::Priority priority,
+                      std::string supersede_key) {
+  auto inflight = std::make_shared<InFlight>();
+  inflight->supersede_key = std::move(supersede_key);
+  {
+    std::lock_guard<std::mutex> lg(inflight_mu_);
+    inflight_[inflightKey(id)] = inflight;
+    if (!inflight->supersede_key.empty()) {
+      auto& latest = latest_by_supersede_key_[inflight->supersede_key];
+      if (latest) {
+        latest->superseded.store(true, std::memory_order_release);
+        cancelInFlight(*latest);
+      }
+      latest = inflight;
+    }
+  }
+  pool_->submit([this, id, params = std::move(params), inflight, handler]() {
+    try {
+      // Cancelled while still queued: don't start the search at all.
+      std::string result = inflight->cancelled.load(std::memory_order_acquire)
+                               ? std::string(kNullJson)
+                               : (this->*handler)(params, &inflight->cancelled, &inflight->grep_pid);
+      if (inflight->superseded.load(std::memory_order_acquire)) {
+        replyError(id, -32800, "Request cancelled: superseded by a newer request");
+      } else if (inflight->cancelled.load(std::memory_order_acquire)) {
+        replyError(id, -32800, "Request cancelled");
+      } else {
+        replyEncodedResult(id, result);
+      }
+    } catch (const std::exception& e) {
+      replyError(id, -32603, std::string("Internal error: ") + e.what());
+    }
+    std::lock_guard<std::mutex> lg(inflight_mu_);
+    inflight_.erase(inflightKey(id));
+    if (!inflight->supersede_key.empty()) {
+      auto it = latest_by_supersede_key_.find(inflight->supersede_key);
+      if (it != latest_by_supersede_key_.end() && it->second == inflight) latest_by_supersede_key_.erase(it);
+    }
+  }, priority);
+  if (trace_) {
+    auto st = pool_->stats();
+    transport_.logLine("pool: queued " + method + " (busy " + std::to_string(st.busy) + "/" +
+                       std::to_string(st.threads) + ", queue depth " + std::to_string(st.queued) + ", completed " +
+                       std::to_string(st.completed) + ")");
+  }
+}
+
+void Server::handleNotification(Message& msg) {
+  const std::string& method = msg.method;
+  const json& params = msg.params;
   if (method == "initialized") return onInitialized(params);
   if (method == "exit") return onExit();
   if (method == "$/setTrace") return;  // ignore
@@ -465,17 +541,12 @@ void Server::handleNotification(const std::string& method, const json& params) {
       auto hit = inflight_.find(inflightKey(*it));
       if (hit != inflight_.end()) inflight = hit->second;
     }
-    if (!inflight) return;
-    inflight->cancelled.store(true, std::memory_order_release);
-    pid_t pid = inflight->grep_pid.load(std::memory_order_acquire);
-    if (pid > 0) {
-      (void)kill(pid, SIGTERM);
-    }
+    if (inflight) cancelInFlight(*inflight);
     return;
   }
   if (method == "workspace/didChangeConfiguration") return;  // ignore
-  if (method == "textDocument/didOpen") return onDidOpen(params);
-  if (method == "textDocument/didChange") return onDidChange(params);
+  if (method == "textDocument/didOpen") return onDidOpen(msg);
+  if (method == "textDocument/didChange") return onDidChange(msg);
   if (method == "textDocument/didClose") return onDidClose(params);
 }
 
@@ -484,6 +555,7 @@ json Server::onInitialize(const json& params) {
   root_path_ = getStringOr(params, "rootPath");
   if (root_path_.empty() && !root_uri_.empty()) root_path_ = fileUriToPath(root_uri_);
   if (root_uri_.empty() && !root_path_.empty()) root_uri_ = pathToFileUri(root_path_);
+  startIndexing();
 
   // vscode-clangd sends initializationOptions: { clangdFileStatus: true, fallbackFlags: [...] }
   if (params.is_object()) {
@@ -497,12 +569,13 @@ json Server::onInitialize(const json& params) {
   json caps;
   caps["textDocumentSync"] = json{
       {"openClose", true},
-      {"change", 1},  // Full
+      {"change", 2},  // Incremental
   };
   caps["hoverProvider"] = true;
   caps["definitionProvider"] = true;
-  caps["referencesProvider"] = true;
-  caps["workspaceSymbolProvider"] = true;
+  // Both report progress and stream partial results when given the tokens.
+  caps["referencesProvider"] = json{{"workDoneProgress", true}};
+  caps["workspaceSymbolProvider"] = json{{"workDoneProgress", true}};
 
   json out;
   out["capabilities"] = caps;
@@ -512,36 +585,91 @@ json Server::onInitialize(const json& params) {
 
 void Server::onInitialized(const json&) {}
 
-json Server::onShutdown() { return nullResult(); }
+json Server::onShutdown() {
+  // Persist incremental updates so the next start only revalidates.
+  if (index_ && index_->ready()) (void)index_->save();
+  return nullResult();
+}
 
 void Server::onExit() {
   // LSP: exit should terminate immediately; success depends on shutdown received.
   exit_requested_ = true;
 }
 
-void Server::onDidOpen(const json& params) {
-  auto td = params.value("textDocument", json::object());
+void Server::onDidOpen(Message& msg) {
+  const json& td = msg.params.contains("textDocument") ? msg.params["textDocument"] : msg.params;
   std::string uri = getStringOr(td, "uri");
-  std::string text = getStringOr(td, "text");
   if (uri.empty()) return;
-  docs_by_uri_[uri].text = std::move(text);
+  Document text(msg.text ? std::string_view(*msg.text) : std::string_view());
+  msg.text.reset();
+  auto snapshot = std::make_shared<const DocumentSnapshot>(std::move(text), getIntOr(td, "version", 0));
+  docs_.publish(uri, snapshot);
+  // Publish first: a search that reads the new cache generation then also sees the new text.
+  invalidateCachedSearches(uri, &snapshot->text);
   if (clangd_file_status_) {
-    sendNotification("textDocument/clangd.fileStatus", json{{"uri", uri}, {"state", "Idle"}});
+    sendNotification("textDocument/clangd.fileStatus", json{{"uri", uri}, {"state", "Idle"}}, /*droppable=*/true);
   }
 }
 
-void Server::onDidChange(const json& params) {
-  auto td = params.value("textDocument", json::object());
+void Server::onDidChange(Message& msg) {
+  const json& params = msg.params;
+  const json& td = params.contains("textDocument") ? params["textDocument"] : params;
   std::string uri = getStringOr(td, "uri");
   if (uri.empty()) return;
 
-  auto changes = params.value("contentChanges", json::array());
-  if (!changes.is_array() || changes.empty()) return;
-  auto first = changes.at(0);
-  std::string text = getStringOr(first, "text");
-  docs_by_uri_[uri].text = std::move(text);
+  const auto changes_it = params.find("contentChanges");
+  if (changes_it == params.end() || !changes_it->is_array() || changes_it->empty()) return;
+  // The parser moved each change's text out of the DOM (see Message).
+  auto changeText = [&](std::size_t i) -> std::string_view {
+    return i < msg.change_texts.size() && msg.change_texts[i] ? std::string_view(*msg.change_texts[i]) : std::string_view();
+  };
+
+  // Changes apply in order, each against the result of the previous one. Edit a copy (cheap:
+  // chunks are shared) of the current snapshot; requests still reading it are unaffected.
+  // Also tracks which lines of the result differ from the current snapshot, so that only those
+  // are checked against the cached searches.
+  DocumentStore::Snapshot current = docs_.get(uri);
+  Document text = current ? current->text : Document();
+  int first_changed = 0;
+  int last_changed = current ? -2 : -1;  // -2: none yet, -1: to the end
+  for (std::size_t i = 0; i < changes_it->size(); ++i) {
+    const json& change = (*changes_it)[i];
+    const auto range_it = change.find("range");
+    if (range_it == change.end() || !range_it->is_object()) {
+      text = Document(changeText(i));  // full replacement
+      first_changed = 0;
+      last_changed = -1;
+      continue;
+    }
+    auto start = range_it->value("start", json::object());
+    auto end = range_it->value("end", json::object());
+    std::size_t begin_off = text.offsetAt(getIntOr(start, "line"), getIntOr(start, "character"));
+    std::size_t end_off = text.offsetAt(getIntOr(end, "line"), getIntOr(end, "character"));
+    const int last_line = static_cast<int>(text.lineCount()) - 1;
+    const int begin_line = std::clamp(getIntOr(start, "line"), 0, last_line);
+    const int end_line = std::clamp(getIntOr(end, "line"), begin_line, last_line);
+    const std::string_view inserted = changeText(i);
+    text.replace(begin_off, end_off, inserted);
+    if (last_changed == -1) continue;
+    // The edit turns lines [begin_line, end_line] into [begin_line, new_end]; lines after it shift.
+    const int new_end = begin_line + static_cast<int>(std::count(inserted.begin(), inserted.end(), '\n'));
+    if (last_changed == -2) {
+      first_changed = begin_line;
+      last_changed = new_end;
+      continue;
+    }
+    const int shifted = last_changed < begin_line ? last_changed
+                        : last_changed > end_line ? last_changed + new_end - end_line
+                                                  : new_end;
+    first_changed = std::min(first_changed, begin_line);
+    last_changed = std::max(shifted, new_end);
+  }
+  int version = getIntOr(td, "version", current ? current->version + 1 : 0);
+  auto snapshot = std::make_shared<const DocumentSnapshot>(std::move(text), version);
+  docs_.publish(uri, snapshot);
+  if (last_changed != -2) invalidateCachedSearches(uri, &snapshot->text, first_changed, last_changed);
   if (clangd_file_status_) {
-    sendNotification("textDocument/clangd.fileStatus", json{{"uri", uri}, {"state", "Idle"}});
+    sendNotification("textDocument/clangd.fileStatus", json{{"uri", uri}, {"state", "Idle"}}, /*droppable=*/true);
   }
 }
 
@@ -549,7 +677,264 @@ void Server::onDidClose(const json& params) {
   auto td = params.value("textDocument", json::object());
   std::string uri = getStringOr(td, "uri");
   if (uri.empty()) return;
-  docs_by_uri_.erase(uri);
+  docs_.erase(uri);
+  invalidateCachedSearches(uri, nullptr);
+}
+
+void Server::invalidateCachedSearches(const std::string& uri, const Document* text, int first_line, int last_line) {
+  if (search_cache_.empty()) return;
+  const std::string path = fileUriToPath(uri);
+  if (text && last_line >= 0 && (first_line > 0 || static_cast<std::size_t>(last_line) + 1 < text->lineCount())) {
+    // A keystroke: only its lines can have gained a match.
+    std::string lines;
+    for (int i = first_line; i <= last_line; ++i) lines.append(text->line(i)).push_back('\n');
+    search_cache_.invalidateFile(makeResultPathAbsolute(path), lines);
+    return;
+  }
+  if (text) {
+    // Searched chunk by chunk: copying the whole document on every keystroke is what the rope avoids.
+    search_cache_.invalidateFile(makeResultPathAbsolute(path), [text](std::string_view needle) { return text->contains(needle); });
+    return;
+  }
+  std::string contents;
+  if (!readWholeFile(path, contents)) contents.clear();
+  search_cache_.invalidateFile(makeResultPathAbsolute(path), contents);
+}
+
+void Server::startIndexing() {
+  if (!use_index_ || !serve_files_.empty() || index_) return;
+  if (root_path_.empty() && root_uri_.empty()) return;  // don't index the server's cwd
+  index_ = std::make_shared<TrigramIndex>(rootDir(), splitExtensionList(kSourceExtensions));
+  symbols_ = std::make_shared<SymbolIndex>(rootDir(), splitExtensionList(kSourceExtensions));
+
+  FileWatcher::Callbacks callbacks;
+  callbacks.on_events = [this, index = index_, symbols = symbols_](std::vector<FileEvent> events) {
+    std::vector<std::string> files, removed_dirs;
+    bool ignore_rules_changed = false;
+    for (auto& e : events) {
+      const std::string_view name = std::string_view(e.path).substr(e.path.rfind('/') + 1);
+      if (name == ".gitignore" || name == ".ignore") ignore_rules_changed = true;
+      // (Un)tracked files: the only .git/ path the watcher reports is the root's index.
+      if (gitIndexListing() && std::string_view(e.path).ends_with("/.git/index")) ignore_rules_changed = true;
+      if (e.is_dir && e.kind == FileEvent::Kind::kRemoved) {
+        removed_dirs.push_back(std::move(e.path));
+      } else {
+        files.push_back(std::move(e.path));
+      }
+    }
+    index->applyChanges(files, removed_dirs);
+    symbols->applyChanges(files, removed_dirs);
+    // Any file may have become (un)ignored: revalidate the whole indexes.
+    if (ignore_rules_changed && index->ready()) index->rescan(&stop_indexing_);
+    if (ignore_rules_changed && symbols->ready()) symbols->rescan(&stop_indexing_);
+    // Only once the trigram index has the changes: a search started before this reads the old
+    // generation, so whatever stale candidates it got never get cached.
+    // A few edited files are checked one by one; a branch switch just starts over.
+    constexpr std::size_t kMaxCheckedFiles = 64;
+    if (!removed_dirs.empty() || ignore_rules_changed || files.size() > kMaxCheckedFiles) {
+      search_cache_.invalidateAll();
+    } else if (!search_cache_.empty()) {
+      std::string contents;
+      for (const auto& f : files) {
+        if (!readWholeFile(f, contents)) contents.clear();
+        search_cache_.invalidateFile(makeResultPathAbsolute(f), contents);
+      }
+    }
+  };
+  callbacks.on_overflow = [this, index = index_, symbols = symbols_]() {
+    if (trace_) transport_.logLine("file watcher overflowed; rescanning workspace");
+    // Directories that can't be watched would keep serving stale cached searches.
+    if (!watcher_->complete()) cache_searches_.store(false, std::memory_order_release);
+    // An index still loading rescans once it is built (loadOrBuild() revalidates what it loaded).
+    if (index->ready()) index->rescan(&stop_indexing_);
+    if (symbols->ready()) symbols->rescan(&stop_indexing_);
+    search_cache_.invalidateAll();  // after the index caught up, as above
+  };
+  watcher_ = std::make_shared<FileWatcher>(rootDir(), std::move(callbacks));
+
+  indexing_thread_ = std::thread([this, index = index_, symbols = symbols_, watcher = watcher_]() {
+    // Start watching before the initial scans so changes made while they run aren't lost.
+    bool watching = watcher->start();
+    // Cached searches are only invalidated for what the watcher sees.
+    cache_searches_.store(watching && watcher->complete(), std::memory_order_release);
+    // Definitions don't wait for the trigram index (which may have to be built from scratch).
+    std::thread symbols_thread([this, symbols]() {
+      symbols->build(&stop_indexing_);
+      if (trace_ && symbols->ready()) {
+        transport_.logLine("definition index ready: " + std::to_string(symbols->symbolCount()) + " symbols in " +
+                           std::to_string(symbols->fileCount()) + " files, " +
+                           std::to_string(symbols->memoryBytes() >> 10) + " KiB");
+      }
+    });
+    index->loadOrBuild(&stop_indexing_);
+    if (index->ready()) {
+      bool saved = index->save();
+      if (trace_) {
+        transport_.logLine("trigram index ready: " + std::to_string(index->fileCount()) + " files" +
+                           (saved ? ", saved to " + index->cachePath() : ", not saved") +
+                           (watching ? ", watching " + std::to_string(watcher->watchCount()) + " dirs" +
+                                           (watcher->complete() ? "" : " (not all: search cache off)")
+                                     : ", inotify unavailable"));
+      }
+    }
+    symbols_thread.join();
+  });
+}
+
+std::vector<GrepMatch> Server::searchWorkspace(const std::string& needle,
+                                               int max_results,
+                                               std::atomic_bool* cancelled,
+                                               std::atomic<pid_t>* child_pid,
+                                               const SearchProgress* progress) {
+  const bool use_cache = !needle.empty() && cache_searches_.load(std::memory_order_acquire);
+  if (use_cache) {
+    if (auto hit = search_cache_.lookup(needle, max_results)) {
+      if (trace_) transport_.logLine("search cache hit: " + needle);
+      return std::move(*hit);
+    }
+  }
+  // The grep child belongs to the shared search, so cancelling one request doesn't kill it.
+  (void)child_pid;
+  return search_flights_.run(
+      needle, max_results, cancelled, progress,
+      [&](std::atomic_bool* flight_cancelled, std::atomic<pid_t>* flight_pid, const SearchProgress* flight_progress) {
+        const std::uint64_t generation = search_cache_.generation();
+        std::vector<GrepMatch> matches = searchFiles(needle, max_results, flight_cancelled, flight_pid, flight_progress);
+        if (use_cache && !flight_cancelled->load(std::memory_order_acquire)) {
+          search_cache_.insert(needle, max_results, generation, matches);
+        }
+        return matches;
+      });
+}
+
+std::vector<GrepMatch> Server::searchFiles(const std::string& needle,
+                                           int max_results,
+                                           std::atomic_bool* cancelled,
+                                           std::atomic<pid_t>* child_pid,
+                                           const SearchProgress* progress) {
+  // Unsaved edits win over the files on disk (and over what the trigram index saw there).
+  const SearchOverlay overlay = openBuffers();
+  if (!serve_files_.empty()) {
+    return grepFixedStringInFiles(serve_files_, needle, max_results, cancelled, child_pid, &overlay, progress);
+  }
+  if (index_) {
+    if (auto files = index_->candidates(needle, splitExtensionList(kSourceExtensions))) {
+      return grepFixedStringInFiles(*files, needle, max_results, cancelled, child_pid, &overlay, progress);
+    }
+  }
+  return grepFixedString(rootDir(), needle, max_results, std::string(kSourceExtensions), cancelled, child_pid,
+                         &overlay, progress);
+}
+
+SearchOverlay Server::openBuffers() const {
+  SearchOverlay overlay;
+  const std::string root = rootDir();
+  std::string root_abs = makeResultPathAbsolute(root);
+  if (root_abs.size() > 1 && root_abs.back() == '/') root_abs.pop_back();
+  static const std::vector<std::string> extensions = splitExtensionList(kSourceExtensions);
+
+  for (const auto& [uri, doc] : docs_.all()) {
+    if (!doc || uri.rfind("file://", 0) != 0) continue;
+    const std::string abs = makeResultPathAbsolute(fileUriToPath(uri));
+    if (!serve_files_.empty()) {
+      // --files: the listed paths are already absolute and normalized.
+      if (std::find(serve_files_.begin(), serve_files_.end(), abs) != serve_files_.end()) overlay[abs] = doc;
+      continue;
+    }
+    // Workspace: source files below the root, spelled like the walk and the index spell them.
+    if (abs.size() <= root_abs.size() + 1 || abs.compare(0, root_abs.size(), root_abs) != 0 ||
+        (root_abs != "/" && abs[root_abs.size()] != '/')) {
+      continue;
+    }
+    const std::string rel = abs.substr(root_abs == "/" ? 1 : root_abs.size() + 1);
+    if (!hasAllowedExtension(rel, extensions) || inExcludedDir(rel)) continue;
+    overlay[(root.empty() || root.back() == '/' ? root : root + "/") + rel] = doc;
+  }
+  return overlay;
+}
+
+std::vector<SymbolIndex::Symbol> Server::indexedDeclarations(const std::string& name) const {
+  if (!symbols_ || !symbols_->ready()) return {};
+  std::vector<SymbolIndex::Symbol> found = symbols_->lookup(name);
+  // Open buffers may differ from what was scanned on disk.
+  const SearchOverlay buffers = openBuffers();
+  found.erase(std::remove_if(found.begin(), found.end(), [&](const auto& s) { return buffers.count(s.path) > 0; }),
+              found.end());
+  for (const auto& [path, doc] : buffers) {
+    for (const auto& d : doc->declarations()) {
+      if (d.name == name) found.push_back(SymbolIndex::Symbol{path, d});
+    }
+  }
+  // Prototypes and forward declarations only count when nothing defines the name.
+  if (std::any_of(found.begin(), found.end(), [](const auto& s) { return s.decl.definition; })) {
+    found.erase(std::remove_if(found.begin(), found.end(), [](const auto& s) { return !s.decl.definition; }),
+                found.end());
+  }
+  return found;
+}
+
+std::optional<std::vector<SymbolIndex::ScoredSymbol>> Server::indexedSymbols(const std::string& query,
+                                                                           std::size_t limit) const {
+  if (!symbols_ || !symbols_->ready()) return std::nullopt;
+  // Open buffers may differ from what was scanned on disk.
+  const SearchOverlay buffers = openBuffers();
+  std::vector<SymbolIndex::ScoredSymbol> found =
+      symbols_->fuzzyFind(query, limit, [&](const std::string& path) { return buffers.count(path) > 0; });
+  if (buffers.empty()) return found;
+
+  FuzzyMatcher matcher(query);
+  const std::string& lower = matcher.lowerPattern();
+  for (const auto& [path, doc] : buffers) {
+    for (const auto& d : doc->declarations()) {
+      if (query.size() < SymbolIndex::kMinFuzzyQuery) {
+        if (d.name.size() < lower.size() ||
+            !std::equal(lower.begin(), lower.end(), d.name.begin(),
+                        [](char l, char c) { return l == std::tolower(static_cast<unsigned char>(c)); })) {
+          continue;
+        }
+      }
+      if (auto score = matcher.match(d.name)) {
+        found.push_back(SymbolIndex::ScoredSymbol{SymbolIndex::Symbol{path, d}, *score});
+      }
+    }
+  }
+  std::stable_sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+    if (a.score != b.score) return a.score > b.score;
+    return a.symbol.decl.name < b.symbol.decl.name;
+  });
+  if (found.size() > limit) found.resize(limit);
+  return found;
+}
+
+bool Server::isIndexedClass(const std::string& scope) const {
+  const std::size_t colons = scope.rfind("::");
+  const std::string outer = colons == std::string::npos ? std::string() : scope.substr(0, colons);
+  for (const auto& s : symbols_->lookup(colons == std::string::npos ? scope : scope.substr(colons + 2))) {
+    const DeclKind k = s.decl.kind;
+    if ((k == DeclKind::kClass || k == DeclKind::kStruct || k == DeclKind::kUnion) && s.decl.container == outer) return true;
+  }
+  return false;
+}
+
+std::string Server::lineText(const std::string& abs_path, int line0) const {
+  if (DocumentStore::Snapshot doc = docs_.get(pathToFileUri(abs_path))) return doc->text.line(line0);
+  std::string contents;
+  if (!readWholeFile(abs_path, contents)) return {};
+  std::size_t begin = 0;
+  for (int i = 0; i < line0; ++i) {
+    begin = contents.find('\n', begin);
+    if (begin == std::string::npos) return {};
+    ++begin;
+  }
+  std::size_t end = contents.find('\n', begin);
+  if (end == std::string::npos) end = contents.size();
+  if (end > begin && contents[end - 1] == '\r') --end;
+  return contents.substr(begin, end - begin);
+}
+
+void Server::traceSnapshot(const std::string& uri, const DocumentSnapshot& doc) {
+  if (!trace_) return;
+  transport_.logLine("answering from " + uri + " version " + std::to_string(doc.version));
 }
 
 std::string Server::rootDir() const {
@@ -570,113 +955,138 @@ std::string Server::makeResultPathAbsolute(const std::string& p) const {
   }
 }
 
-json Server::onWorkspaceSymbol(const json& params, std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid) {
+std::string Server::onWorkspaceSymbol(const json& params, std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid) {
   std::string query = getStringOr(params, "query");
-  std::vector<GrepMatch> matches;
-  if (!serve_files_.empty()) {
-    matches = grepFixedStringInFiles(serve_files_, query, 50, cancelled, child_pid);
-  } else {
-    matches = grepFixedString(rootDir(), query, 50, std::string("c,cc,cpp,cxx,h,hh,hpp,hxx"), cancelled, child_pid);
-  }
-
-  // Rank likely declarations/definitions/macros higher.
-  auto ranked =
-      rankAndFilterMatches(matches, query, /*current_abs_path=*/"", /*current_line1=*/0, /*prefer_abs_path=*/"",
-                           [this](const std::string& p) { return makeResultPathAbsolute(p); });
-
-  json arr = json::array();
-  for (const auto& r : ranked) {
-    const auto& m = r.m;
-    const std::string& abs = r.abs_path;
-    json loc;
-    loc["uri"] = pathToFileUri(abs);
-    loc["range"] = json{
-        {"start", json{{"line", m.line - 1}, {"character", m.column}}},
-        {"end", json{{"line", m.line - 1}, {"character", m.column + static_cast<int>(query.size())}}},
-    };
-
-    json si;
-    si["name"] = query;
-    si["kind"] = 13;  // Variable (arbitrary; we're grep-based)
-    si["location"] = loc;
-    si["containerName"] = abs;
-    arr.push_back(std::move(si));
+  auto write_symbols = [&](JsonWriter& w, const std::vector<GrepMatch>& matches) {
+    // Rank likely declarations/definitions/macros higher.
+    auto ranked =
+        rankAndFilterMatches(matches, query, /*current_abs_path=*/"", /*current_line1=*/0, /*prefer_abs_path=*/"",
+                             [this](const std::string& p) { return makeResultPathAbsolute(p); });
+    w.beginArray();
+    for (const auto& r : ranked) writeSymbolInformation(w, r, query);
+    w.endArray();
+    return ranked.size();
+  };
+  // The definition index matches declared names fuzzily; until it is ready, grep finds the text.
+  if (auto found = indexedSymbols(query, 50)) {
+    std::string out;
+    JsonWriter w(out);
+    w.beginArray();
+    for (const auto& s : *found) {
+      const Declaration& d = s.symbol.decl;
+      // The scanner can't tell a method defined out of line from its class in a header.
+      const bool member = d.member || (d.kind == DeclKind::kFunction && !d.container.empty() && isIndexedClass(d.container));
+      writeDeclarationSymbolInformation(w, makeResultPathAbsolute(s.symbol.path), d, member);
+    }
+    w.endArray();
+    return out;
   }
-  return arr;
+  RequestProgress progress(*this, params, "Searching workspace symbols", write_symbols);
+  std::vector<GrepMatch> matches = searchWorkspace(query, 50, cancelled, child_pid, progress.search());
+  if (progress.streamed()) return kEmptyArrayJson;
+
+  std::string out;
+  JsonWriter w(out);
+  write_symbols(w, matches);
+  return out;
 }
 
-json Server::onHover(const json& params, std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid) {
+std::string Server::onHover(const json& params, std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid) {
   auto td = params.value("textDocument", json::object());
   std::string uri = getStringOr(td, "uri");
-  if (uri.empty()) return nullResult();
+  if (uri.empty()) return kNullJson;
 
   auto pos = params.value("position", json::object());
   int line0 = getIntOr(pos, "line", 0);
   int ch0 = getIntOr(pos, "character", 0);
 
-  auto it = docs_by_uri_.find(uri);
-  if (it == docs_by_uri_.end()) return nullResult();
-  if (isInLineCommentAt(it->second.text, line0, ch0)) return nullResult();
-  std::string sym = wordAt(it->second.text, line0, ch0);
-  if (isStopWord(sym)) return nullResult();
+  DocumentStore::Snapshot doc = docs_.get(uri);
+  if (!doc) return kNullJson;
+  traceSnapshot(uri, *doc);
+  const std::string line = doc->text.line(line0);
+  const std::size_t col = utf16ToByteColumn(line, ch0);
+  if (isInLineCommentAt(line, col)) return kNullJson;
+  std::string sym = wordAt(line, col);
+  if (isStopWord(sym)) return kNullJson;
   std::string current_abs = makeResultPathAbsolute(fileUriToPath(uri));
   int current_line1 = line0 + 1;
 
-  std::vector<GrepMatch> matches;
-  if (!serve_files_.empty()) {
-    matches = grepFixedStringInFiles(serve_files_, sym, 20, cancelled, child_pid);
-  } else {
-    matches = grepFixedString(rootDir(), sym, 20, std::string("c,cc,cpp,cxx,h,hh,hpp,hxx"), cancelled, child_pid);
+  json hover;
+  hover["range"] = json{
+      {"start", json{{"line", line0}, {"character", ch0}}},
+      {"end", json{{"line", line0}, {"character", ch0}}},
+  };
+
+  // The definition index answers without searching; the search covers what it can't see yet.
+  if (auto decls = indexedDeclarations(sym); !decls.empty()) {
+    // Like the search, skip the declaration the cursor is on when there are others.
+    auto best = std::find_if(decls.begin(), decls.end(), [&](const auto& s) {
+      return s.decl.line != line0 || makeResultPathAbsolute(s.path) != current_abs;
+    });
+    if (best == decls.end()) best = decls.begin();
+    const std::string abs = makeResultPathAbsolute(best->path);
+    hover["contents"] = json{
+        {"kind", "markdown"},
+        {"value", std::string("**super-lazy-clangd** (index)\n\nFound `") + abs + ":" +
+                      std::to_string(best->decl.line + 1) + "`\n\n```cpp\n" + lineText(abs, best->decl.line) +
+                      "\n```"},
+    };
+    return hover.dump(-1, ' ', false, json::error_handler_t::replace);
   }
-  if (matches.empty()) return nullResult();
+
+  std::vector<GrepMatch> matches = searchWorkspace(sym, 20, cancelled, child_pid);
+  if (matches.empty()) return kNullJson;
 
   auto ranked = rankAndFilterMatches(matches, sym, current_abs, current_line1, /*prefer_abs_path=*/current_abs,
                                      [this](const std::string& p) { return makeResultPathAbsolute(p); });
-  if (ranked.empty()) return nullResult();
+  if (ranked.empty()) return kNullJson;
   const auto& best = ranked.front();
-  const auto& m = best.m;
-  const std::string& abs = best.abs_path;
-  json hover;
+  const auto& m = *best.m;
+  const std::string& abs = *best.abs_path;
   hover["contents"] = json{
       {"kind", "markdown"},
       {"value", std::string("**super-lazy-clangd** (grep)\n\nFound `") + abs + ":" + std::to_string(m.line) + "`\n\n```cpp\n" +
                     m.text + "\n```"},
   };
-  hover["range"] = json{
-      {"start", json{{"line", line0}, {"character", ch0}}},
-      {"end", json{{"line", line0}, {"character", ch0}}},
-  };
-  return hover;
+  return hover.dump(-1, ' ', false, json::error_handler_t::replace);
 }
 
-json Server::onDefinition(const json& params, std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid) {
+std::string Server::onDefinition(const json& params, std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid) {
   auto td = params.value("textDocument", json::object());
   std::string uri = getStringOr(td, "uri");
-  if (uri.empty()) return nullResult();
+  if (uri.empty()) return kNullJson;
 
   auto pos = params.value("position", json::object());
   int line0 = getIntOr(pos, "line", 0);
   int ch0 = getIntOr(pos, "character", 0);
 
-  auto it = docs_by_uri_.find(uri);
-  if (it == docs_by_uri_.end()) return nullResult();
-  if (isInLineCommentAt(it->second.text, line0, ch0)) return nullResult();
-  std::string sym = wordAt(it->second.text, line0, ch0);
-  if (isStopWord(sym)) return nullResult();
+  DocumentStore::Snapshot doc = docs_.get(uri);
+  if (!doc) return kNullJson;
+  traceSnapshot(uri, *doc);
+  const std::string line = doc->text.line(line0);
+  const std::size_t col = utf16ToByteColumn(line, ch0);
+  if (isInLineCommentAt(line, col)) return kNullJson;
+  std::string sym = wordAt(line, col);
+  if (isStopWord(sym)) return kNullJson;
   std::string current_abs = makeResultPathAbsolute(fileUriToPath(uri));
   int current_line1 = line0 + 1;
 
-  std::vector<GrepMatch> matches;
-  if (!serve_files_.empty()) {
-    matches = grepFixedStringInFiles(serve_files_, sym, 20, cancelled, child_pid);
-  } else {
-    matches = grepFixedString(rootDir(), sym, 20, std::string("c,cc,cpp,cxx,h,hh,hpp,hxx"), cancelled, child_pid);
+  // The definition index answers without searching; the search covers what it can't see yet.
+  if (auto decls = indexedDeclarations(sym); !decls.empty()) {
+    std::string out;
+    JsonWriter w(out);
+    w.beginArray();
+    for (const auto& s : decls) writeDeclarationLocation(w, makeResultPathAbsolute(s.path), s.decl);
+    w.endArray();
+    return out;
   }
-  if (matches.empty()) return nullResult();
+
+  std::vector<GrepMatch> matches = searchWorkspace(sym, 20, cancelled, child_pid);
+  if (matches.empty()) return kNullJson;
 
   auto ranked = rankAndFilterMatches(matches, sym, current_abs, current_line1, /*prefer_abs_path=*/current_abs,
                                      [this](const std::string& p) { return makeResultPathAbsolute(p); });
-  if (ranked.empty()) return nullResult();
+  if (ranked.empty()) return kNullJson;
 
   // If there's exactly one "strong" definition-like hit, return only it.
   // (VSCode will then jump directly instead of showing a chooser.)
@@ -690,83 +1100,73 @@ json Server::onDefinition(const json& params, std::atomic_bool* cancelled, std::
     }
   }
 
-  json locs = json::array();
+  std::string out;
+  JsonWriter w(out);
+  w.beginArray();
   if (strong == 1) {
-    const auto& r = ranked[strong_idx];
-    const auto& m = r.m;
-    const std::string& abs = r.abs_path;
-    json loc;
-    loc["uri"] = pathToFileUri(abs);
-    loc["range"] = json{
-        {"start", json{{"line", m.line - 1}, {"character", m.column}}},
-        {"end", json{{"line", m.line - 1}, {"character", m.column + static_cast<int>(sym.size())}}},
-    };
-    locs.push_back(std::move(loc));
-    return locs;
-  }
-
-  for (const auto& r : ranked) {
-    const auto& m = r.m;
-    const std::string& abs = r.abs_path;
-    json loc;
-    loc["uri"] = pathToFileUri(abs);
-    loc["range"] = json{
-        {"start", json{{"line", m.line - 1}, {"character", m.column}}},
-        {"end", json{{"line", m.line - 1}, {"character", m.column + static_cast<int>(sym.size())}}},
-    };
-    locs.push_back(std::move(loc));
+    writeLocation(w, *ranked[strong_idx].abs_path, *ranked[strong_idx].m, sym.size());
+  } else {
+    for (const auto& r : ranked) writeLocation(w, *r.abs_path, *r.m, sym.size());
   }
-  return locs;
+  w.endArray();
+  return out;
 }
 
-json Server::onReferences(const json& params, std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid) {
+std::string Server::onReferences(const json& params, std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid) {
   auto td = params.value("textDocument", json::object());
   std::string uri = getStringOr(td, "uri");
-  if (uri.empty()) return json::array();
+  if (uri.empty()) return kEmptyArrayJson;
 
   auto pos = params.value("position", json::object());
   int line0 = getIntOr(pos, "line", 0);
   int ch0 = getIntOr(pos, "character", 0);
 
-  auto it = docs_by_uri_.find(uri);
-  if (it == docs_by_uri_.end()) return json::array();
-  if (isInLineCommentAt(it->second.text, line0, ch0)) return json::array();
-  std::string sym = wordAt(it->second.text, line0, ch0);
-  if (isStopWord(sym)) return json::array();
+  DocumentStore::Snapshot doc = docs_.get(uri);
+  if (!doc) return kEmptyArrayJson;
+  traceSnapshot(uri, *doc);
+  const std::string line = doc->text.line(line0);
+  const std::size_t col = utf16ToByteColumn(line, ch0);
+  if (isInLineCommentAt(line, col)) return kEmptyArrayJson;
+  std::string sym = wordAt(line, col);
+  if (isStopWord(sym)) return kEmptyArrayJson;
   std::string current_abs = makeResultPathAbsolute(fileUriToPath(uri));
   int current_line1 = line0 + 1;
 
-  std::vector<GrepMatch> matches;
-  if (!serve_files_.empty()) {
-    matches = grepFixedStringInFiles(serve_files_, sym, 50, cancelled, child_pid);
-  } else {
-    matches = grepFixedString(rootDir(), sym, 50, std::string("c,cc,cpp,cxx,h,hh,hpp,hxx"), cancelled, child_pid);
-  }
+  auto write_locations = [&](JsonWriter& w, const std::vector<GrepMatch>& matches) {
+    auto ranked = rankAndFilterMatches(matches, sym, current_abs, current_line1, /*prefer_abs_path=*/current_abs,
+                                       [this](const std::string& p) { return makeResultPathAbsolute(p); });
+    w.beginArray();
+    for (const auto& r : ranked) writeLocation(w, *r.abs_path, *r.m, sym.size());
+    w.endArray();
+    return ranked.size();
+  };
+  RequestProgress progress(*this, params, "Finding references", write_locations);
+  std::vector<GrepMatch> matches = searchWorkspace(sym, 50, cancelled, child_pid, progress.search());
+  if (progress.streamed()) return kEmptyArrayJson;
 
-  auto ranked = rankAndFilterMatches(matches, sym, current_abs, current_line1, /*prefer_abs_path=*/current_abs,
-                                     [this](const std::string& p) { return makeResultPathAbsolute(p); });
-  json locs = json::array();
-  for (const auto& r : ranked) {
-    const auto& m = r.m;
-    const std::string& abs = r.abs_path;
-    json loc;
-    loc["uri"] = pathToFileUri(abs);
-    loc["range"] = json{
-        {"start", json{{"line", m.line - 1}, {"character", m.column}}},
-        {"end", json{{"line", m.line - 1}, {"character", m.column + static_cast<int>(sym.size())}}},
-    };
-    locs.push_back(std::move(loc));
-  }
-  return locs;
+  std::string out;
+  JsonWriter w(out);
+  write_locations(w, matches);
+  return out;
 }
 
 void Server::replyResult(const json& id, const json& result) {
-  json resp;
-  resp["jsonrpc"] = "2.0";
-  resp["id"] = id;
-  resp["result"] = result;
-  std::lock_guard<std::mutex> lg(send_mu_);
-  transport_.writeMessage(resp.dump());
+  replyEncodedResult(id, result.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+
+void Server::replyEncodedResult(const json& id, std::string_view result) {
+  std::string out;
+  out.reserve(result.size() + 64);
+  JsonWriter w(out);
+  w.beginObject();
+  w.key("jsonrpc");
+  w.value("2.0");
+  w.key("id");
+  w.raw(id.dump());
+  w.key("result");
+  w.raw(result);
+  w.endObject();
+  transport_.writeMessage(std::move(out));
 }
 
 void Server::replyError(const json& id, int code, const std::string& message) {
@@ -774,17 +1174,26 @@ void Server::replyError(const json& id, int code, const std::string& message) {
   resp["jsonrpc"] = "2.0";
   resp["id"] = id;
   resp["error"] = json{{"code", code}, {"message", message}};
-  std::lock_guard<std::mutex> lg(send_mu_);
   transport_.writeMessage(resp.dump());
 }
 
-void Server::sendNotification(const std::string& method, const json& params) {
-  json msg;
-  msg["jsonrpc"] = "2.0";
-  msg["method"] = method;
-  msg["params"] = params;
-  std::lock_guard<std::mutex> lg(send_mu_);
-  transport_.writeMessage(msg.dump());
+void Server::sendNotification(const std::string& method, const json& params, bool droppable) {
+  sendEncodedNotification(method, params.dump(-1, ' ', false, json::error_handler_t::replace), droppable);
+}
+
+void Server::sendEncodedNotification(const std::string& method, std::string_view params, bool droppable) {
+  std::string out;
+  out.reserve(params.size() + method.size() + 48);
+  JsonWriter w(out);
+  w.beginObject();
+  w.key("jsonrpc");
+  w.value("2.0");
+  w.key("method");
+  w.value(method);
+  w.key("params");
+  w.raw(params);
+  w.endObject();
+  transport_.writeMessage(std::move(out), droppable);
 }
 
 }  // namespace slclangd::lsp
@@ -3,57 +3,130 @@
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <sys/types.h>
+#include <thread>
 #include <vector>
 
+#include "document_store.h"
+#include "file_watcher.h"
+#include "grep_search.h"
+#include "lsp_message.h"
 #include "lsp_transport.h"
+#include "search_cache.h"
+#include "search_flights.h"
+#include "symbol_index.h"
+#include "thread_pool.h"
+#include "trigram_index.h"
 
 // Vendored single-header nlohmann::json
 #include "json.hpp"
 
 namespace slclangd::lsp {
 
+struct ServerOptions {
+  std::vector<std::string> serve_files;  // --files: restrict search to these files
+  bool use_index = true;                 // index the workspace root (trigrams, definitions)
+  std::size_t worker_threads = 0;        // -j: request worker pool size (0 = ThreadPool::defaultThreads())
+};
+
 class Server final {
  public:
-  explicit Server(Transport& transport, std::vector<std::string> serve_files = {});
+  explicit Server(Transport& transport, ServerOptions options = {});
+  ~Server();
 
   // Runs the main loop until exit.
   int run();
 
  private:
-  void handleMessage(const std::string& body);
-
-  void handleRequest(const std::string& method, const nlohmann::json& id, const nlohmann::json& params);
-  void handleNotification(const std::string& method, const nlohmann::json& params);
+  void handleMessage(std::string_view body);
+
+  void handleRequest(const std::string& method, const nlohmann::json& id, nlohmann::json params);
+  void handleNotification(Message& msg);
+
+  // Runs a potentially slow handler on the worker pool so the main loop keeps reading messages
+  // (and can process $/cancelRequest meanwhile). A non-empty `supersede_key` cancels the previous
+  // still-running request with the same key (e.g. an older hover on the same document).
+  // Handlers return the result already encoded as JSON text: big Location arrays are streamed
+  // with JsonWriter instead of going through a nlohmann::json tree.
+  using AsyncHandler = std::string (Server::*)(const nlohmann::json& params,
+                                               std::atomic_bool* cancelled,
+                                               std::atomic<pid_t>* child_pid);
+  void runAsync(const std::string& method, const nlohmann::json& id, nlohmann::json params,
+                AsyncHandler handler, ThreadPool::Priority priority, std::string supersede_key = {});
 
   nlohmann::json onInitialize(const nlohmann::json& params);
   void onInitialized(const nlohmann::json& params);
   nlohmann::json onShutdown();
   void onExit();
 
-  void onDidOpen(const nlohmann::json& params);
-  void onDidChange(const nlohmann::json& params);
+  // Take the message: the document text is moved out of it.
+  void onDidOpen(Message& msg);
+  void onDidChange(Message& msg);
   void onDidClose(const nlohmann::json& params);
 
-  nlohmann::json onWorkspaceSymbol(const nlohmann::json& params,
-                                   std::atomic_bool* cancelled,
-                                   std::atomic<pid_t>* child_pid);
-  nlohmann::json onHover(const nlohmann::json& params,
-                         std::atomic_bool* cancelled,
-                         std::atomic<pid_t>* child_pid);
-  nlohmann::json onDefinition(const nlohmann::json& params,
-                              std::atomic_bool* cancelled,
-                              std::atomic<pid_t>* child_pid);
-  nlohmann::json onReferences(const nlohmann::json& params,
-                              std::atomic_bool* cancelled,
-                              std::atomic<pid_t>* child_pid);
+  std::string onWorkspaceSymbol(const nlohmann::json& params,
+                                std::atomic_bool* cancelled,
+                                std::atomic<pid_t>* child_pid);
+  std::string onHover(const nlohmann::json& params,
+                      std::atomic_bool* cancelled,
+                      std::atomic<pid_t>* child_pid);
+  std::string onDefinition(const nlohmann::json& params,
+                           std::atomic_bool* cancelled,
+                           std::atomic<pid_t>* child_pid);
+  std::string onReferences(const nlohmann::json& params,
+                           std::atomic_bool* cancelled,
+                           std::atomic<pid_t>* child_pid);
 
   void replyResult(const nlohmann::json& id, const nlohmann::json& result);
+  void replyEncodedResult(const nlohmann::json& id, std::string_view result);
   void replyError(const nlohmann::json& id, int code, const std::string& message);
-  void sendNotification(const std::string& method, const nlohmann::json& params);
+  // A `droppable` notification may be shed when the client falls behind (see Transport).
+  void sendNotification(const std::string& method, const nlohmann::json& params, bool droppable = false);
+  void sendEncodedNotification(const std::string& method, std::string_view params, bool droppable = false);
+
+  // $/progress for one request that passed a workDoneToken and/or a partialResultToken.
+  class RequestProgress;
+
+  // Fixed-string search over the served files or the workspace (narrowed by the trigram index
+  // once it is ready), answered from search_cache_ or an identical running search when possible.
+  // `progress` only hears from searches that actually run: a cache hit returns at once.
+  std::vector<GrepMatch> searchWorkspace(const std::string& needle,
+                                         int max_results,
+                                         std::atomic_bool* cancelled,
+                                         std::atomic<pid_t>* child_pid,
+                                         const SearchProgress* progress = nullptr);
+  // The uncached search.
+  std::vector<GrepMatch> searchFiles(const std::string& needle,
+                                     int max_results,
+                                     std::atomic_bool* cancelled,
+                                     std::atomic<pid_t>* child_pid,
+                                     const SearchProgress* progress);
+  // The open documents within the search scope, keyed by the path the search reports for them.
+  SearchOverlay openBuffers() const;
+  // Declarations of `name` from the definition index, with open buffers re-scanned; only the
+  // definitions if there are any. Empty while the index isn't ready.
+  std::vector<SymbolIndex::Symbol> indexedDeclarations(const std::string& name) const;
+  // Up to `limit` declarations matching a workspace/symbol query (see SymbolIndex::fuzzyFind), with
+  // open buffers re-scanned; nullopt while the index isn't ready.
+  std::optional<std::vector<SymbolIndex::ScoredSymbol>> indexedSymbols(const std::string& query,
+                                                                       std::size_t limit) const;
+  // Whether `scope` ("a::B") is a class, struct or union in the definition index.
+  bool isIndexedClass(const std::string& scope) const;
+  // Line `line0` of the open document at `abs_path`, or else of the file on disk.
+  std::string lineText(const std::string& abs_path, int line0) const;
+  void startIndexing();
+  // Drops cached searches that `uri`'s new text (or, once closed, its file on disk) may change.
+  // Only lines [first_line, last_line] of `text` differ from the previous version (-1: to the end).
+  void invalidateCachedSearches(const std::string& uri, const Document* text, int first_line = 0, int last_line = -1);
+
+  // Trace-logs which document version a request is being answered from. Only logged: hover,
+  // definition and reference responses have no version field, so the client isn't told.
+  void traceSnapshot(const std::string& uri, const DocumentSnapshot& doc);
 
   std::string rootDir() const;
   std::string makeResultPathAbsolute(const std::string& p) const;
@@ -66,22 +139,40 @@ class Server final {
 
   struct InFlight {
     std::atomic_bool cancelled{false};
+    std::atomic_bool superseded{false};
     std::atomic<pid_t> grep_pid{-1};
+    std::string supersede_key;
   };
+  void cancelInFlight(InFlight& inflight);
+
   std::mutex inflight_mu_;
   std::unordered_map<std::string, std::shared_ptr<InFlight>> inflight_;
-  std::mutex send_mu_;
+  std::unordered_map<std::string, std::shared_ptr<InFlight>> latest_by_supersede_key_;
 
   std::string root_uri_;
   std::string root_path_;
   std::vector<std::string> serve_files_;
-
-  struct Doc {
-    std::string text;
-  };
-  std::unordered_map<std::string, Doc> docs_by_uri_;
+  bool use_index_ = true;
+  std::shared_ptr<TrigramIndex> index_;
+  std::shared_ptr<SymbolIndex> symbols_;  // answers textDocument/definition
+  std::shared_ptr<FileWatcher> watcher_;  // keeps index_ and symbols_ current with on-disk edits
+  // Builds the indexes and starts watcher_. ~Server() sets stop_indexing_, which also cuts short
+  // the watcher's rescans, then joins it and stops the watcher.
+  std::thread indexing_thread_;
+  std::atomic_bool stop_indexing_{false};
+
+  // Open documents. Handlers take one snapshot up front and compute the whole response from it.
+  DocumentStore docs_;
+
+  // Raw results of recent searches. Only used once the file watcher runs: without it on-disk
+  // edits would go unnoticed.
+  SearchCache search_cache_{[this](const std::string& p) { return makeResultPathAbsolute(p); }};
+  std::atomic_bool cache_searches_{false};
+  // Concurrent identical searches that missed the cache share one run.
+  SearchFlights search_flights_;
+
+  // Declared last: destroyed (and joined) first, while everything its tasks touch is still alive.
+  std::unique_ptr<ThreadPool> pool_;
 };
 
 }  // namespace slclangd::lsp
-
-
@@ -2,82 +2,207 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
 #include <iostream>
-#include <sstream>
+#include <climits>
 #include <string>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
 
 namespace slclangd::lsp {
 namespace {
 
-static inline std::string trim(std::string s) {
-  auto is_space = [](unsigned char c) { return std::isspace(c) != 0; };
-  s.erase(s.begin(), std::find_if(s.begin(), s.end(), [&](char c) { return !is_space(static_cast<unsigned char>(c)); }));
-  s.erase(std::find_if(s.rbegin(), s.rend(), [&](char c) { return !is_space(static_cast<unsigned char>(c)); }).base(),
-          s.end());
+// Grows to fit the largest message seen; a didOpen of a big file is a few MB.
+constexpr std::size_t kInitialBufferBytes = 64 * 1024;
+
+static std::string_view trim(std::string_view s) {
+  auto is_space = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+  while (!s.empty() && is_space(s.front())) s.remove_prefix(1);
+  while (!s.empty() && is_space(s.back())) s.remove_suffix(1);
   return s;
 }
 
 }  // namespace
 
-Transport::Transport(std::istream& in, std::ostream& out, std::ostream& log) : in_(in), out_(out), log_(log) {}
+Transport::Transport(int in_fd, int out_fd, std::ostream& log)
+    : in_fd_(in_fd), in_buf_(kInitialBufferBytes), out_fd_(out_fd), log_(log) {
+  writer_ = std::thread([this]() { writerLoop(); });
+}
 
-std::optional<std::string> Transport::readMessage() {
-  std::string line;
-  std::size_t content_length = 0;
-  bool saw_header = false;
+Transport::~Transport() {
+  out_stopping_.store(true, std::memory_order_release);
+  out_signal_.fetch_add(1, std::memory_order_release);
+  out_signal_.notify_one();
+  writer_.join();
+  // Anything pushed after the writer's final drain is dropped.
+  for (OutMessage* m = out_head_.exchange(nullptr); m;) delete std::exchange(m, m->next);
+}
 
+bool Transport::fill() {
+  if (in_end_ == in_buf_.size()) {
+    if (in_begin_ > 0) {
+      // The caller is done with everything before in_begin_ (the previous body included).
+      std::memmove(in_buf_.data(), in_buf_.data() + in_begin_, in_end_ - in_begin_);
+      in_end_ -= in_begin_;
+      in_begin_ = 0;
+    } else {
+      in_buf_.resize(in_buf_.size() * 2);
+    }
+  }
   while (true) {
-    if (!std::getline(in_, line)) {
-      // EOF
-      return std::nullopt;
+    ssize_t n = ::read(in_fd_, in_buf_.data() + in_end_, in_buf_.size() - in_end_);
+    if (n > 0) {
+      in_end_ += static_cast<std::size_t>(n);
+      return true;
     }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) logLine(std::string("read() failed: ") + std::strerror(errno));
+    return false;
+  }
+}
+
+std::optional<std::string_view> Transport::readMessage() {
+  if (in_begin_ == in_end_) in_begin_ = in_end_ = 0;
+
+  std::size_t content_length = 0;
+  bool saw_header = false;
+  // Offsets are relative to in_begin_, which fill() may move.
+  std::size_t scan = 0;
 
-    // getline strips '\n' but keeps a trailing '\r' if present.
-    if (!line.empty() && line.back() == '\r') {
-      line.pop_back();
+  while (true) {
+    const char* base = in_buf_.data() + in_begin_;
+    const std::size_t avail = in_end_ - in_begin_;
+    const void* nl = std::memchr(base + scan, '\n', avail - scan);
+    if (!nl) {
+      if (!fill()) {
+        // EOF
+        if (saw_header || avail > 0) logLine("Unexpected EOF in message header");
+        return std::nullopt;
+      }
+      continue;
     }
+    const std::size_t line_end = static_cast<std::size_t>(static_cast<const char*>(nl) - base);
+    std::string_view line(base + scan, line_end - scan);
+    scan = line_end + 1;
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
 
     if (line.empty()) {
       break;  // end of headers
     }
 
     saw_header = true;
-    constexpr const char* kCL = "Content-Length:";
-    if (line.rfind(kCL, 0) == 0) {
-      auto v = trim(line.substr(std::char_traits<char>::length(kCL)));
-      try {
-        content_length = static_cast<std::size_t>(std::stoul(v));
-      } catch (...) {
-        log_ << "Invalid Content-Length value: " << v << "\n";
+    constexpr std::string_view kCL = "Content-Length:";
+    if (line.substr(0, kCL.size()) == kCL) {
+      auto v = trim(line.substr(kCL.size()));
+      auto [ptr, ec] = std::from_chars(v.data(), v.data() + v.size(), content_length);
+      if (ec != std::errc() || ptr != v.data() + v.size()) {
+        logLine("Invalid Content-Length value: " + std::string(v));
         content_length = 0;
       }
     }
   }
 
-  if (!saw_header && in_.eof()) {
-    return std::nullopt;
-  }
   if (content_length == 0) {
     // Some clients may send empty notifications; treat as no-op.
-    return std::string{};
+    in_begin_ += scan;
+    return std::string_view{};
   }
 
-  std::string body(content_length, '\0');
-  in_.read(body.data(), static_cast<std::streamsize>(content_length));
-  if (static_cast<std::size_t>(in_.gcount()) != content_length) {
-    log_ << "Short read: expected " << content_length << " bytes, got " << in_.gcount() << "\n";
-    return std::nullopt;
+  // Make room for the whole body at once rather than doubling towards it.
+  const std::size_t needed = scan + content_length;
+  if (in_begin_ + needed > in_buf_.size()) {
+    std::memmove(in_buf_.data(), in_buf_.data() + in_begin_, in_end_ - in_begin_);
+    in_end_ -= in_begin_;
+    in_begin_ = 0;
+    if (needed > in_buf_.size()) in_buf_.resize(needed);
+  }
+  while (in_end_ - in_begin_ < needed) {
+    if (!fill()) {
+      logLine("Short read: expected " + std::to_string(content_length) + " bytes, got " +
+              std::to_string(in_end_ - in_begin_ - scan));
+      return std::nullopt;
+    }
   }
+  std::string_view body(in_buf_.data() + in_begin_ + scan, content_length);
+  in_begin_ += needed;
   return body;
 }
 
-void Transport::writeMessage(const std::string& json) {
-  out_ << "Content-Length: " << json.size() << "\r\n\r\n";
-  out_ << json;
-  out_.flush();
+bool Transport::writeMessage(std::string json, bool droppable) {
+  if (droppable && out_backlog_.load(std::memory_order_relaxed) > kDropBacklogBytes) return false;
+  auto* m = new OutMessage;
+  m->header = "Content-Length: " + std::to_string(json.size()) + "\r\n\r\n";
+  m->body = std::move(json);
+  out_backlog_.fetch_add(m->header.size() + m->body.size(), std::memory_order_relaxed);
+  m->next = out_head_.load(std::memory_order_relaxed);
+  while (!out_head_.compare_exchange_weak(m->next, m, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+  out_signal_.fetch_add(1, std::memory_order_release);
+  out_signal_.notify_one();
+  return true;
+}
+
+void Transport::writerLoop() {
+  while (true) {
+    // Read the signal before draining: a push after the drain bumps it, so wait() won't sleep.
+    std::uint32_t seen = out_signal_.load(std::memory_order_acquire);
+    OutMessage* stack = out_head_.exchange(nullptr, std::memory_order_acquire);
+    if (!stack) {
+      if (out_stopping_.load(std::memory_order_acquire)) return;
+      out_signal_.wait(seen, std::memory_order_acquire);
+      continue;
+    }
+    // Reverse into send order.
+    OutMessage* batch = nullptr;
+    while (stack) {
+      OutMessage* next = stack->next;
+      stack->next = batch;
+      batch = stack;
+      stack = next;
+    }
+    writeBatch(batch);
+  }
+}
+
+void Transport::writeBatch(OutMessage* batch) {
+  std::vector<iovec> iov;
+  std::size_t bytes = 0;
+  for (OutMessage* m = batch; m; m = m->next) {
+    iov.push_back({m->header.data(), m->header.size()});
+    iov.push_back({m->body.data(), m->body.size()});
+    bytes += m->header.size() + m->body.size();
+  }
+
+  std::size_t first = 0;
+  while (!out_broken_ && first < iov.size()) {
+    const int count = static_cast<int>(std::min<std::size_t>(iov.size() - first, IOV_MAX));
+    ssize_t n = ::writev(out_fd_, iov.data() + first, count);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      logLine(std::string("write() failed: ") + std::strerror(errno));
+      out_broken_ = true;  // drop this and everything after it
+      break;
+    }
+    // Skip what was written, resuming mid-buffer after a short write.
+    auto left = static_cast<std::size_t>(n);
+    while (first < iov.size() && left >= iov[first].iov_len) left -= iov[first++].iov_len;
+    if (left > 0) {
+      iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+      iov[first].iov_len -= left;
+    }
+  }
+
+  while (batch) delete std::exchange(batch, batch->next);
+  out_backlog_.fetch_sub(bytes, std::memory_order_relaxed);
 }
 
-void Transport::logLine(const std::string& s) { log_ << s << "\n"; }
+void Transport::logLine(const std::string& s) {
+  std::lock_guard<std::mutex> lg(log_mu_);
+  log_ << s << "\n";
+}
 
 }  // namespace slclangd::lsp
 
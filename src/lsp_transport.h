@@ -1,29 +1,76 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <iosfwd>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 namespace slclangd::lsp {
 
 // Minimal LSP/JSON-RPC transport: reads/writes "Content-Length:" framed messages over stdio.
+//
+// Input is read straight from the file descriptor into one reusable buffer; headers are parsed in
+// place and bodies are handed out as views into it, so a message costs no allocation or copy.
+//
+// Output goes through a dedicated writer thread: writeMessage() pushes onto a lock-free queue and
+// returns immediately, and the writer sends everything queued so far with one writev(). A slow
+// client therefore never blocks the threads producing replies.
 class Transport final {
  public:
-  Transport(std::istream& in, std::ostream& out, std::ostream& log);
+  Transport(int in_fd, int out_fd, std::ostream& log);
+  // Sends whatever is still queued, then stops the writer.
+  ~Transport();
 
-  // Returns nullopt on clean EOF.
-  std::optional<std::string> readMessage();
+  Transport(const Transport&) = delete;
+  Transport& operator=(const Transport&) = delete;
 
-  void writeMessage(const std::string& json);
+  // Returns nullopt on clean EOF. The view stays valid until the next call.
+  std::optional<std::string_view> readMessage();
 
+  // Thread-safe and non-blocking. A `droppable` message (a status notification nobody waits on)
+  // is discarded instead of queued while the client is more than kDropBacklogBytes behind;
+  // returns false in that case.
+  bool writeMessage(std::string json, bool droppable = false);
+
+  // Thread-safe: background tasks (e.g. indexing) log too.
   void logLine(const std::string& s);
 
  private:
-  std::istream& in_;
-  std::ostream& out_;
+  // Reads more input after the buffered bytes, compacting or growing the buffer as needed.
+  // Returns false on EOF or a read error.
+  bool fill();
+
+  struct OutMessage {
+    std::string header;
+    std::string body;
+    OutMessage* next = nullptr;
+  };
+  void writerLoop();
+  // Writes `batch` (oldest first) with as few writev() calls as possible; frees it.
+  void writeBatch(OutMessage* batch);
+
+  static constexpr std::size_t kDropBacklogBytes = 16 * 1024 * 1024;
+
+  int in_fd_;
+  std::vector<char> in_buf_;
+  std::size_t in_begin_ = 0;  // first unconsumed byte
+  std::size_t in_end_ = 0;    // end of the bytes read so far
+  int out_fd_;
   std::ostream& log_;
+  std::mutex log_mu_;
+
+  std::atomic<OutMessage*> out_head_{nullptr};  // newest first (Treiber stack)
+  std::atomic<std::uint32_t> out_signal_{0};    // bumped after each push; the writer waits on it
+  std::atomic<std::size_t> out_backlog_{0};     // bytes queued but not yet written
+  std::atomic_bool out_stopping_{false};
+  bool out_broken_ = false;  // writer thread only: the client went away
+  std::thread writer_;
 };
 
 }  // namespace slclangd::lsp
@@ -2,8 +2,11 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <unistd.h>
 #include <vector>
 
+#include "grep_search.h"
+#include "inproc_search.h"
 #include "lsp_server.h"
 #include "lsp_transport.h"
 
@@ -19,6 +22,20 @@ static void printHelp() {
                "  --log-file <path>\n"
                "            Write server logs/trace to this file (useful for VSCode debugging).\n"
                "            (If unset, also checks env var CLANGD_TRACE as a fallback.)\n"
+               "  -j,--jobs <n>\n"
+               "            Number of worker threads serving hover/definition/references/symbol\n"
+               "            requests (default: number of cores, at most 4).\n"
+               "  --no-index Don't index the workspace (the trigram index cached on disk and the\n"
+               "            in-memory definition index).\n"
+               "  --no-git-index\n"
+               "            Walk the workspace even if it is a git work tree, instead of listing\n"
+               "            its tracked files from .git/index (which leaves untracked files out).\n"
+               "  --search-backend <auto|grep|inproc>\n"
+               "            Search engine: fork GNU grep, or scan files in-process (default).\n"
+               "            (If unset, also checks env var SLCLANGD_SEARCH_BACKEND.)\n"
+               "  --search-threads <n>\n"
+               "            Threads walking and scanning the workspace, shared by all in-process searches\n"
+               "            (default: number of cores).\n"
                "  --version  Print version and exit.\n"
                "  -h,--help  Show help.\n";
 }
@@ -34,7 +51,7 @@ static std::string normalizePath(const std::string& p) {
 }  // namespace
 
 int main(int argc, char** argv) {
-  std::vector<std::string> serve_files;
+  slclangd::lsp::ServerOptions options;
   std::string log_file;
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
@@ -52,6 +69,47 @@ int main(int argc, char** argv) {
       }
       continue;
     }
+    if (arg == "-j" || arg == "--jobs") {
+      if (i + 1 < argc) {
+        try {
+          options.worker_threads = static_cast<std::size_t>(std::stoul(argv[++i]));
+        } catch (...) {
+          std::cerr << "invalid " << arg << " value: " << argv[i] << "\n";
+          return 2;
+        }
+      }
+      continue;
+    }
+    if (arg == "--no-index") {
+      options.use_index = false;
+      continue;
+    }
+    if (arg == "--no-git-index") {
+      slclangd::setGitIndexListing(false);
+      continue;
+    }
+    if (arg == "--search-backend") {
+      if (i + 1 < argc) {
+        auto backend = slclangd::parseSearchBackend(argv[++i]);
+        if (!backend) {
+          std::cerr << "unknown --search-backend: " << argv[i] << "\n";
+          return 2;
+        }
+        slclangd::setSearchBackend(*backend);
+      }
+      continue;
+    }
+    if (arg == "--search-threads") {
+      if (i + 1 < argc) {
+        try {
+          slclangd::setSearchThreads(static_cast<std::size_t>(std::stoul(argv[++i])));
+        } catch (...) {
+          std::cerr << "invalid " << arg << " value: " << argv[i] << "\n";
+          return 2;
+        }
+      }
+      continue;
+    }
     if (arg == "--files") {
       ++i;
       for (; i < argc; ++i) {
@@ -61,7 +119,7 @@ int main(int argc, char** argv) {
           --i;
           break;
         }
-        serve_files.push_back(normalizePath(f));
+        options.serve_files.push_back(normalizePath(f));
       }
       continue;
     }
@@ -81,8 +139,8 @@ int main(int argc, char** argv) {
     if (log_ofs.is_open()) log = &log_ofs;
   }
 
-  slclangd::lsp::Transport transport(std::cin, std::cout, *log);
-  slclangd::lsp::Server server(transport, std::move(serve_files));
+  slclangd::lsp::Transport transport(STDIN_FILENO, STDOUT_FILENO, *log);
+  slclangd::lsp::Server server(transport, std::move(options));
   return server.run();
 }
 
@@ -0,0 +1,103 @@
+#include "match_score.h"
+
+namespace slclangd {
+namespace {
+
+enum ByteClass : std::uint8_t {
+  kBlank = 1,       // ' ', '\t'
+  kSpace = 2,       // std::isspace() in the C locale
+  kWord = 4,        // identifier characters
+  kTypeSyntax = 8,  // what may sit between a return type and a function name: "*&:<>,("
+};
+
+constexpr std::array<std::uint8_t, 256> kByteClasses = [] {
+  std::array<std::uint8_t, 256> t{};
+  for (int c = 0; c < 256; ++c) {
+    if (c == ' ' || c == '\t') t[c] |= kBlank;
+    if (c == ' ' || (c >= '\t' && c <= '\r')) t[c] |= kSpace;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_') t[c] |= kWord;
+  }
+  for (char c : std::string_view("*&:<>,(")) t[static_cast<unsigned char>(c)] |= kTypeSyntax;
+  return t;
+}();
+
+static bool is(char c, ByteClass cls) { return (kByteClasses[static_cast<unsigned char>(c)] & cls) != 0; }
+
+// Return types that make "<type> needle(" a likely declaration or definition.
+constexpr std::string_view kPrimitiveTypeNames[] = {
+    "void", "bool", "char", "short", "int", "long", "float", "double",
+    "signed", "unsigned",
+    "wchar_t", "char8_t", "char16_t", "char32_t",
+    "size_t", "ssize_t",
+    "int8_t", "uint8_t", "int16_t", "uint16_t", "int32_t", "uint32_t", "int64_t", "uint64_t",
+    "intptr_t", "uintptr_t",
+    // Common kernel typedefs
+    "u8", "u16", "u32", "u64",
+    "s8", "s16", "s32", "s64",
+};
+constexpr auto kPrimitiveTypes = makeKeywordTable<128>(kPrimitiveTypeNames);
+
+// Where the macro name starts if `line` is a "#define", else npos.
+static std::size_t macroNameStart(std::string_view line) {
+  auto skip_spaces = [&](std::size_t i) {
+    while (i < line.size() && is(line[i], kSpace)) ++i;
+    return i;
+  };
+  std::size_t i = skip_spaces(0);
+  if (i >= line.size() || line[i] != '#') return std::string_view::npos;
+  i = skip_spaces(i + 1);
+  constexpr std::string_view kDefine = "define";
+  if (line.substr(i, kDefine.size()) != kDefine) return std::string_view::npos;
+  i += kDefine.size();
+  if (i < line.size() && !is(line[i], kSpace)) return std::string_view::npos;
+  i = skip_spaces(i);
+  return i < line.size() ? i : std::string_view::npos;
+}
+
+static int scoreMatchLine(std::string_view line, int col0, std::size_t needle_size) {
+  if (col0 < 0) return -100000;
+  const std::size_t col = std::min(static_cast<std::size_t>(col0), line.size());
+  int score = 0;
+
+  // Strong signal: macro definition (#define <needle> ...)
+  if (macroNameStart(line) == col) score += 100;
+
+  // Boundary before token indicates likely declaration/definition site.
+  if (col == 0 || is(line[col - 1], kBlank)) score += 25;
+
+  // Template-ish / qualified type-ish: previous non-space is '>' (e.g. vector<T> foo(...))
+  std::size_t before = col;
+  while (before > 0 && is(line[before - 1], kBlank)) --before;
+  if (before > 0 && line[before - 1] == '>') score += 20;
+
+  // Lookahead after token.
+  // - immediate ';' after token: very likely a declaration (e.g. "int foo;")
+  const std::size_t end = std::min(col + needle_size, line.size());
+  if (end < line.size() && line[end] == ';') score += 40;
+
+  // - next non-space is '(' : function-like (decl/def/call), still a good signal.
+  std::size_t after = end;
+  while (after < line.size() && is(line[after], kBlank)) ++after;
+  if (after < line.size() && line[after] == '(') {
+    score += 60;
+    // If it's preceded by a primitive return type, boost more.
+    // Heuristic examples: "int foo(", "void bar(", "unsigned long baz(", "u32 *qux(".
+    while (before > 0 && is(line[before - 1], kTypeSyntax)) --before;
+    while (before > 0 && is(line[before - 1], kBlank)) --before;
+    const std::size_t type_end = before;
+    while (before > 0 && is(line[before - 1], kWord)) --before;
+    if (kPrimitiveTypes.contains(line.substr(before, type_end - before))) score += 30;
+  }
+
+  return score;
+}
+
+}  // namespace
+
+std::vector<int> scoreMatchLines(const std::vector<GrepMatch>& matches, std::size_t needle_size) {
+  std::vector<int> scores(matches.size());
+  for (std::size_t i = 0; i < matches.size(); ++i) scores[i] = scoreMatchLine(matches[i].text, matches[i].column, needle_size);
+  return scores;
+}
+
+}  // namespace slclangd
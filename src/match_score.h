@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "grep_search.h"
+
+namespace slclangd {
+
+// How much each grep hit's line looks like the needle's declaration or definition rather than a
+// use of it (a "#define" of it, a call-like "(" after it, a primitive return type before it, ...):
+// higher is likelier. `needle_size` is the length of the needle found at each match's column.
+//
+// One pass over the lines with byte-class tables and no allocations, so ranking tens of thousands
+// of references costs little next to the search itself.
+std::vector<int> scoreMatchLines(const std::vector<GrepMatch>& matches, std::size_t needle_size);
+
+// A fixed set of ASCII keywords, matched case-insensitively. The hash is perfect for the set (its
+// seed is searched at compile time), so a lookup hashes the word once and compares it with at most
+// one keyword, without allocating. Build one with makeKeywordTable().
+template <std::size_t N, std::size_t Slots>
+class KeywordTable final {
+  static_assert(N < 255 && Slots >= N && (Slots & (Slots - 1)) == 0);
+
+ public:
+  constexpr explicit KeywordTable(const std::string_view (&words)[N]) {
+    for (std::size_t i = 0; i < N; ++i) {
+      words_[i] = words[i];
+      min_size_ = std::min(min_size_, words[i].size());
+      max_size_ = std::max(max_size_, words[i].size());
+    }
+    // Never ends (so doesn't compile) if no seed separates the words: make Slots larger.
+    while (!tryPlace(seed_)) ++seed_;
+  }
+
+  constexpr bool contains(std::string_view word) const {
+    if (word.size() < min_size_ || word.size() > max_size_) return false;
+    const std::uint8_t slot = slots_[hash(word, seed_) & (Slots - 1)];
+    if (slot == 0 || words_[slot - 1].size() != word.size()) return false;
+    for (std::size_t i = 0; i < word.size(); ++i) {
+      if (lower(word[i]) != words_[slot - 1][i]) return false;
+    }
+    return true;
+  }
+
+ private:
+  static constexpr char lower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+
+  static constexpr std::uint32_t hash(std::string_view s, std::uint32_t seed) {
+    std::uint32_t h = seed * 0x9e3779b9u ^ static_cast<std::uint32_t>(s.size());
+    for (char c : s) h = (h ^ static_cast<unsigned char>(lower(c))) * 16777619u;
+    return h ^ (h >> 16);
+  }
+
+  constexpr bool tryPlace(std::uint32_t seed) {
+    slots_.fill(0);
+    for (std::size_t i = 0; i < N; ++i) {
+      std::uint8_t& slot = slots_[hash(words_[i], seed) & (Slots - 1)];
+      if (slot != 0) return false;
+      slot = static_cast<std::uint8_t>(i + 1);
+    }
+    return true;
+  }
+
+  std::array<std::string_view, N> words_{};  // lowercase
+  std::array<std::uint8_t, Slots> slots_{};  // index into words_ + 1, or 0
+  std::uint32_t seed_ = 0;
+  std::size_t min_size_ = SIZE_MAX;
+  std::size_t max_size_ = 0;
+};
+
+template <std::size_t Slots, std::size_t N>
+constexpr KeywordTable<N, Slots> makeKeywordTable(const std::string_view (&words)[N]) {
+  return KeywordTable<N, Slots>(words);
+}
+
+}  // namespace slclangd
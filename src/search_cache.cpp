@@ -0,0 +1,97 @@
+#include "search_cache.h"
+
+#include "inproc_search.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace slclangd {
+
+SearchCache::SearchCache(PathFn normalize_path, std::size_t max_entries, std::size_t max_bytes)
+    : normalize_path_(std::move(normalize_path)), max_entries_(max_entries), max_bytes_(max_bytes) {}
+
+std::uint64_t SearchCache::generation() const {
+  std::lock_guard<std::mutex> lg(mu_);
+  return generation_;
+}
+
+bool SearchCache::empty() const {
+  std::lock_guard<std::mutex> lg(mu_);
+  return lru_.empty();
+}
+
+std::optional<std::vector<GrepMatch>> SearchCache::lookup(const std::string& needle, int max_results) {
+  std::lock_guard<std::mutex> lg(mu_);
+  auto it = by_needle_.find(needle);
+  if (it == by_needle_.end()) return std::nullopt;
+  const Entry& e = *it->second;
+  if (!e.complete && e.max_results < max_results) return std::nullopt;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  const std::size_t n = std::min(e.matches.size(), static_cast<std::size_t>(std::max(max_results, 0)));
+  return std::vector<GrepMatch>(e.matches.begin(), e.matches.begin() + static_cast<std::ptrdiff_t>(n));
+}
+
+void SearchCache::insert(const std::string& needle,
+                         int max_results,
+                         std::uint64_t generation,
+                         const std::vector<GrepMatch>& matches) {
+  Entry e;
+  e.needle = needle;
+  e.max_results = max_results;
+  e.complete = static_cast<int>(matches.size()) < max_results;
+  e.matches = matches;
+  e.bytes = sizeof(Entry) + needle.size();
+  for (const auto& m : matches) {
+    e.bytes += sizeof(GrepMatch) + m.path.size() + m.text.size();
+    e.files.push_back(normalize_path_(m.path));
+  }
+  std::sort(e.files.begin(), e.files.end());
+  e.files.erase(std::unique(e.files.begin(), e.files.end()), e.files.end());
+  for (const auto& f : e.files) e.bytes += f.size();
+  if (e.bytes > max_bytes_) return;
+
+  std::lock_guard<std::mutex> lg(mu_);
+  if (generation != generation_) return;  // something changed while it ran
+  if (auto it = by_needle_.find(needle); it != by_needle_.end()) {
+    const Entry& old = *it->second;
+    // Keep whichever answers more requests.
+    if (old.complete || old.max_results >= max_results) return;
+    eraseLocked(it->second);
+  }
+  bytes_ += e.bytes;
+  lru_.push_front(std::move(e));
+  by_needle_.emplace(needle, lru_.begin());
+  while (lru_.size() > max_entries_ || bytes_ > max_bytes_) eraseLocked(std::prev(lru_.end()));
+}
+
+void SearchCache::invalidateFile(const std::string& path, std::string_view contents) {
+  invalidateFile(path, [&](std::string_view needle) { return findFixedString(contents, needle) != std::string_view::npos; });
+}
+
+void SearchCache::invalidateFile(const std::string& path, const ContainsFn& contains) {
+  std::lock_guard<std::mutex> lg(mu_);
+  ++generation_;
+  for (auto it = lru_.begin(); it != lru_.end();) {
+    auto next = std::next(it);
+    if (std::binary_search(it->files.begin(), it->files.end(), path) || contains(it->needle)) {
+      eraseLocked(it);
+    }
+    it = next;
+  }
+}
+
+void SearchCache::invalidateAll() {
+  std::lock_guard<std::mutex> lg(mu_);
+  ++generation_;
+  lru_.clear();
+  by_needle_.clear();
+  bytes_ = 0;
+}
+
+void SearchCache::eraseLocked(Lru::iterator it) {
+  bytes_ -= it->bytes;
+  by_needle_.erase(it->needle);
+  lru_.erase(it);
+}
+
+}  // namespace slclangd
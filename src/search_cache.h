@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "grep_search.h"
+
+namespace slclangd {
+
+// LRU cache of raw search results (before any ranking), keyed by needle, so hover, definition and
+// references on the same identifier search the workspace once.
+//
+// Entries are tied to a corpus generation: every invalidation bumps it, and a search only gets
+// cached if nothing was invalidated since it started (see generation()/insert()). A result
+// computed with a larger max_results (or one that found fewer than its limit, i.e. everything)
+// also answers smaller requests.
+class SearchCache final {
+ public:
+  // Maps GrepMatch::path to the form invalidateFile() is called with (e.g. absolute).
+  using PathFn = std::function<std::string(const std::string& path)>;
+
+  static constexpr std::size_t kDefaultEntries = 256;
+  static constexpr std::size_t kDefaultBytes = 16 * 1024 * 1024;
+
+  explicit SearchCache(PathFn normalize_path,
+                       std::size_t max_entries = kDefaultEntries,
+                       std::size_t max_bytes = kDefaultBytes);
+
+  SearchCache(const SearchCache&) = delete;
+  SearchCache& operator=(const SearchCache&) = delete;
+
+  // Read this before starting a search and pass it to insert().
+  std::uint64_t generation() const;
+
+  // The first `max_results` matches for `needle`, if a cached search covers them.
+  std::optional<std::vector<GrepMatch>> lookup(const std::string& needle, int max_results);
+
+  // Caches the result of a search for `needle` limited to `max_results` that started at
+  // `generation`. Dropped if the cache was invalidated in between.
+  void insert(const std::string& needle, int max_results, std::uint64_t generation, const std::vector<GrepMatch>& matches);
+
+  // Whether the new contents of a file contain `needle`.
+  using ContainsFn = std::function<bool(std::string_view needle)>;
+
+  // `path` changed and `contents` is its new text, or just the lines of it that changed (empty if
+  // it is gone): drops the entries that had a match in it or whose needle occurs in `contents`.
+  // Everything else stays valid: a match depends on its line alone.
+  void invalidateFile(const std::string& path, std::string_view contents);
+  // Same, for contents that aren't in one piece (e.g. a Document).
+  void invalidateFile(const std::string& path, const ContainsFn& contains);
+  void invalidateAll();
+
+  bool empty() const;
+
+ private:
+  struct Entry {
+    std::string needle;
+    int max_results = 0;
+    bool complete = false;           // fewer matches than max_results: every match there is
+    std::vector<GrepMatch> matches;
+    std::vector<std::string> files;  // normalized paths of `matches`, sorted and unique
+    std::size_t bytes = 0;
+  };
+  using Lru = std::list<Entry>;  // most recently used first
+
+  void eraseLocked(Lru::iterator it);
+
+  const PathFn normalize_path_;
+  const std::size_t max_entries_;
+  const std::size_t max_bytes_;
+
+  mutable std::mutex mu_;
+  std::uint64_t generation_ = 0;
+  Lru lru_;
+  std::unordered_map<std::string, Lru::iterator> by_needle_;
+  std::size_t bytes_ = 0;
+};
+
+}  // namespace slclangd
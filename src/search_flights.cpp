@@ -0,0 +1,119 @@
+#include "search_flights.h"
+
+#include <algorithm>
+#include <csignal>
+#include <utility>
+
+namespace slclangd {
+namespace {
+
+static bool isSet(const std::atomic_bool* flag) { return flag && flag->load(std::memory_order_acquire); }
+
+static std::vector<GrepMatch> firstN(const std::vector<GrepMatch>& matches, int n) {
+  const std::size_t count = std::min(matches.size(), static_cast<std::size_t>(std::max(n, 0)));
+  return std::vector<GrepMatch>(matches.begin(), matches.begin() + static_cast<std::ptrdiff_t>(count));
+}
+
+}  // namespace
+
+std::vector<GrepMatch> SearchFlights::run(const std::string& needle,
+                                          int max_results,
+                                          std::atomic_bool* cancelled,
+                                          const SearchProgress* progress,
+                                          const SearchFn& search) {
+  std::shared_ptr<Flight> flight;
+  bool leader = false;
+  {
+    std::lock_guard<std::mutex> lg(mu_);
+    if (isSet(cancelled)) return {};
+    auto [begin, end] = running_.equal_range(needle);
+    for (auto it = begin; it != end; ++it) {
+      if (it->second->max_results >= max_results && !it->second->cancelled.load(std::memory_order_relaxed)) {
+        flight = it->second;
+        break;
+      }
+    }
+    if (!flight) {
+      flight = std::make_shared<Flight>();
+      flight->max_results = max_results;
+      running_.emplace(needle, flight);
+      leader = true;
+    }
+    flight->callers.push_back(Caller{cancelled, progress, max_results});
+    Caller& self = flight->callers.back();
+    if (progress && progress->on_files && flight->scanned > 0) progress->on_files(flight->scanned, flight->total);
+    sendMatchesLocked(*flight, self);
+  }
+
+  if (leader) {
+    // Relays the search's progress to whoever is attached at the time.
+    SearchProgress relay;
+    relay.on_matches = [this, flight](const std::vector<GrepMatch>& batch) {
+      std::lock_guard<std::mutex> lg(mu_);
+      flight->found.insert(flight->found.end(), batch.begin(), batch.end());
+      for (auto& caller : flight->callers) sendMatchesLocked(*flight, caller);
+    };
+    relay.on_files = [this, flight](std::size_t scanned, std::size_t total) {
+      std::lock_guard<std::mutex> lg(mu_);
+      flight->scanned = scanned;
+      flight->total = total;
+      for (auto& caller : flight->callers) {
+        if (caller.progress && caller.progress->on_files) caller.progress->on_files(scanned, total);
+      }
+    };
+    // Runs to completion for the other callers even if this one is cancelled meanwhile.
+    std::vector<GrepMatch> result = search(&flight->cancelled, &flight->child_pid, &relay);
+    std::lock_guard<std::mutex> lg(mu_);
+    auto [begin, end] = running_.equal_range(needle);
+    for (auto it = begin; it != end; ++it) {
+      if (it->second == flight) {
+        running_.erase(it);
+        break;
+      }
+    }
+    flight->result = std::move(result);
+    flight->done = true;
+    detachLocked(*flight, cancelled);
+    cv_.notify_all();
+    return firstN(flight->result, max_results);
+  }
+
+  std::unique_lock<std::mutex> lk(mu_);
+  cv_.wait(lk, [&]() { return flight->done || isSet(cancelled); });
+  if (!flight->done) {
+    // Cancelled. Detach now (cancel() may not have run yet): the relay must not call `progress`
+    // once we've returned.
+    detachLocked(*flight, cancelled);
+    return {};
+  }
+  return firstN(flight->result, max_results);
+}
+
+void SearchFlights::cancel(std::atomic_bool* cancelled) {
+  std::lock_guard<std::mutex> lg(mu_);
+  for (auto& [needle, flight] : running_) detachLocked(*flight, cancelled);
+  cv_.notify_all();
+}
+
+void SearchFlights::detachLocked(Flight& flight, std::atomic_bool* cancelled) {
+  auto it = std::find_if(flight.callers.begin(), flight.callers.end(),
+                         [&](const Caller& c) { return c.cancelled == cancelled; });
+  if (it == flight.callers.end()) return;
+  flight.callers.erase(it);
+  if (!flight.callers.empty() || flight.done) return;
+  flight.cancelled.store(true, std::memory_order_release);
+  pid_t pid = flight.child_pid.load(std::memory_order_acquire);
+  if (pid > 0) (void)kill(pid, SIGTERM);
+}
+
+void SearchFlights::sendMatchesLocked(const Flight& flight, Caller& caller) {
+  if (!caller.progress || !caller.progress->on_matches) return;
+  const std::size_t limit = std::min(flight.found.size(), static_cast<std::size_t>(std::max(caller.max_results, 0)));
+  if (caller.sent >= limit) return;
+  const std::vector<GrepMatch> batch(flight.found.begin() + static_cast<std::ptrdiff_t>(caller.sent),
+                                     flight.found.begin() + static_cast<std::ptrdiff_t>(limit));
+  caller.sent = limit;
+  caller.progress->on_matches(batch);
+}
+
+}  // namespace slclangd
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+#include "grep_search.h"
+
+namespace slclangd {
+
+// Single-flight layer in front of a search backend: concurrent searches for the same needle (over
+// the same scope: use one instance per scope) run once and share the result.
+//
+// The first caller runs the search itself, under a cancellation flag and child pid owned by the
+// flight rather than by any one request. Later callers whose limit the running search covers wait
+// for it. A cancelled caller (see cancel()) stops waiting right away, but the shared search keeps
+// going until every caller attached to it has been cancelled. Progress reported by the search is
+// passed on to every attached caller; one that joins late first gets the matches found so far.
+class SearchFlights final {
+ public:
+  using SearchFn = std::function<std::vector<GrepMatch>(
+      std::atomic_bool* cancelled, std::atomic<pid_t>* child_pid, const SearchProgress* progress)>;
+
+  SearchFlights() = default;
+  SearchFlights(const SearchFlights&) = delete;
+  SearchFlights& operator=(const SearchFlights&) = delete;
+
+  // Returns at most `max_results` matches for `needle`, running `search` unless an identical
+  // search with at least that limit is already running. `cancelled` (may be null) is the caller's
+  // own flag; returns early, with nothing, once it is set and cancel() was called for it.
+  // `progress` (may be null) gets this caller's share of the progress until it returns.
+  std::vector<GrepMatch> run(const std::string& needle,
+                             int max_results,
+                             std::atomic_bool* cancelled,
+                             const SearchProgress* progress,
+                             const SearchFn& search);
+
+  // Call after setting a caller's `cancelled` flag: detaches it from its search, which is
+  // cancelled (and its grep child killed) once no caller is left.
+  void cancel(std::atomic_bool* cancelled);
+
+ private:
+  struct Caller {
+    std::atomic_bool* cancelled = nullptr;
+    const SearchProgress* progress = nullptr;
+    int max_results = 0;
+    std::size_t sent = 0;  // matches passed to progress->on_matches
+  };
+  struct Flight {
+    int max_results = 0;
+    std::atomic_bool cancelled{false};
+    std::atomic<pid_t> child_pid{-1};
+    std::vector<Caller> callers;  // attached, not cancelled yet
+    std::vector<GrepMatch> found;  // streamed by the search so far
+    std::size_t scanned = 0;
+    std::size_t total = 0;
+    bool done = false;
+    std::vector<GrepMatch> result;
+  };
+
+  void detachLocked(Flight& flight, std::atomic_bool* cancelled);
+  // Passes caller.progress the found matches it hasn't seen yet, up to its limit.
+  static void sendMatchesLocked(const Flight& flight, Caller& caller);
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::unordered_multimap<std::string, std::shared_ptr<Flight>> running_;
+};
+
+}  // namespace slclangd
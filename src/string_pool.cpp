@@ -0,0 +1,54 @@
+#include "string_pool.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace slclangd {
+namespace {
+
+static std::size_t hashOf(std::string_view s) { return std::hash<std::string_view>{}(s); }
+
+}  // namespace
+
+std::uint32_t StringPool::find(std::string_view s) const {
+  if (slots_.empty()) return kNotFound;
+  const std::size_t mask = slots_.size() - 1;
+  for (std::size_t i = hashOf(s) & mask;; i = (i + 1) & mask) {
+    const std::uint32_t slot = slots_[i];
+    if (slot == 0) return kNotFound;
+    if (view(slot - 1) == s) return slot - 1;
+  }
+}
+
+std::uint32_t StringPool::intern(std::string_view s) {
+  // At most half full, so probe sequences stay short.
+  if ((size() + 1) * 2 > slots_.size()) rehash(std::max<std::size_t>(64, slots_.size() * 2));
+  const std::size_t mask = slots_.size() - 1;
+  for (std::size_t i = hashOf(s) & mask;; i = (i + 1) & mask) {
+    const std::uint32_t slot = slots_[i];
+    if (slot == 0) {
+      const auto id = static_cast<std::uint32_t>(size());
+      arena_.append(s);
+      starts_.push_back(static_cast<std::uint32_t>(arena_.size()));
+      slots_[i] = id + 1;
+      return id;
+    }
+    if (view(slot - 1) == s) return slot - 1;
+  }
+}
+
+void StringPool::rehash(std::size_t slots) {
+  slots_.assign(slots, 0);
+  const std::size_t mask = slots - 1;
+  for (std::uint32_t id = 0; id < size(); ++id) {
+    std::size_t i = hashOf(view(id)) & mask;
+    while (slots_[i] != 0) i = (i + 1) & mask;
+    slots_[i] = id + 1;
+  }
+}
+
+std::size_t StringPool::bytes() const {
+  return arena_.capacity() + starts_.capacity() * sizeof(std::uint32_t) + slots_.capacity() * sizeof(std::uint32_t);
+}
+
+}  // namespace slclangd
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace slclangd {
+
+// Interns strings: each distinct string is stored once, back to back in one arena, and named by a
+// dense 32-bit id (0, 1, 2, ... in insertion order). The lookup table is open-addressed over the
+// ids, so the pool costs the bytes themselves plus about 12 bytes per string. Not thread-safe.
+class StringPool final {
+ public:
+  static constexpr std::uint32_t kNotFound = UINT32_MAX;
+
+  std::uint32_t intern(std::string_view s);
+  // The id of `s`, or kNotFound (doesn't add it).
+  std::uint32_t find(std::string_view s) const;
+
+  // Valid until the next intern().
+  std::string_view view(std::uint32_t id) const {
+    return std::string_view(arena_.data() + starts_[id], starts_[id + 1] - starts_[id]);
+  }
+
+  std::size_t size() const { return starts_.size() - 1; }
+  // Heap bytes held, for statistics.
+  std::size_t bytes() const;
+
+ private:
+  void rehash(std::size_t slots);
+
+  std::string arena_;
+  std::vector<std::uint32_t> starts_{0};  // string i is arena_[starts_[i], starts_[i + 1])
+  std::vector<std::uint32_t> slots_;      // id + 1, or 0 if empty; the size is a power of two
+};
+
+}  // namespace slclangd
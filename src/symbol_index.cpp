@@ -0,0 +1,576 @@
+#include "symbol_index.h"
+
+#include "fuzzy_match.h"
+#include "ignore_rules.h"
+#include "inproc_search.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+namespace slclangd {
+namespace {
+
+static std::int64_t mtimeNs(const struct stat& st) {
+  return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+// Files a rescan worker scans before interning them into the state.
+constexpr std::size_t kCommitBatch = 256;
+
+// Recent queries whose candidates fuzzyFind() keeps for the next keystrokes.
+constexpr std::size_t kRecentQueries = 8;
+// Candidates scored per result wanted, at most (clangd's index retrieves as many).
+constexpr std::size_t kScoredPerResult = 100;
+
+static std::uint64_t pairKey(std::uint32_t a, std::uint32_t b) { return (static_cast<std::uint64_t>(a) << 32) | b; }
+
+static void appendLower(std::string& out, std::string_view s) {
+  for (char c : s) out.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+}
+
+// Whether `word` contains `pattern`'s characters in order.
+static bool isSubsequence(std::string_view pattern, std::string_view word) {
+  const char* p = word.data();
+  const char* end = p + word.size();
+  for (char c : pattern) {
+    const void* hit = std::memchr(p, c, static_cast<std::size_t>(end - p));
+    if (!hit) return false;
+    p = static_cast<const char*>(hit) + 1;
+  }
+  return true;
+}
+
+}  // namespace
+
+SymbolIndex::SymbolIndex(std::string root, std::vector<std::string> extensions, std::size_t threads)
+    : root_(std::move(root)),
+      extensions_(std::move(extensions)),
+      threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+std::string SymbolIndex::rootPrefix() const {
+  if (!root_.empty() && root_.back() == '/') return root_;
+  return root_ + "/";
+}
+
+std::string SymbolIndex::absPath(const std::string& rel) const {
+  if (!root_.empty() && root_.back() == '/') return root_ + rel;
+  return root_ + "/" + rel;
+}
+
+std::uint32_t SymbolIndex::findFile(const State& st, std::string_view rel) {
+  std::uint32_t dir = 0;
+  std::size_t pos = 0;
+  for (std::size_t slash = rel.find('/'); slash != std::string_view::npos; slash = rel.find('/', pos)) {
+    const std::uint32_t name = st.strings.find(rel.substr(pos, slash - pos));
+    if (name == StringPool::kNotFound) return kNone;
+    auto it = st.dir_ids.find(pairKey(dir, name));
+    if (it == st.dir_ids.end()) return kNone;
+    dir = it->second;
+    pos = slash + 1;
+  }
+  const std::uint32_t base = st.strings.find(rel.substr(pos));
+  if (base == StringPool::kNotFound) return kNone;
+  auto it = st.file_ids.find(pairKey(dir, base));
+  return it == st.file_ids.end() ? kNone : it->second;
+}
+
+std::string SymbolIndex::relPath(const State& st, std::uint32_t file) {
+  const FileEntry& f = st.files[file];
+  std::vector<std::string_view> parts{st.strings.view(f.base)};
+  for (std::uint32_t d = f.dir; d != 0; d = st.dirs[d].parent) parts.push_back(st.strings.view(st.dirs[d].name));
+  std::string rel;
+  for (auto it = parts.rbegin(); it != parts.rend(); ++it) {
+    if (!rel.empty()) rel.push_back('/');
+    rel.append(*it);
+  }
+  return rel;
+}
+
+Declaration SymbolIndex::declarationOf(const State& st, const Entry& e) {
+  Declaration d;
+  d.name = std::string(st.names.view(e.name));
+  d.container = std::string(st.strings.view(e.container));
+  d.kind = e.kind;
+  d.definition = e.definition;
+  d.member = e.member;
+  d.line = static_cast<int>(e.line);
+  d.column = static_cast<int>(e.column);
+  d.length = e.length;
+  return d;
+}
+
+void SymbolIndex::addFile(State& st, const Scanned& scanned) {
+  static_assert(sizeof(Entry) == 28, "declaration records should stay compact");
+  const auto id = static_cast<std::uint32_t>(st.files.size());
+  const std::string_view rel = scanned.rel;
+  FileEntry f;
+  std::size_t pos = 0;
+  for (std::size_t slash = rel.find('/'); slash != std::string_view::npos; slash = rel.find('/', pos)) {
+    const std::uint32_t name = st.strings.intern(rel.substr(pos, slash - pos));
+    auto [it, inserted] = st.dir_ids.try_emplace(pairKey(f.dir, name), static_cast<std::uint32_t>(st.dirs.size()));
+    if (inserted) st.dirs.push_back(Dir{f.dir, name});
+    f.dir = it->second;
+    pos = slash + 1;
+  }
+  f.base = st.strings.intern(rel.substr(pos));
+  f.size = scanned.size;
+  f.mtime_ns = scanned.mtime_ns;
+  f.first = static_cast<std::uint32_t>(st.entries.size());
+  f.count = static_cast<std::uint32_t>(scanned.decls.size());
+
+  for (const Declaration& d : scanned.decls) {
+    Entry e;
+    e.name = st.names.intern(d.name);
+    if (e.name >= st.heads.size()) {
+      st.heads.resize(e.name + 1, kNone);
+      st.live.resize(e.name + 1, 0);
+    }
+    ++st.live[e.name];
+    e.container = st.strings.intern(d.container);
+    e.file = id;
+    e.next = st.heads[e.name];
+    e.line = static_cast<std::uint32_t>(std::max(d.line, 0));
+    e.column = static_cast<std::uint32_t>(std::max(d.column, 0));
+    e.length = static_cast<std::uint16_t>(std::clamp(d.length, 0, 0xFFFF));
+    e.kind = d.kind;
+    e.definition = d.definition;
+    e.member = d.member;
+    st.heads[e.name] = static_cast<std::uint32_t>(st.entries.size());
+    st.entries.push_back(e);
+  }
+  st.symbols += f.count;
+  st.file_ids[pairKey(f.dir, f.base)] = id;
+  st.files.push_back(f);
+}
+
+void SymbolIndex::removeFile(State& st, std::uint32_t id) {
+  auto& f = st.files[id];
+  if (!f.alive) return;
+  f.alive = false;
+  ++st.dead;
+  st.symbols -= f.count;
+  for (std::uint32_t i = f.first; i < f.first + f.count; ++i) --st.live[st.entries[i].name];
+  // Its entries stay in the arena (and the name chains) until compact(); lookup() skips them.
+  auto it = st.file_ids.find(pairKey(f.dir, f.base));
+  if (it != st.file_ids.end() && it->second == id) st.file_ids.erase(it);
+}
+
+void SymbolIndex::compact(State& st) {
+  // Rebuilt from scratch, so the arena and the string pools drop what only dead files used.
+  State fresh;
+  fresh.generation = st.generation + 1;
+  Scanned scanned;
+  for (std::uint32_t id = 0; id < st.files.size(); ++id) {
+    const FileEntry& f = st.files[id];
+    if (!f.alive) continue;
+    scanned.rel = relPath(st, id);
+    scanned.size = f.size;
+    scanned.mtime_ns = f.mtime_ns;
+    scanned.decls.clear();
+    for (std::uint32_t i = f.first; i < f.first + f.count; ++i) scanned.decls.push_back(declarationOf(st, st.entries[i]));
+    addFile(fresh, scanned);
+  }
+  st = std::move(fresh);
+}
+
+void SymbolIndex::build(std::atomic_bool* cancelled) {
+  rescan(cancelled);
+  if (cancelled && cancelled->load(std::memory_order_acquire)) return;
+
+  // Replay changes reported (by the file watcher) while we were still scanning.
+  std::vector<std::string> files, dirs;
+  {
+    std::lock_guard<std::mutex> lg(pending_mu_);
+    ready_.store(true, std::memory_order_release);
+    files.swap(pending_files_);
+    dirs.swap(pending_dirs_);
+  }
+  if (!files.empty() || !dirs.empty()) applyUpdates(files, dirs);
+}
+
+void SymbolIndex::rescan(std::atomic_bool* cancelled) {
+  const std::string prefix = rootPrefix();
+  std::size_t known = 0;
+  {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    known = state_.files.size();
+  }
+
+  // Each worker reads and scans the files it is handed, and commits them every few hundred.
+  struct PerThread {
+    std::string buf;
+    std::vector<Scanned> scanned;
+    std::vector<std::uint32_t> seen;
+  };
+  std::vector<PerThread> per_thread(threads_);
+  enumerateSourceFiles(
+      root_, extensions_, threads_,
+      [&](const std::string& path, std::size_t worker) {
+        if (path.rfind(prefix, 0) != 0) return true;
+        struct stat sb {};
+        if (stat(path.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode)) return true;
+        PerThread& t = per_thread[worker];
+        Scanned e;
+        e.rel = path.substr(prefix.size());
+        e.size = static_cast<std::uint64_t>(sb.st_size);
+        e.mtime_ns = mtimeNs(sb);
+        {
+          std::shared_lock<std::shared_mutex> lk(mu_);
+          const std::uint32_t id = findFile(state_, e.rel);
+          if (id != kNone) {
+            const auto& f = state_.files[id];
+            if (id < known) t.seen.push_back(id);
+            if (f.size == e.size && f.mtime_ns == e.mtime_ns) return true;
+          }
+        }
+        if (!readWholeFile(path, t.buf)) return true;
+        e.decls = scanDeclarations(t.buf);
+        t.scanned.push_back(std::move(e));
+        // Interned as we go, so the scanned strings don't pile up.
+        if (t.scanned.size() >= kCommitBatch) commit(t.scanned);
+        return true;
+      },
+      cancelled);
+  if (cancelled && cancelled->load(std::memory_order_acquire)) return;
+
+  std::vector<bool> seen(known, false);
+  for (auto& t : per_thread) {
+    for (std::uint32_t id : t.seen) seen[id] = true;
+    commit(t.scanned);
+  }
+  // Whatever wasn't listed is gone or ignored now.
+  std::unique_lock<std::shared_mutex> lk(mu_);
+  for (std::uint32_t id = 0; id < known; ++id) {
+    if (!seen[id]) removeFile(state_, id);
+  }
+  if (state_.dead > 0 && state_.dead * 4 >= state_.files.size()) compact(state_);
+}
+
+void SymbolIndex::commit(std::vector<Scanned>& scanned) {
+  std::unique_lock<std::shared_mutex> lk(mu_);
+  for (const auto& e : scanned) {
+    const std::uint32_t id = findFile(state_, e.rel);
+    if (id != kNone) {
+      const auto& old = state_.files[id];
+      // A concurrent update may already have indexed this (or a newer) version.
+      if (old.mtime_ns > e.mtime_ns || (old.mtime_ns == e.mtime_ns && old.size == e.size)) continue;
+      removeFile(state_, id);
+    }
+    addFile(state_, e);
+  }
+  scanned.clear();
+}
+
+void SymbolIndex::applyChanges(const std::vector<std::string>& files, const std::vector<std::string>& removed_dirs) {
+  {
+    std::lock_guard<std::mutex> lg(pending_mu_);
+    if (!ready()) {
+      pending_files_.insert(pending_files_.end(), files.begin(), files.end());
+      pending_dirs_.insert(pending_dirs_.end(), removed_dirs.begin(), removed_dirs.end());
+      return;
+    }
+  }
+  applyUpdates(files, removed_dirs);
+}
+
+void SymbolIndex::applyUpdates(const std::vector<std::string>& files, const std::vector<std::string>& removed_dirs) {
+  const std::string prefix = rootPrefix();
+
+  if (!removed_dirs.empty()) {
+    std::unordered_set<std::string> gone;
+    for (const auto& d : removed_dirs) {
+      if (d.rfind(prefix, 0) != 0) continue;
+      struct stat sb {};
+      if (stat(d.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode)) continue;  // came back; its files are reported
+      gone.insert(d.substr(prefix.size()));
+    }
+    if (!gone.empty()) {
+      auto under_gone = [&](const std::string& rel) {
+        for (std::size_t slash = rel.find('/'); slash != std::string::npos; slash = rel.find('/', slash + 1)) {
+          if (gone.count(rel.substr(0, slash))) return true;
+        }
+        return false;
+      };
+      std::unique_lock<std::shared_mutex> lk(mu_);
+      for (std::uint32_t id = 0; id < state_.files.size(); ++id) {
+        if (state_.files[id].alive && under_gone(relPath(state_, id))) removeFile(state_, id);
+      }
+    }
+  }
+
+  std::string buf;
+  IgnoreChecker ignore(root_);
+  const ListedFiles listed(root_);
+  std::vector<Scanned> scanned;
+  for (const auto& path : files) {
+    if (path.rfind(prefix, 0) != 0) continue;
+    Scanned e;
+    e.rel = path.substr(prefix.size());
+    if (!hasAllowedExtension(e.rel, extensions_) || inExcludedDir(e.rel)) continue;
+    struct stat sb {};
+    // Files that became ignored (or untracked) are dropped like deleted ones.
+    if (!listed.contains(e.rel) || ignore.ignored(e.rel) || stat(path.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode) || !readWholeFile(path, buf)) {
+      std::unique_lock<std::shared_mutex> lk(mu_);
+      const std::uint32_t id = findFile(state_, e.rel);
+      if (id != kNone) removeFile(state_, id);
+      continue;
+    }
+    e.size = static_cast<std::uint64_t>(sb.st_size);
+    e.mtime_ns = mtimeNs(sb);
+    e.decls = scanDeclarations(buf);
+    scanned.push_back(std::move(e));
+  }
+  commit(scanned);
+
+  std::unique_lock<std::shared_mutex> lk(mu_);
+  if (state_.dead > 0 && state_.dead * 4 >= state_.files.size()) compact(state_);
+}
+
+std::vector<SymbolIndex::Symbol> SymbolIndex::lookup(std::string_view name) const {
+  std::vector<Symbol> out;
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  const std::uint32_t name_id = state_.names.find(name);
+  if (name_id == StringPool::kNotFound || name_id >= state_.heads.size()) return out;
+  for (std::uint32_t i = state_.heads[name_id]; i != kNone; i = state_.entries[i].next) {
+    const Entry& e = state_.entries[i];
+    if (!state_.files[e.file].alive) continue;
+    out.push_back(Symbol{absPath(relPath(state_, e.file)), declarationOf(state_, e)});
+  }
+  return out;
+}
+
+void SymbolIndex::refreshDictionary() const {
+  Dictionary& d = dict_;
+  const std::size_t names = state_.names.size();
+  if (d.generation == state_.generation && d.ids.size() == names) return;
+  d.recent.clear();
+
+  // New names are appended unsorted until there are enough of them to re-sort everything.
+  if (d.generation == state_.generation && names - d.sorted <= d.sorted / 4 + 4096) {
+    for (auto id = static_cast<std::uint32_t>(d.ids.size()); id < names; ++id) {
+      d.ids.push_back(id);
+      d.signatures.push_back(FuzzyMatcher::signature(state_.names.view(id)));
+      d.text.append(state_.names.view(id));
+      appendLower(d.lower, state_.names.view(id));
+      d.starts.push_back(static_cast<std::uint32_t>(d.lower.size()));
+    }
+    return;
+  }
+
+  std::string lower;
+  std::vector<std::uint32_t> starts{0};
+  starts.reserve(names + 1);
+  for (std::uint32_t id = 0; id < names; ++id) {
+    appendLower(lower, state_.names.view(id));
+    starts.push_back(static_cast<std::uint32_t>(lower.size()));
+  }
+  auto lowerOf = [&](std::uint32_t id) { return std::string_view(lower).substr(starts[id], starts[id + 1] - starts[id]); };
+  d.ids.resize(names);
+  std::iota(d.ids.begin(), d.ids.end(), 0);
+  std::sort(d.ids.begin(), d.ids.end(), [&](std::uint32_t a, std::uint32_t b) {
+    const int c = lowerOf(a).compare(lowerOf(b));
+    return c != 0 ? c < 0 : state_.names.view(a) < state_.names.view(b);
+  });
+  d.text.clear();
+  d.text.reserve(lower.size());
+  d.lower.clear();
+  d.lower.reserve(lower.size());
+  d.starts.assign(1, 0);
+  d.starts.reserve(names + 1);
+  d.signatures.clear();
+  d.signatures.reserve(names);
+  for (std::uint32_t id : d.ids) {
+    d.signatures.push_back(FuzzyMatcher::signature(state_.names.view(id)));
+    d.text.append(state_.names.view(id));
+    d.lower.append(lowerOf(id));
+    d.starts.push_back(static_cast<std::uint32_t>(d.lower.size()));
+  }
+  d.sorted = names;
+  d.generation = state_.generation;
+}
+
+std::vector<SymbolIndex::ScoredSymbol> SymbolIndex::fuzzyFind(std::string_view query,
+                                                              std::size_t limit,
+                                                              const std::function<bool(const std::string& path)>& skip) const {
+  std::vector<ScoredSymbol> out;
+  if (limit == 0) return out;
+  FuzzyMatcher matcher(query);
+  const std::string& lower = matcher.lowerPattern();
+
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  std::lock_guard<std::mutex> dict_lock(dict_mu_);
+  refreshDictionary();
+  const Dictionary& d = dict_;
+
+  auto lowerAt = [&](std::uint32_t pos) {
+    return std::string_view(d.lower).substr(d.starts[pos], d.starts[pos + 1] - d.starts[pos]);
+  };
+
+  // Candidates (positions in d.ids). Like clangd, short queries only match names starting with
+  // them: a range of the sorted names, plus the newer ones.
+  std::vector<std::uint32_t> own;
+  const std::vector<std::uint32_t>* candidates = &own;
+  if (lower.size() < kMinFuzzyQuery) {
+    std::uint32_t lo = 0;
+    std::uint32_t hi = static_cast<std::uint32_t>(d.sorted);
+    while (lo < hi) {
+      const std::uint32_t mid = lo + (hi - lo) / 2;
+      if (lowerAt(mid) < lower) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    for (std::uint32_t pos = lo; pos < d.sorted && lowerAt(pos).substr(0, lower.size()) == lower; ++pos) own.push_back(pos);
+    for (auto pos = static_cast<std::uint32_t>(d.sorted); pos < d.ids.size(); ++pos) {
+      if (lowerAt(pos).substr(0, lower.size()) == lower) own.push_back(pos);
+    }
+  } else {
+    // Longer ones match names containing them as a subsequence. A query extending a recent one
+    // only re-checks that one's candidates.
+    auto best = dict_.recent.end();
+    for (auto it = dict_.recent.begin(); it != dict_.recent.end(); ++it) {
+      if (lower.rfind(it->first, 0) == 0 && (best == dict_.recent.end() || it->first.size() > best->first.size())) best = it;
+    }
+    if (best != dict_.recent.end() && best->first == lower) {
+      std::rotate(best, best + 1, dict_.recent.end());  // most recent last
+    } else {
+      auto test = [&](std::uint32_t pos) {
+        if (matcher.mayMatch(d.signatures[pos]) && isSubsequence(lower, lowerAt(pos))) own.push_back(pos);
+      };
+      if (best != dict_.recent.end()) {
+        for (std::uint32_t pos : best->second) test(pos);
+      } else {
+        for (auto pos = static_cast<std::uint32_t>(0); pos < d.ids.size(); ++pos) test(pos);
+      }
+      if (dict_.recent.size() == kRecentQueries) dict_.recent.erase(dict_.recent.begin());
+      dict_.recent.emplace_back(lower, std::move(own));
+    }
+    candidates = &dict_.recent.back().second;
+  }
+
+  // Live candidates by length: shorter names can score higher, so ranking them first lets the
+  // long tail be skipped once it can't make the cut.
+  std::vector<std::uint32_t> by_length(candidates->size());
+  std::uint32_t bucket_starts[FuzzyMatcher::kMaxWord + 2] = {};
+  auto lengthOf = [&](std::uint32_t pos) {
+    return std::min<std::size_t>(d.starts[pos + 1] - d.starts[pos], FuzzyMatcher::kMaxWord);
+  };
+  for (std::uint32_t pos : *candidates) {
+    if (state_.live[d.ids[pos]] != 0) ++bucket_starts[lengthOf(pos) + 1];
+  }
+  for (std::size_t len = 1; len <= FuzzyMatcher::kMaxWord + 1; ++len) bucket_starts[len] += bucket_starts[len - 1];
+  {
+    std::uint32_t fill[FuzzyMatcher::kMaxWord + 1];
+    std::copy(bucket_starts, bucket_starts + FuzzyMatcher::kMaxWord + 1, fill);
+    for (std::uint32_t pos : *candidates) {
+      if (state_.live[d.ids[pos]] != 0) by_length[fill[lengthOf(pos)]++] = pos;
+    }
+    by_length.resize(bucket_starts[FuzzyMatcher::kMaxWord + 1]);
+  }
+
+  struct Scored {
+    float score;
+    std::uint32_t pos;
+  };
+  auto better = [](const Scored& a, const Scored& b) { return a.score != b.score ? a.score > b.score : a.pos < b.pos; };
+  // The best `want` names, best first, and whether that's all of them.
+  auto rank = [&](std::size_t want, bool& complete) {
+    std::vector<Scored> top;  // a heap with the worst on top
+    std::size_t matched = 0;
+    complete = true;
+    for (std::size_t len = 0; len <= FuzzyMatcher::kMaxWord; ++len) {
+      // Done once no longer name can make the cut or, like clangd's index, once enough candidates
+      // per result were scored (for queries common names contain by the thousand).
+      if (top.size() == want && (matched >= want * kScoredPerResult || matcher.bestScore(len) < top.front().score)) {
+        complete = bucket_starts[len] == by_length.size();
+        break;
+      }
+      matched += bucket_starts[len + 1] - bucket_starts[len];
+      for (std::uint32_t i = bucket_starts[len]; i < bucket_starts[len + 1]; ++i) {
+        const std::uint32_t pos = by_length[i];
+        auto score = matcher.match(std::string_view(d.text).substr(d.starts[pos], d.starts[pos + 1] - d.starts[pos]));
+        if (!score) continue;
+        const Scored s{*score, pos};
+        if (top.size() < want) {
+          top.push_back(s);
+          std::push_heap(top.begin(), top.end(), better);
+        } else if (better(s, top.front())) {
+          std::pop_heap(top.begin(), top.end(), better);
+          top.back() = s;
+          std::push_heap(top.begin(), top.end(), better);
+          complete = false;
+        } else {
+          complete = false;
+        }
+      }
+    }
+    std::sort_heap(top.begin(), top.end(), better);
+    return top;
+  };
+
+  // Every name ranked has a live declaration, so `limit` names are enough unless `skip` drops some.
+  std::vector<Symbol> defs, decls;
+  for (std::size_t want = limit;; want *= 4) {
+    bool complete = false;
+    const std::vector<Scored> top = rank(want, complete);
+    out.clear();
+    for (const Scored& scored : top) {
+      defs.clear();
+      decls.clear();
+      const std::uint32_t id = d.ids[scored.pos];
+      for (std::uint32_t e = state_.heads[id]; e != kNone; e = state_.entries[e].next) {
+        const Entry& entry = state_.entries[e];
+        if (!state_.files[entry.file].alive) continue;
+        Symbol sym{absPath(relPath(state_, entry.file)), declarationOf(state_, entry)};
+        if (skip && skip(sym.path)) continue;
+        (entry.definition ? defs : decls).push_back(std::move(sym));
+      }
+      for (auto* group : {&defs, &decls}) {
+        for (auto& sym : *group) {
+          if (out.size() == limit) break;
+          out.push_back(ScoredSymbol{std::move(sym), scored.score});
+        }
+      }
+      if (out.size() == limit) break;
+    }
+    if (out.size() == limit || complete) break;
+  }
+  return out;
+}
+
+std::size_t SymbolIndex::fileCount() const {
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  return state_.files.size() - state_.dead;
+}
+
+std::size_t SymbolIndex::symbolCount() const {
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  return state_.symbols;
+}
+
+std::size_t SymbolIndex::memoryBytes() const {
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  std::size_t dictionary = 0;
+  {
+    std::lock_guard<std::mutex> dict_lock(dict_mu_);
+    dictionary = dict_.ids.capacity() * sizeof(std::uint32_t) + dict_.text.capacity() + dict_.lower.capacity() +
+                 dict_.starts.capacity() * sizeof(std::uint32_t) + dict_.signatures.capacity() * sizeof(std::uint64_t);
+    for (const auto& [query, candidates] : dict_.recent) dictionary += candidates.capacity() * sizeof(std::uint32_t);
+  }
+  // Hash nodes: the pair plus a next pointer and a cached hash; buckets are pointers.
+  constexpr std::size_t kNodeBytes = sizeof(std::pair<const std::uint64_t, std::uint32_t>) + 2 * sizeof(void*);
+  return state_.names.bytes() + state_.strings.bytes() + state_.dirs.capacity() * sizeof(Dir) +
+         state_.files.capacity() * sizeof(FileEntry) + state_.entries.capacity() * sizeof(Entry) +
+         state_.heads.capacity() * sizeof(std::uint32_t) +
+         (state_.dir_ids.size() + state_.file_ids.size()) * kNodeBytes +
+         (state_.dir_ids.bucket_count() + state_.file_ids.bucket_count()) * sizeof(void*) +
+         state_.live.capacity() * sizeof(std::uint32_t) + dictionary;
+}
+
+}  // namespace slclangd
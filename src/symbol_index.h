@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "decl_scanner.h"
+#include "string_pool.h"
+
+namespace slclangd {
+
+// Workspace-wide table of the declarations scanDeclarations() finds in each C/C++ file, keyed by
+// name, so finding a definition is a hash lookup rather than a search plus re-ranking.
+//
+// Storage is sized for very large trees: declarations are 28-byte records in one arena, names and
+// scopes are interned once, and the path table stores each directory once. It lives in memory
+// only: build() scans the whole tree on several threads at startup (files are enumerated like the
+// searches enumerate them), then applyChanges() (fed by FileWatcher) re-scans the files that
+// change, as for TrigramIndex.
+class SymbolIndex final {
+ public:
+  struct Symbol {
+    std::string path;  // root-joined, like the searches report paths
+    Declaration decl;
+  };
+
+  // `extensions` restricts indexed files (same format as grepFixedString's, without dots).
+  // `threads` scan the tree in build() and rescan() (0 = one per core).
+  SymbolIndex(std::string root, std::vector<std::string> extensions, std::size_t threads = 0);
+
+  // Scans the tree, marks the index ready and replays the changes reported meanwhile. Safe to call
+  // from a background thread.
+  void build(std::atomic_bool* cancelled = nullptr);
+
+  // Re-scans files whose size/mtime changed; missing or ignored ones are dropped, as is everything
+  // below `removed_dirs`. Changes reported before the index is ready are replayed by build().
+  void applyChanges(const std::vector<std::string>& files, const std::vector<std::string>& removed_dirs);
+
+  // Revalidates every entry against the tree (e.g. after the file watcher lost events).
+  void rescan(std::atomic_bool* cancelled = nullptr);
+
+  bool ready() const { return ready_.load(std::memory_order_acquire); }
+
+  // Every indexed declaration named `name`, definitions or not.
+  std::vector<Symbol> lookup(std::string_view name) const;
+
+  // Shorter workspace/symbol queries only match names they start.
+  static constexpr std::size_t kMinFuzzyQuery = 3;
+
+  struct ScoredSymbol {
+    Symbol symbol;
+    float score = 0;  // FuzzyMatcher's
+  };
+
+  // Up to `limit` declarations whose names match `query` like clangd's workspace/symbol (see
+  // FuzzyMatcher), best first and then by name, a name's definitions before its other declarations.
+  // Queries shorter than 3 characters only match names starting with them (an empty one lists
+  // names alphabetically). Symbols whose path `skip` returns true for are left out.
+  //
+  // The names are kept in a lowercase-sorted dictionary, so short queries are a binary search. The
+  // candidates of recent longer queries are remembered: as the user types, each query only
+  // re-checks the names the previous one matched.
+  std::vector<ScoredSymbol> fuzzyFind(std::string_view query,
+                                      std::size_t limit,
+                                      const std::function<bool(const std::string& path)>& skip = nullptr) const;
+
+  std::size_t fileCount() const;
+  std::size_t symbolCount() const;
+  // Heap bytes held by the tables, for statistics.
+  std::size_t memoryBytes() const;
+
+ private:
+  static constexpr std::uint32_t kNone = UINT32_MAX;
+
+  // One declaration: a fixed-size record in State::entries, the arena all of them are appended to
+  // (each file's contiguously). Names and scopes are interned, paths go through the path table.
+  struct Entry {
+    std::uint32_t name;       // in State::names
+    std::uint32_t container;  // in State::strings ("" at file scope)
+    std::uint32_t file;
+    std::uint32_t next;       // next entry with the same name, or kNone
+    std::uint32_t line;
+    std::uint32_t column;
+    std::uint16_t length;
+    DeclKind kind;
+    bool definition : 1;
+    bool member : 1;
+  };
+
+  // Path table: each directory is stored once, as its parent and last component.
+  struct Dir {
+    std::uint32_t parent;  // kNone for the root
+    std::uint32_t name;    // in State::strings
+  };
+
+  struct FileEntry {
+    std::uint32_t dir = 0;
+    std::uint32_t base = 0;  // in State::strings
+    std::uint64_t size = 0;
+    std::int64_t mtime_ns = 0;
+    std::uint32_t first = 0;  // its entries: [first, first + count)
+    std::uint32_t count = 0;
+    bool alive = true;
+  };
+
+  struct State {
+    StringPool names;    // declared names
+    StringPool strings;  // scopes and path components
+    std::vector<Dir> dirs{Dir{kNone, 0}};
+    std::unordered_map<std::uint64_t, std::uint32_t> dir_ids;   // (parent, name) -> dir
+    std::vector<FileEntry> files;
+    std::unordered_map<std::uint64_t, std::uint32_t> file_ids;  // (dir, base) -> live file
+    std::vector<Entry> entries;
+    std::vector<std::uint32_t> heads;  // per name: its most recent entry (chains may cross dead files)
+    std::vector<std::uint32_t> live;   // per name: entries in live files
+    std::size_t dead = 0;
+    std::size_t symbols = 0;
+    std::uint64_t generation = 0;  // bumped by compact(), which renumbers the names
+
+    State() { strings.intern(""); }
+  };
+
+  // A file read and scanned, before it's interned into the state.
+  struct Scanned {
+    std::string rel;  // relative to root_
+    std::uint64_t size = 0;
+    std::int64_t mtime_ns = 0;
+    std::vector<Declaration> decls;
+  };
+
+  static std::uint32_t findFile(const State& st, std::string_view rel);
+  static std::string relPath(const State& st, std::uint32_t file);
+  static Declaration declarationOf(const State& st, const Entry& e);
+  static void addFile(State& st, const Scanned& scanned);
+  static void removeFile(State& st, std::uint32_t id);
+  static void compact(State& st);
+
+  // Every name in State::names, for fuzzyFind().
+  struct Dictionary {
+    std::uint64_t generation = UINT64_MAX;  // of the State it was built from
+    std::vector<std::uint32_t> ids;         // name ids: [0, sorted) by lowercase name, then newer names
+    std::size_t sorted = 0;
+    std::string text;                   // the names back to back in `ids` order, so ranking reads them in sequence
+    std::string lower;                  // and lowercased
+    std::vector<std::uint32_t> starts;  // name at position i is text[starts[i], starts[i + 1])
+    std::vector<std::uint64_t> signatures;  // FuzzyMatcher::signature() of each
+    // Recent queries (lowercased, 3+ characters) and the positions of the names containing them as
+    // a subsequence.
+    std::vector<std::pair<std::string, std::vector<std::uint32_t>>> recent;
+  };
+
+  // Catches dict_ up with state_ (mu_ and dict_mu_ held).
+  void refreshDictionary() const;
+
+  // Swaps in freshly scanned files, unless a newer version is already indexed.
+  void commit(std::vector<Scanned>& scanned);
+  void applyUpdates(const std::vector<std::string>& files, const std::vector<std::string>& removed_dirs);
+  std::string rootPrefix() const;
+  std::string absPath(const std::string& rel) const;
+
+  std::string root_;
+  std::vector<std::string> extensions_;
+  std::size_t threads_;
+  std::atomic_bool ready_{false};
+
+  mutable std::shared_mutex mu_;
+  State state_;
+
+  // Locked after mu_ (shared).
+  mutable std::mutex dict_mu_;
+  mutable Dictionary dict_;
+
+  std::mutex pending_mu_;
+  std::vector<std::string> pending_files_;
+  std::vector<std::string> pending_dirs_;
+};
+
+}  // namespace slclangd
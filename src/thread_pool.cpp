@@ -0,0 +1,78 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace slclangd {
+
+ThreadPool::ThreadPool(std::size_t threads) {
+  threads = std::max<std::size_t>(threads, 1);
+  workers_.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i) workers_.emplace_back([this]() { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lg(mu_);
+    stopping_ = true;
+    for (auto& q : queues_) q.clear();
+  }
+  cv_.notify_all();
+  for (auto& t : workers_) t.join();
+}
+
+void ThreadPool::submit(std::function<void()> task, Priority priority) {
+  {
+    std::lock_guard<std::mutex> lg(mu_);
+    if (stopping_) return;
+    queues_[static_cast<std::size_t>(priority)].push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+ThreadPool::Stats ThreadPool::stats() const {
+  std::lock_guard<std::mutex> lg(mu_);
+  Stats s;
+  s.threads = workers_.size();
+  s.busy = busy_;
+  for (const auto& q : queues_) s.queued += q.size();
+  s.completed = completed_;
+  return s;
+}
+
+std::size_t ThreadPool::defaultThreads() {
+  std::size_t hw = std::thread::hardware_concurrency();
+  return std::clamp<std::size_t>(hw, 1, 4);
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait(lk, [this]() {
+        return stopping_ || std::any_of(queues_.begin(), queues_.end(), [](const auto& q) { return !q.empty(); });
+      });
+      if (stopping_) return;
+      auto& interactive = queues_[static_cast<std::size_t>(Priority::kInteractive)];
+      auto& background = queues_[static_cast<std::size_t>(Priority::kBackground)];
+      auto* q = &interactive;
+      if (interactive.empty() || (!background.empty() && overtakes_ >= kMaxOvertakes)) q = &background;
+      if (q == &background) {
+        overtakes_ = 0;
+      } else if (!background.empty()) {
+        ++overtakes_;
+      }
+      task = std::move(q->front());
+      q->pop_front();
+      ++busy_;
+    }
+    task();
+    std::lock_guard<std::mutex> lg(mu_);
+    --busy_;
+    ++completed_;
+  }
+}
+
+}  // namespace slclangd
+
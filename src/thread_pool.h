@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace slclangd {
+
+// Fixed-size worker pool with one FIFO queue per priority. Bounds how many searches run at once no
+// matter how fast the editor fires requests; excess work waits, and interactive work jumps ahead of
+// background work.
+class ThreadPool final {
+ public:
+  enum class Priority {
+    kInteractive = 0,  // the user is waiting on it right now (definition, hover)
+    kBackground = 1,   // workspace-wide, slower anyway (references, workspace/symbol)
+  };
+
+  explicit ThreadPool(std::size_t threads);
+  // Lets running tasks finish; tasks still queued are dropped.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> task, Priority priority = Priority::kInteractive);
+
+  struct Stats {
+    std::size_t threads = 0;
+    std::size_t busy = 0;      // workers currently running a task
+    std::size_t queued = 0;    // tasks waiting for a worker
+    std::uint64_t completed = 0;
+  };
+  Stats stats() const;
+
+  // Pool size used when the user doesn't pick one: all cores, capped so concurrent searches
+  // don't thrash the disk.
+  static std::size_t defaultThreads();
+
+ private:
+  void workerLoop();
+
+  static constexpr std::size_t kPriorities = 2;
+  // A waiting background task is run after this many interactive tasks overtook it, so a
+  // stream of hovers can't starve it forever.
+  static constexpr unsigned kMaxOvertakes = 8;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::array<std::deque<std::function<void()>>, kPriorities> queues_;
+  unsigned overtakes_ = 0;
+  std::vector<std::thread> workers_;
+  std::size_t busy_ = 0;
+  std::uint64_t completed_ = 0;
+  bool stopping_ = false;
+};
+
+}  // namespace slclangd
+
@@ -0,0 +1,528 @@
+#include "trigram_index.h"
+
+#include "ignore_rules.h"
+#include "inproc_search.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <unordered_set>
+#include <sys/stat.h>
+#include <utility>
+
+namespace slclangd {
+namespace {
+
+constexpr char kMagic[8] = {'S', 'L', 'C', 'T', 'R', 'I', '0', '2'};
+
+static std::uint32_t trigramAt(const char* p) {
+  return (static_cast<std::uint32_t>(static_cast<unsigned char>(p[0])) << 16) |
+         (static_cast<std::uint32_t>(static_cast<unsigned char>(p[1])) << 8) |
+         static_cast<std::uint32_t>(static_cast<unsigned char>(p[2]));
+}
+
+// Distinct trigrams of `data`, deduplicated with a 2^24-bit seen-set that is cleared lazily.
+static void distinctTrigrams(std::string_view data, std::vector<std::uint32_t>& out) {
+  thread_local std::vector<std::uint64_t> seen((1u << 24) / 64, 0);
+  out.clear();
+  if (data.size() < 3) return;
+  for (std::size_t i = 0; i + 3 <= data.size(); ++i) {
+    std::uint32_t t = trigramAt(data.data() + i);
+    std::uint64_t bit = std::uint64_t{1} << (t & 63);
+    if (seen[t >> 6] & bit) continue;
+    seen[t >> 6] |= bit;
+    out.push_back(t);
+  }
+  for (std::uint32_t t : out) seen[t >> 6] = 0;
+}
+
+static std::int64_t mtimeNs(const struct stat& st) {
+  return static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static std::uint64_t fnv1a64(std::string_view s) {
+  std::uint64_t h = 1469598103934665603ull;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// Which files a full scan covers (see enumerateSourceFiles()); indexes of both kinds differ.
+static const char* listingMode() { return gitIndexListing() ? "git-index" : "walk"; }
+
+static std::string joinExtensions(const std::vector<std::string>& exts) {
+  std::string out;
+  for (const auto& e : exts) {
+    if (!out.empty()) out.push_back(',');
+    out += e;
+  }
+  return out;
+}
+
+template <typename T>
+static void writePod(std::ostream& os, const T& v) {
+  os.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// Reads a loaded cache file, never past its end: a truncated or corrupt file fails a read.
+class CacheReader {
+ public:
+  explicit CacheReader(std::string_view data) : data_(data) {}
+
+  template <typename T>
+  bool pod(T& v) {
+    if (data_.size() < sizeof(v)) return false;
+    std::memcpy(&v, data_.data(), sizeof(v));
+    data_.remove_prefix(sizeof(v));
+    return true;
+  }
+  bool bytes(std::size_t n, std::string_view& out) {
+    if (n > data_.size()) return false;
+    out = data_.substr(0, n);
+    data_.remove_prefix(n);
+    return true;
+  }
+  bool string(std::string& s) {
+    std::uint32_t n = 0;
+    std::string_view v;
+    if (!pod(n) || !bytes(n, v)) return false;
+    s.assign(v);
+    return true;
+  }
+  std::size_t remaining() const { return data_.size(); }
+
+ private:
+  std::string_view data_;
+};
+
+static void writeString(std::ostream& os, const std::string& s) {
+  writePod(os, static_cast<std::uint32_t>(s.size()));
+  os.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+}  // namespace
+
+void TrigramIndex::Posting::add(std::uint32_t id) {
+  std::uint32_t delta = count == 0 ? id : id - last;
+  while (delta >= 0x80) {
+    bytes.push_back(static_cast<std::uint8_t>(delta | 0x80));
+    delta >>= 7;
+  }
+  bytes.push_back(static_cast<std::uint8_t>(delta));
+  last = id;
+  ++count;
+}
+
+void TrigramIndex::Posting::decode(std::vector<std::uint32_t>& out) const {
+  out.clear();
+  out.reserve(count);
+  std::uint32_t cur = 0;
+  std::size_t i = 0;
+  for (std::uint32_t n = 0; n < count; ++n) {
+    std::uint32_t delta = 0;
+    int shift = 0;
+    while (i < bytes.size()) {
+      std::uint8_t b = bytes[i++];
+      delta |= static_cast<std::uint32_t>(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) break;
+      shift += 7;
+    }
+    cur = n == 0 ? delta : cur + delta;
+    out.push_back(cur);
+  }
+}
+
+bool TrigramIndex::Posting::valid(std::uint32_t files) const {
+  if (count == 0 || count > bytes.size()) return false;
+  std::uint32_t cur = 0;
+  std::size_t i = 0;
+  for (std::uint32_t n = 0; n < count; ++n) {
+    std::uint64_t delta = 0;
+    for (int shift = 0;; shift += 7) {
+      if (i == bytes.size() || shift > 28) return false;
+      const std::uint8_t b = bytes[i++];
+      delta |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) break;
+    }
+    if (n > 0 && delta == 0) return false;  // ids strictly increase
+    const std::uint64_t id = n == 0 ? delta : cur + delta;
+    if (id >= files) return false;
+    cur = static_cast<std::uint32_t>(id);
+  }
+  return i == bytes.size() && cur == last;
+}
+
+TrigramIndex::TrigramIndex(std::string root, std::vector<std::string> extensions)
+    : root_(std::move(root)), extensions_(std::move(extensions)) {}
+
+std::string TrigramIndex::rootPrefix() const {
+  if (!root_.empty() && root_.back() == '/') return root_;
+  return root_ + "/";
+}
+
+std::string TrigramIndex::absPath(const std::string& rel) const {
+  if (!root_.empty() && root_.back() == '/') return root_ + rel;
+  return root_ + "/" + rel;
+}
+
+std::string TrigramIndex::cachePath() const {
+  std::string base;
+  if (const char* x = std::getenv("XDG_CACHE_HOME"); x && *x) {
+    base = x;
+  } else if (const char* h = std::getenv("HOME"); h && *h) {
+    base = std::string(h) + "/.cache";
+  } else {
+    base = "/tmp";
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.trigrams",
+                static_cast<unsigned long long>(fnv1a64(root_ + '\0' + joinExtensions(extensions_) + '\0' + listingMode())));
+  return base + "/super-lazy-clangd/" + name;
+}
+
+void TrigramIndex::addFile(State& st, FileEntry entry, const std::vector<std::uint32_t>& trigrams) {
+  auto id = static_cast<std::uint32_t>(st.files.size());
+  for (std::uint32_t t : trigrams) st.postings[t].add(id);
+  st.id_by_rel[entry.rel] = id;
+  st.files.push_back(std::move(entry));
+}
+
+void TrigramIndex::removeFile(State& st, std::uint32_t id) {
+  auto& f = st.files[id];
+  if (!f.alive) return;
+  f.alive = false;
+  ++st.dead;
+  auto it = st.id_by_rel.find(f.rel);
+  if (it != st.id_by_rel.end() && it->second == id) st.id_by_rel.erase(it);
+}
+
+void TrigramIndex::compact(State& st) {
+  std::vector<std::uint32_t> remap(st.files.size(), UINT32_MAX);
+  std::vector<FileEntry> files;
+  files.reserve(st.files.size() - st.dead);
+  for (std::uint32_t id = 0; id < st.files.size(); ++id) {
+    if (!st.files[id].alive) continue;
+    remap[id] = static_cast<std::uint32_t>(files.size());
+    files.push_back(std::move(st.files[id]));
+  }
+
+  std::unordered_map<std::uint32_t, Posting> postings;
+  std::vector<std::uint32_t> ids;
+  for (const auto& [tri, posting] : st.postings) {
+    posting.decode(ids);
+    Posting p;
+    for (std::uint32_t id : ids) {
+      if (remap[id] != UINT32_MAX) p.add(remap[id]);
+    }
+    if (p.count > 0) postings.emplace(tri, std::move(p));
+  }
+
+  st.id_by_rel.clear();
+  for (std::uint32_t id = 0; id < files.size(); ++id) st.id_by_rel[files[id].rel] = id;
+  st.files = std::move(files);
+  st.postings = std::move(postings);
+  st.dead = 0;
+}
+
+void TrigramIndex::loadOrBuild(std::atomic_bool* cancelled) {
+  {
+    State st;
+    if (!load(st)) st = State{};
+    std::unique_lock<std::shared_mutex> lk(mu_);
+    state_ = std::move(st);
+  }
+  rescan(cancelled);
+  if (cancelled && cancelled->load(std::memory_order_acquire)) return;
+
+  // Replay changes reported (by the file watcher) while we were still building.
+  std::vector<std::string> files, dirs;
+  {
+    std::lock_guard<std::mutex> lg(pending_mu_);
+    ready_.store(true, std::memory_order_release);
+    files.swap(pending_files_);
+    dirs.swap(pending_dirs_);
+  }
+  if (!files.empty() || !dirs.empty()) applyUpdates(files, dirs);
+}
+
+void TrigramIndex::rescan(std::atomic_bool* cancelled) {
+  const std::string prefix = rootPrefix();
+  std::size_t known = 0;
+  {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    known = state_.files.size();
+  }
+
+  // Only collect paths here; applyUpdates() re-reads them without holding the lock for long.
+  std::vector<bool> seen(known, false);
+  std::vector<std::string> changed;
+  enumerateSourceFiles(
+      root_, extensions_, 1,
+      [&](const std::string& path, std::size_t) {
+        if (path.rfind(prefix, 0) != 0) return true;
+        struct stat sb {};
+        if (stat(path.c_str(), &sb) != 0) return true;
+        std::string_view rel(path.data() + prefix.size(), path.size() - prefix.size());
+        {
+          std::shared_lock<std::shared_mutex> lk(mu_);
+          auto it = state_.id_by_rel.find(std::string(rel));
+          if (it != state_.id_by_rel.end()) {
+            const auto& f = state_.files[it->second];
+            if (it->second < known) seen[it->second] = true;
+            if (f.size == static_cast<std::uint64_t>(sb.st_size) && f.mtime_ns == mtimeNs(sb)) return true;
+          }
+        }
+        changed.push_back(path);
+        return true;
+      },
+      cancelled);
+  if (cancelled && cancelled->load(std::memory_order_acquire)) return;
+
+  {
+    // Whatever wasn't listed is re-checked; applyUpdates() drops paths that are gone or ignored.
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    for (std::uint32_t id = 0; id < known; ++id) {
+      if (state_.files[id].alive && !seen[id]) changed.push_back(absPath(state_.files[id].rel));
+    }
+  }
+  applyUpdates(changed, {}, cancelled);
+}
+
+void TrigramIndex::applyChanges(const std::vector<std::string>& files, const std::vector<std::string>& removed_dirs) {
+  {
+    std::lock_guard<std::mutex> lg(pending_mu_);
+    if (!ready()) {
+      pending_files_.insert(pending_files_.end(), files.begin(), files.end());
+      pending_dirs_.insert(pending_dirs_.end(), removed_dirs.begin(), removed_dirs.end());
+      return;
+    }
+  }
+  applyUpdates(files, removed_dirs);
+}
+
+void TrigramIndex::applyUpdates(const std::vector<std::string>& files,
+                                const std::vector<std::string>& removed_dirs,
+                                std::atomic_bool* cancelled) {
+  const std::string prefix = rootPrefix();
+
+  if (!removed_dirs.empty()) {
+    std::unordered_set<std::string> gone;
+    for (const auto& d : removed_dirs) {
+      if (d.rfind(prefix, 0) != 0) continue;
+      struct stat sb {};
+      if (stat(d.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode)) continue;  // came back; its files are reported
+      gone.insert(d.substr(prefix.size()));
+    }
+    if (!gone.empty()) {
+      auto under_gone = [&](const std::string& rel) {
+        for (std::size_t slash = rel.find('/'); slash != std::string::npos; slash = rel.find('/', slash + 1)) {
+          if (gone.count(rel.substr(0, slash))) return true;
+        }
+        return false;
+      };
+      std::unique_lock<std::shared_mutex> lk(mu_);
+      for (std::uint32_t id = 0; id < state_.files.size(); ++id) {
+        if (state_.files[id].alive && under_gone(state_.files[id].rel)) removeFile(state_, id);
+      }
+    }
+  }
+
+  // Files are read and tokenized into trigrams outside the lock, then committed in small batches
+  // so concurrent queries only ever wait for a few hash-map insertions.
+  struct Update {
+    FileEntry entry;
+    bool present = false;
+    std::vector<std::uint32_t> trigrams;
+  };
+  constexpr std::size_t kBatch = 256;
+  std::vector<Update> batch;
+  auto commit = [&]() {
+    std::unique_lock<std::shared_mutex> lk(mu_);
+    for (auto& u : batch) {
+      auto it = state_.id_by_rel.find(u.entry.rel);
+      if (it != state_.id_by_rel.end()) {
+        const auto& old = state_.files[it->second];
+        // A concurrent update may already have indexed this (or a newer) version.
+        if (u.present && (old.mtime_ns > u.entry.mtime_ns ||
+                          (old.mtime_ns == u.entry.mtime_ns && old.size == u.entry.size))) {
+          continue;
+        }
+        removeFile(state_, it->second);
+      }
+      if (u.present) addFile(state_, std::move(u.entry), u.trigrams);
+    }
+    batch.clear();
+  };
+
+  std::string buf;
+  IgnoreChecker ignore(root_);
+  const ListedFiles listed(root_);
+  for (const auto& path : files) {
+    if (cancelled && cancelled->load(std::memory_order_acquire)) break;
+    if (path.rfind(prefix, 0) != 0) continue;
+    Update u;
+    u.entry.rel = path.substr(prefix.size());
+    if (!hasAllowedExtension(u.entry.rel, extensions_) || inExcludedDir(u.entry.rel)) continue;
+    // Files that became ignored (or untracked) are dropped like deleted ones.
+    struct stat sb {};
+    if (listed.contains(u.entry.rel) && !ignore.ignored(u.entry.rel) && stat(path.c_str(), &sb) == 0 &&
+        S_ISREG(sb.st_mode)) {
+      u.entry.size = static_cast<std::uint64_t>(sb.st_size);
+      u.entry.mtime_ns = mtimeNs(sb);
+      {
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        auto it = state_.id_by_rel.find(u.entry.rel);
+        if (it != state_.id_by_rel.end() && state_.files[it->second].size == u.entry.size &&
+            state_.files[it->second].mtime_ns == u.entry.mtime_ns) {
+          continue;
+        }
+      }
+      if (!readWholeFile(path, buf)) continue;
+      u.present = true;
+      // Binary files are registered (so they aren't re-read on every load) but get no postings:
+      // grep -I never reports them.
+      if (std::memchr(buf.data(), '\0', buf.size()) == nullptr) distinctTrigrams(buf, u.trigrams);
+    }
+    batch.push_back(std::move(u));
+    if (batch.size() >= kBatch) commit();
+  }
+  if (!batch.empty()) commit();
+
+  std::unique_lock<std::shared_mutex> lk(mu_);
+  if (state_.dead > 0 && state_.dead * 4 >= state_.files.size()) compact(state_);
+}
+
+bool TrigramIndex::load(State& st) const {
+  // Whatever is on disk (maybe truncated, corrupt or from another version) is checked before
+  // use: every length against what is left of the file, every posting against the file count.
+  std::string data;
+  if (!readWholeFile(cachePath(), data)) return false;
+  CacheReader in(data);
+  std::string_view magic;
+  if (!in.bytes(sizeof(kMagic), magic) || std::memcmp(magic.data(), kMagic, sizeof(kMagic)) != 0) return false;
+  std::string root, exts, listing;
+  if (!in.string(root) || !in.string(exts) || !in.string(listing)) return false;
+  if (root != root_ || exts != joinExtensions(extensions_) || listing != listingMode()) return false;
+
+  constexpr std::size_t kMinFileBytes = sizeof(std::uint32_t) + sizeof(std::uint64_t) + sizeof(std::int64_t);
+  std::uint32_t nfiles = 0;
+  if (!in.pod(nfiles) || nfiles > in.remaining() / kMinFileBytes) return false;
+  st.files.resize(nfiles);
+  for (std::uint32_t id = 0; id < nfiles; ++id) {
+    auto& f = st.files[id];
+    if (!in.string(f.rel) || !in.pod(f.size) || !in.pod(f.mtime_ns)) return false;
+    if (f.mtime_ns < 0) {
+      f.alive = false;
+      ++st.dead;
+      continue;
+    }
+    if (f.rel.empty() || !st.id_by_rel.emplace(f.rel, id).second) return false;
+  }
+
+  constexpr std::size_t kMinPostingBytes = 4 * sizeof(std::uint32_t) + 1;
+  std::uint32_t nposts = 0;
+  if (!in.pod(nposts) || nposts > in.remaining() / kMinPostingBytes) return false;
+  st.postings.reserve(nposts);
+  for (std::uint32_t i = 0; i < nposts; ++i) {
+    std::uint32_t tri = 0, nbytes = 0;
+    std::string_view bytes;
+    Posting p;
+    if (!in.pod(tri) || !in.pod(p.last) || !in.pod(p.count) || !in.pod(nbytes) || !in.bytes(nbytes, bytes)) return false;
+    p.bytes.assign(bytes.begin(), bytes.end());
+    if (tri >= (1u << 24) || !p.valid(nfiles) || !st.postings.emplace(tri, std::move(p)).second) return false;
+  }
+  return in.remaining() == 0;
+}
+
+bool TrigramIndex::save() const {
+  if (!ready()) return false;
+  const std::string path = cachePath();
+  const std::string tmp = path + ".tmp";
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  {
+    std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+    if (!os) return false;
+    os.write(kMagic, sizeof(kMagic));
+    writeString(os, root_);
+    writeString(os, joinExtensions(extensions_));
+    writeString(os, listingMode());
+
+    // Dead entries keep their slot (with mtime -1) so file ids, and thus postings, stay valid.
+    writePod(os, static_cast<std::uint32_t>(state_.files.size()));
+    for (const auto& f : state_.files) {
+      writeString(os, f.alive ? f.rel : std::string());
+      writePod(os, f.size);
+      writePod(os, f.alive ? f.mtime_ns : std::int64_t{-1});
+    }
+    writePod(os, static_cast<std::uint32_t>(state_.postings.size()));
+    for (const auto& [tri, p] : state_.postings) {
+      writePod(os, tri);
+      writePod(os, p.last);
+      writePod(os, p.count);
+      writePod(os, static_cast<std::uint32_t>(p.bytes.size()));
+      os.write(reinterpret_cast<const char*>(p.bytes.data()), static_cast<std::streamsize>(p.bytes.size()));
+    }
+    if (!os) return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+std::optional<std::vector<std::string>> TrigramIndex::candidates(std::string_view needle,
+                                                                 const std::vector<std::string>& extensions) const {
+  if (!ready() || needle.size() < 3) return std::nullopt;
+  for (const auto& e : extensions) {
+    if (std::find(extensions_.begin(), extensions_.end(), e) == extensions_.end()) return std::nullopt;
+  }
+  if (extensions.empty() && !extensions_.empty()) return std::nullopt;
+
+  std::vector<std::uint32_t> tris;
+  for (std::size_t i = 0; i + 3 <= needle.size(); ++i) tris.push_back(trigramAt(needle.data() + i));
+  std::sort(tris.begin(), tris.end());
+  tris.erase(std::unique(tris.begin(), tris.end()), tris.end());
+
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  std::vector<const Posting*> lists;
+  for (std::uint32_t t : tris) {
+    auto it = state_.postings.find(t);
+    if (it == state_.postings.end()) return std::vector<std::string>{};
+    lists.push_back(&it->second);
+  }
+  // Intersect rarest-first so the working set shrinks as fast as possible.
+  std::sort(lists.begin(), lists.end(), [](const Posting* a, const Posting* b) { return a->count < b->count; });
+
+  std::vector<std::uint32_t> acc, next, merged;
+  lists.front()->decode(acc);
+  for (std::size_t i = 1; i < lists.size() && !acc.empty(); ++i) {
+    lists[i]->decode(next);
+    merged.clear();
+    std::set_intersection(acc.begin(), acc.end(), next.begin(), next.end(), std::back_inserter(merged));
+    acc.swap(merged);
+  }
+
+  std::vector<std::string> out;
+  out.reserve(acc.size());
+  for (std::uint32_t id : acc) {
+    const auto& f = state_.files[id];
+    if (!f.alive || !hasAllowedExtension(f.rel, extensions)) continue;
+    out.push_back(absPath(f.rel));
+  }
+  return out;
+}
+
+std::size_t TrigramIndex::fileCount() const {
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  return state_.files.size() - state_.dead;
+}
+
+}  // namespace slclangd
+
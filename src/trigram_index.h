@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace slclangd {
+
+// Workspace-wide trigram index: maps every 3-byte sequence to the (delta/varint encoded) list of
+// files containing it. A fixed-string query only needs to open the files whose posting lists
+// contain all of the needle's trigrams; the caller still scans those candidates, so results are
+// identical to a full scan.
+//
+// The index is persisted under $XDG_CACHE_HOME/super-lazy-clangd/ and revalidated (size + mtime)
+// on load, so a restarted server only re-reads files that changed. While running it is kept up to
+// date incrementally through applyChanges() (fed by FileWatcher).
+class TrigramIndex final {
+ public:
+  // `extensions` restricts indexed files (same format as grepFixedString's, without dots).
+  TrigramIndex(std::string root, std::vector<std::string> extensions);
+
+  // Loads the persisted index (if any), brings it up to date with the tree and marks it ready.
+  // Otherwise builds it from scratch. Safe to call from a background thread.
+  void loadOrBuild(std::atomic_bool* cancelled = nullptr);
+
+  // Re-indexes files that changed on disk: present ones are re-read if their size/mtime changed,
+  // missing ones are dropped, as is everything below `removed_dirs`. Changes reported before the
+  // index is ready are replayed once loadOrBuild() finishes.
+  void applyChanges(const std::vector<std::string>& files, const std::vector<std::string>& removed_dirs);
+
+  // Revalidates every entry against the tree (e.g. after the file watcher lost events).
+  void rescan(std::atomic_bool* cancelled = nullptr);
+
+  // Writes the index to cachePath(). Returns false on I/O errors.
+  bool save() const;
+
+  bool ready() const { return ready_.load(std::memory_order_acquire); }
+  const std::string& root() const { return root_; }
+  std::string cachePath() const;
+
+  // Files (paths as grep -R would print them, in index order) that may contain `needle`.
+  // Returns nullopt when the index can't narrow the search (not ready, needle shorter than a
+  // trigram, or extensions the index doesn't cover); callers should fall back to a full scan.
+  std::optional<std::vector<std::string>> candidates(std::string_view needle,
+                                                     const std::vector<std::string>& extensions) const;
+
+  std::size_t fileCount() const;
+
+ private:
+  struct FileEntry {
+    std::string rel;  // relative to root_
+    std::uint64_t size = 0;
+    std::int64_t mtime_ns = 0;
+    bool alive = true;
+  };
+
+  struct Posting {
+    std::vector<std::uint8_t> bytes;  // varint deltas of increasing file ids
+    std::uint32_t last = 0;
+    std::uint32_t count = 0;
+
+    void add(std::uint32_t id);
+    void decode(std::vector<std::uint32_t>& out) const;
+    // Well-formed, with increasing ids below `files` (for postings loaded from disk).
+    bool valid(std::uint32_t files) const;
+  };
+
+  struct State {
+    std::vector<FileEntry> files;
+    std::unordered_map<std::string, std::uint32_t> id_by_rel;
+    std::unordered_map<std::uint32_t, Posting> postings;
+    std::size_t dead = 0;
+  };
+
+  static void addFile(State& st, FileEntry entry, const std::vector<std::uint32_t>& trigrams);
+  static void removeFile(State& st, std::uint32_t id);
+  static void compact(State& st);
+
+  // Stops early (leaving the rest unapplied) once `cancelled` is set.
+  void applyUpdates(const std::vector<std::string>& files,
+                    const std::vector<std::string>& removed_dirs,
+                    std::atomic_bool* cancelled = nullptr);
+  bool load(State& st) const;
+  std::string rootPrefix() const;
+  std::string absPath(const std::string& rel) const;
+
+  std::string root_;
+  std::vector<std::string> extensions_;
+  std::atomic_bool ready_{false};
+
+  mutable std::shared_mutex mu_;
+  State state_;
+
+  std::mutex pending_mu_;
+  std::vector<std::string> pending_files_;
+  std::vector<std::string> pending_dirs_;
+};
+
+}  // namespace slclangd
+
@@ -0,0 +1,251 @@
+// Smoke tests for the pieces of the server that are easiest to get subtly wrong and hardest to
+// reach through LSP requests: ignore-file patterns, the git index reader, the fuzzy matcher, the
+// declaration scanner and incremental document edits. Run from the repository root:
+//
+//   meson test -C build    (or build/unit-smoke directly)
+
+#include "decl_scanner.h"
+#include "document.h"
+#include "fuzzy_match.h"
+#include "git_index.h"
+#include "ignore_rules.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+using namespace slclangd;
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(cond)                                                       \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      std::fprintf(stderr, "%s:%d: CHECK(%s)\n", __FILE__, __LINE__, #cond); \
+      ++g_failures;                                                       \
+    }                                                                     \
+  } while (0)
+
+void testIgnoreRules() {
+  IgnoreRules rules;
+  rules.parse(
+      "# comment\n"
+      "*.o\n"
+      "!keep.o\n"
+      "build/\n"
+      "/top.txt\n"
+      "docs/**/*.md\n"
+      "logs/*.log\n"
+      "foo?.c\n"
+      "[ab]x.h\n"
+      "\\#hash\n");
+  using V = IgnoreRules::Verdict;
+  CHECK(rules.match("a.o", false) == V::kIgnored);
+  CHECK(rules.match("sub/a.o", false) == V::kIgnored);  // no '/': matches at any depth
+  CHECK(rules.match("keep.o", false) == V::kIncluded);  // the last matching pattern wins
+  CHECK(rules.match("build", true) == V::kIgnored);
+  CHECK(rules.match("build", false) == V::kUnmatched);  // trailing '/': directories only
+  CHECK(rules.match("top.txt", false) == V::kIgnored);
+  CHECK(rules.match("sub/top.txt", false) == V::kUnmatched);  // anchored
+  CHECK(rules.match("docs/c.md", false) == V::kIgnored);      // "**/" matches no directory too
+  CHECK(rules.match("docs/a/b/c.md", false) == V::kIgnored);
+  CHECK(rules.match("logs/x.log", false) == V::kIgnored);
+  CHECK(rules.match("logs/a/x.log", false) == V::kUnmatched);  // '*' doesn't cross '/'
+  CHECK(rules.match("foo1.c", false) == V::kIgnored);
+  CHECK(rules.match("foo12.c", false) == V::kUnmatched);
+  CHECK(rules.match("ax.h", false) == V::kIgnored);
+  CHECK(rules.match("cx.h", false) == V::kUnmatched);
+  CHECK(rules.match("#hash", false) == V::kIgnored);
+  CHECK(rules.match("# comment", false) == V::kUnmatched);
+}
+
+// Writes the same tree into a fresh repository once per index version and reads it back.
+void testGitIndex() {
+  char dir_template[] = "/tmp/slclangd-unit-XXXXXX";
+  const char* dir = mkdtemp(dir_template);
+  if (!dir || std::system("git --version >/dev/null 2>&1") != 0) {
+    std::printf("skipped: git index (needs git and a writable /tmp)\n");
+    return;
+  }
+  const std::string root = dir;
+  const std::vector<std::string> tracked = {
+      "a.cpp",
+      "dir/b.h",
+      "dir/sub/shared_prefix_one.cpp",
+      "dir/sub/shared_prefix_two.cpp",  // v4 prefix-compresses paths against the previous one
+      "z.c",
+  };
+  for (int version = 2; version <= 4; ++version) {
+    std::string cmd = "cd " + root + " && rm -rf .git * && git init -q && mkdir -p dir/sub";
+    for (const auto& f : tracked) cmd += " && echo x > " + f;
+    cmd += " && echo x > skipped.cpp && echo x > untracked.cpp && git add ";
+    for (const auto& f : tracked) cmd += f + " ";
+    cmd += "skipped.cpp && git update-index --skip-worktree skipped.cpp";
+    cmd += " && git update-index --index-version " + std::to_string(version);
+    if (std::system(cmd.c_str()) != 0) {
+      std::printf("skipped: git index v%d (git failed)\n", version);
+      continue;
+    }
+    std::vector<std::string> paths;
+    CHECK(readGitIndex(root, paths));
+    CHECK(paths == tracked);  // skip-worktree and untracked files are left out
+    std::vector<std::string> none;
+    CHECK(!readGitIndex(root + "/dir", none));  // not the top of a work tree
+    CHECK(none.empty());
+  }
+  (void)!std::system(("rm -rf " + root).c_str());
+}
+
+void testFuzzyMatcher() {
+  FuzzyMatcher lsp("lspSrv");
+  CHECK(lsp.match("LspServer").has_value());
+  CHECK(lsp.match("lsp_server").has_value());
+  CHECK(!lsp.match("lspsrv").has_value());  // 'S' has to start a segment
+  CHECK(!lsp.match("getValue").has_value());
+
+  FuzzyMatcher gv("gv");
+  const auto exact = gv.match("getValue");
+  const auto other_case = gv.match("GetValue");
+  const auto unaligned = gv.match("gravity");
+  CHECK(exact && other_case && unaligned);
+  if (exact && other_case && unaligned) {
+    CHECK(*exact > *other_case);  // exact case scores higher
+    CHECK(*exact > *unaligned);   // matching segment starts scores higher
+    CHECK(*exact <= gv.bestScore(std::string_view("getValue").size()));
+  }
+  for (const char* word : {"getValue", "GetValue", "gravity", "xyz"}) {
+    CHECK(gv.mayMatch(FuzzyMatcher::signature(word)) || !gv.match(word));
+  }
+
+  FuzzyMatcher empty("");
+  CHECK(empty.match("anything") == 1.0f);
+}
+
+const Declaration* findDecl(const std::vector<Declaration>& decls, std::string_view name, bool definition) {
+  for (const auto& d : decls) {
+    if (d.name == name && d.definition == definition) return &d;
+  }
+  return nullptr;
+}
+
+void testDeclScanner() {
+  const std::vector<Declaration> decls = scanDeclarations(
+      "#define MAX_LEN 10\n"
+      "namespace ns {\n"
+      "struct S { int field; void method(); };\n"
+      "struct S s1;\n"
+      "class API_EXPORT Widget;\n"
+      "enum class Color : int { Red, Green };\n"
+      "typedef unsigned long ulong_t;\n"
+      "using Alias = int;\n"
+      "extern int ext;\n"
+      "int compute(int x) { int local = x; return local; }\n"
+      "void S::method() {}\n"
+      "#if 0\n"
+      "int hidden;\n"
+      "#endif\n"
+      "}\n");
+  auto expect = [&](std::string_view name, DeclKind kind, std::string_view container, bool definition, int line) {
+    const Declaration* d = findDecl(decls, name, definition);
+    CHECK(d != nullptr);
+    if (!d) {
+      std::fprintf(stderr, "  missing declaration: %.*s\n", static_cast<int>(name.size()), name.data());
+      return d;
+    }
+    CHECK(d->kind == kind);
+    CHECK(d->container == container);
+    CHECK(d->line == line);
+    return d;
+  };
+  expect("MAX_LEN", DeclKind::kMacro, "", true, 0);
+  expect("S", DeclKind::kStruct, "ns", true, 2);
+  expect("s1", DeclKind::kVariable, "ns", true, 3);  // not a forward declaration of "s1"
+  expect("Widget", DeclKind::kClass, "ns", false, 4);
+  expect("Color", DeclKind::kEnum, "ns", true, 5);
+  expect("Green", DeclKind::kEnumerator, "ns::Color", true, 5);
+  expect("ulong_t", DeclKind::kTypedef, "ns", true, 6);
+  expect("Alias", DeclKind::kTypedef, "ns", true, 7);
+  expect("ext", DeclKind::kVariable, "ns", false, 8);
+  if (const Declaration* d = expect("compute", DeclKind::kFunction, "ns", true, 9)) {
+    CHECK(d->column == 4);
+    CHECK(d->length == 7);
+    CHECK(!d->member);
+  }
+  if (const Declaration* d = expect("method", DeclKind::kFunction, "ns::S", false, 2)) CHECK(d->member);
+  if (const Declaration* d = expect("method", DeclKind::kFunction, "ns::S", true, 10)) CHECK(d->member);
+  CHECK(!findDecl(decls, "s1", false));
+  CHECK(!findDecl(decls, "field", true));   // members aren't namespace-scope variables
+  CHECK(!findDecl(decls, "local", true));   // function bodies are skipped
+  CHECK(!findDecl(decls, "hidden", true));  // #if 0
+  CHECK(scanDeclarations(std::string_view("int a;\0int b;", 13)).empty());  // binary
+}
+
+// Replays random edits on a Document and a plain string side by side.
+void testDocumentEdits() {
+  Document doc("line one\nline two\n");
+  doc.replace(doc.offsetAt(1, 5), doc.offsetAt(1, 8), "2");
+  CHECK(doc.str() == "line one\nline 2\n");
+  CHECK(doc.lineCount() == 3);
+  CHECK(doc.line(1) == "line 2");
+  CHECK(doc.offsetAt(7, 0) == doc.size());   // past the end: clamped
+  CHECK(doc.offsetAt(0, 99) == 8);           // past the end of the line: clamped
+
+  Document utf("a\xC3\xA9" "b\xF0\x9F\x98\x80" "c\r\nx");  // é is one UTF-16 unit, the emoji two
+  CHECK(utf.offsetAt(0, 2) == 3);
+  CHECK(utf.offsetAt(0, 5) == 8);
+  CHECK(utf.line(0) == "a\xC3\xA9" "b\xF0\x9F\x98\x80" "c");  // without the "\r"
+
+  std::mt19937 rng(1234);
+  std::string model;
+  for (int i = 0; i < 3000; ++i) model += "word" + std::to_string(i) + (i % 7 == 0 ? "\n" : " ");
+  Document big(model);
+  const char* inserts[] = {"", "x", "\n", "needle\n", "a\nb\nc"};
+  for (int step = 0; step < 400; ++step) {
+    const std::size_t begin = rng() % (model.size() + 1);
+    const std::size_t end = std::min(model.size(), begin + rng() % 64);
+    const std::string text = step % 97 == 0 ? std::string(20000, 'q') : inserts[rng() % 5];
+    model.replace(begin, end - begin, text);
+    big.replace(begin, end, text);
+  }
+  CHECK(big.str() == model);
+  CHECK(big.size() == model.size());
+  CHECK(big.lineCount() == static_cast<std::size_t>(std::count(model.begin(), model.end(), '\n')) + 1);
+  std::size_t start = 0;
+  for (int line = 0; line < static_cast<int>(big.lineCount()); ++line) {
+    const std::size_t nl = model.find('\n', start);
+    const std::string expected = model.substr(start, nl == std::string::npos ? std::string::npos : nl - start);
+    if (big.line(line) != expected || big.offsetAt(line, 0) != start) {
+      CHECK(big.line(line) == expected);
+      CHECK(big.offsetAt(line, 0) == start);
+      break;
+    }
+    start = nl + 1;
+  }
+  // Matches straddling chunk boundaries are found too.
+  CHECK(big.contains("needle") == (model.find("needle") != std::string::npos));
+  CHECK(big.contains("word2999") == (model.find("word2999") != std::string::npos));
+  CHECK(!big.contains("not in there"));
+}
+
+}  // namespace
+
+int main() {
+  testIgnoreRules();
+  testGitIndex();
+  testFuzzyMatcher();
+  testDeclScanner();
+  testDocumentEdits();
+  if (g_failures != 0) {
+    std::fprintf(stderr, "FAILED: %d checks\n", g_failures);
+    return 1;
+  }
+  std::printf("OK: ignore rules + git index + fuzzy matcher + declaration scanner + document edits\n");
+  return 0;
+}